@@ -0,0 +1,10 @@
+#version 120
+// Fragment shader for picking on the GPU. Writes the id of the object drawn.
+
+// The id in 8 bit per channel. Red holds the lowest byte.
+uniform vec4 id_color;
+
+void main(void)
+{
+	gl_FragColor = id_color;
+}
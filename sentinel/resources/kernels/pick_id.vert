@@ -0,0 +1,14 @@
+#version 120
+/** Vertex shader for picking on the GPU. Positions only.
+ * See Gpu_picker.
+ */
+
+attribute vec4 v_vertices;
+
+// camera*trans_rot_object, narrowed down to the pixels around the mouse.
+uniform mat4 A;
+
+void main(void)
+{
+	gl_Position = A * v_vertices;
+}
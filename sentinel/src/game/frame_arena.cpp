@@ -0,0 +1,76 @@
+/**
+ * Sentinel Gl -- an OpenGL based remake of the Firebird classic the Sentinel.
+ * Copyright (C) May 25th, 2015 Markus-Hermann Koch, mhk@markuskoch.eu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+#include "frame_arena.h"
+
+namespace game
+{
+void* Frame_arena::allocate_bytes(size_t bytes)
+{
+	// new char[] is aligned for any type. Hence so is each offset that
+	// is a multiple of ALIGNMENT.
+	bytes = (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+	frame_bytes += bytes;
+	if (used + bytes > capacity)
+	{
+		// Keep the full block until reset(). Its memory is still in use.
+		full_blocks.push_back(block);
+		capacity = (bytes > capacity) ? bytes : capacity;
+		block = new char[capacity];
+		used = 0;
+	}
+	void* res = block + used;
+	used += bytes;
+	return res;
+}
+
+void Frame_arena::reset()
+{
+	if (full_blocks.size() > 0)
+	{
+		for (vector<char*>::const_iterator CI=full_blocks.begin();CI!=full_blocks.end();CI++)
+		{
+			delete[] *CI;
+		}
+		full_blocks.clear();
+		delete[] block;
+		capacity = 2*frame_bytes;
+		block = new char[capacity];
+	}
+	used = 0;
+	frame_bytes = 0;
+}
+
+Frame_arena::Frame_arena(size_t capacity)
+{
+	if (capacity == 0) throw "Frame_arena capacity must be positive.";
+	this->capacity = capacity;
+	this->block = new char[capacity];
+	this->used = 0;
+	this->frame_bytes = 0;
+}
+
+Frame_arena::~Frame_arena()
+{
+	for (vector<char*>::const_iterator CI=full_blocks.begin();CI!=full_blocks.end();CI++)
+	{
+		delete[] *CI;
+	}
+	delete[] block;
+}
+}
@@ -18,7 +18,9 @@
 
 #include <cmath>
 #include <sstream>
+#include <QMutexLocker>
 #include "game.h"
+#include "profiler.h"
 
 // DEBUGGING CODE!
 #include <iostream>
@@ -41,12 +43,99 @@ const QVector4D Game::absorbed_light_factor(1./256., 128./256., 1./256.,1);
 
 Known_Sounds::~Known_Sounds()
 {
-	for (map<string,QSound*>::iterator IT=sounds.begin(); IT!=sounds.end();IT++)
+	for (int j=0;j<E_SOUND::NUMBER_OF_SOUNDS;j++)
 	{
-		delete (IT->second);
+		delete sounds[j];
 	}
 }
 
+//> Figure_index. ----------------------------------------------------
+void Figure_index::set_membership(vector<QPoint>& list, vector<int>& list_positions, QPoint pos, bool member)
+{
+	int key = pos.y()*board_fg->get_width()+pos.x();
+	int slot = list_positions[key];
+	if (member)
+	{
+		if (slot != -1) return; // Already listed.
+		list_positions[key] = (int)list.size();
+		list.push_back(pos);
+	} else {
+		if (slot == -1) return; // Not listed anyway.
+		QPoint last = list.back();
+		list[slot] = last;
+		list_positions[last.y()*board_fg->get_width()+last.x()] = slot;
+		list.pop_back();
+		list_positions[key] = -1;
+	}
+}
+
+bool Figure_index::is_antagonist_site(QPoint pos)
+{
+	return slots_antagonists[pos.y()*board_fg->get_width()+pos.x()] != -1;
+}
+
+void Figure_index::update(QPoint pos)
+{
+	revision++;
+	Figure* base = board_fg->get(pos);
+	Figure* top = base ? base->get_top_figure() : 0;
+	E_FIGURE_TYPE type = top ? top->get_type() : E_FIGURE_TYPE::TREE;
+	E_MATTER_STATE state = top ? top->get_state() : E_MATTER_STATE::STABLE;
+	bool is_meanie = top && type == E_FIGURE_TYPE::MEANIE;
+	set_membership(antagonists, slots_antagonists, pos, top && (is_meanie ||
+		type == E_FIGURE_TYPE::SENTRY || type == E_FIGURE_TYPE::SENTINEL));
+	set_membership(trees, slots_trees, pos, top && type == E_FIGURE_TYPE::TREE);
+	set_membership(transitions, slots_transitions, pos, top && state != E_MATTER_STATE::STABLE);
+	set_membership(occupied, slots_occupied, pos, base != 0);
+	if (is_meanie)
+	{
+		meanie = pos;
+	} else if (meanie == pos) {
+		meanie = QPoint(-1,-1);
+	}
+	Square_summary& summary = summaries[pos.y()*board_fg->get_width()+pos.x()];
+	if (base)
+	{
+		Figure_stack* stack = base->get_stack();
+		summary.stack_height = (unsigned char)stack->size();
+		summary.base_type = (unsigned char)base->get_type();
+		summary.top_type = (unsigned char)type;
+		summary.top_state = (unsigned char)state;
+		summary.number_of_blocks = (unsigned char)stack->get_number_of_blocks();
+		summary.has_robot = type == E_FIGURE_TYPE::ROBOT;
+	} else {
+		summary.stack_height = 0;
+		summary.number_of_blocks = 0;
+		summary.has_robot = false;
+	}
+}
+
+void Figure_index::rebuild()
+{
+	for (int y=0;y<board_fg->get_height();y++)
+	{
+		for (int x=0;x<board_fg->get_width();x++)
+		{
+			update(QPoint(x,y));
+		}
+	}
+}
+
+Figure_index::Figure_index(Board<Figure>* board_fg)
+{
+	this->board_fg = board_fg;
+	int n = board_fg->get_width()*board_fg->get_height();
+	this->slots_antagonists = vector<int>(n,-1);
+	this->slots_trees = vector<int>(n,-1);
+	this->slots_transitions = vector<int>(n,-1);
+	this->slots_occupied = vector<int>(n,-1);
+	this->summaries = vector<Square_summary>(n);
+	this->meanie = QPoint(-1,-1);
+	this->revision = 0;
+	rebuild();
+}
+//< ------------------------------------------------------------------
+
 void Game::update_game_status(E_UPDATE_GAME_STATUS_BY caller)
 {
 	// Note: I _hate_ switches within switches.
@@ -79,13 +168,10 @@ void Game::update_game_status(E_UPDATE_GAME_STATUS_BY caller)
 			this->status = E_GAME_STATUS::SENTINEL_ABSORBED;
 			sentinel_disintegrating = false;
 			update_statusBar_text(get_game_status_string());
-			for (int x=0;x<landscape->get_width();x++)
+			const vector<QPoint>& occupied = figure_index->get_occupied();
+			for (vector<QPoint>::const_iterator CI=occupied.begin();CI!=occupied.end();CI++)
 			{
-				for (int y=0;y<landscape->get_height();y++)
-				{
-					Figure* fig = board_fg->get(x,y);
-					if (fig != 0) fig->set_spin_period(0);
-				}
+				board_fg->get(*CI)->set_spin_period(0);
 			}
 		}
 		if (caller == E_UPDATE_GAME_STATUS_BY::HYPERSPACE ||
@@ -95,7 +181,7 @@ void Game::update_game_status(E_UPDATE_GAME_STATUS_BY caller)
 			{
 				this->status = E_GAME_STATUS::LOST;
 				update_statusBar_text(get_game_status_string());
-				known_sounds->play("defeat");
+				known_sounds->play(E_SOUND::SOUND_DEFEAT);
 			}
 		}
 	}
@@ -112,7 +198,7 @@ void Game::update_game_status(E_UPDATE_GAME_STATUS_BY caller)
 		if (caller == E_UPDATE_GAME_STATUS_BY::HYPERSPACE)
 		{
 			this->status = E_GAME_STATUS::WON;
-			known_sounds->play("victory");
+			known_sounds->play(E_SOUND::SOUND_VICTORY);
 			if (this->game_type==E_GAME_TYPE::CAMPAIGN)
 			{
 				update_campaign_code(player->get_energy_units());
@@ -123,6 +209,34 @@ void Game::update_game_status(E_UPDATE_GAME_STATUS_BY caller)
 	}
 }
 
+void Game::transmute_figure(QPoint pos, E_FIGURE_TYPE new_type)
+{
+	Figure* figure = board_fg->get(pos);
+	if (!figure) throw "Null pointer encountered.";
+	figure = figure->get_top_figure();
+	if (!figure->is_stable()) return;
+	E_FIGURE_TYPE old_type = figure->get_type();
+	figure->set_type(new_type,landscape->get_mesh(new_type));
+	figure_index->update(pos);
+	book_landscape_energy(Figure::get_energy_value(new_type) - Figure::get_energy_value(old_type));
+}
+
+void Game::book_landscape_energy(int delta)
+{
+	landscape_energy += delta;
+#ifdef MHK_DEBUG
+	int recount = recount_landscape_energy();
+	if (recount != landscape_energy)
+	{
+		ostringstream oss;
+		oss << "Energy ledger says " << landscape_energy << " while the board holds " <<
+			recount << ". Resynchronizing.";
+		io->println(E_DEBUG_LEVEL::WARNING, "Game::book_landscape_energy(..)", oss.str());
+		landscape_energy = recount;
+	}
+#endif
+}
+
 void Game::match_current_robot_to_viewer_Data()
 {
 	Figure* robot = board_fg->get(player->get_site());
@@ -138,11 +252,11 @@ void Game::match_current_robot_to_viewer_Data()
 bool Game::is_stack_of_stable_blocks(Figure* figure)
 {
 	if (!figure) return false;
-	vector<Figure*> vec = figure->get_above_figure_stack();
+	Figure_stack* stack = figure->get_stack();
 	bool purity = true;
-	for (vector<Figure*>::const_iterator CI=vec.begin();CI!=vec.end();CI++)
+	for (int j=figure->get_stack_index();j<stack->size();j++)
 	{
-		Figure* fig = *CI;
+		Figure* fig = stack->at(j);
 		if (!(fig->is_stable() && fig->get_type() == E_FIGURE_TYPE::BLOCK))
 		{
 			purity = false;
@@ -272,32 +386,12 @@ vector<QPoint> Game::restrict_to_free_non_CONNECTION(vector<QPoint> data)
 
 QPoint_Figure Game::find_stable_meanie()
 {
-	bool found_meanie = false;
-	Figure* meanie = 0;
-	QPoint site(-1,-1);
-	for (int x=0;x<landscape->get_width();x++)
-	{
-		for (int y=0;y<landscape->get_height();y++)
-		{
-			Figure* cand = board_fg->get(x,y);
-			if (!cand) continue;
-			cand->get_top_figure();
-			if (cand->get_type() == E_FIGURE_TYPE::MEANIE)
-			{
-				if (cand->is_stable())
-				{
-					meanie = cand;
-					site.setX(x);
-					site.setY(y);
-				}
-				// Note that there is only one meanie anyways, no matter
-				// what its matter state is.
-				found_meanie = true;
-			}
-			if (found_meanie) break;
-		}
-		if (found_meanie) break;
-	}
+	// Note that there is only one meanie anyways, no matter
+	// what its matter state is.
+	QPoint site = figure_index->get_meanie();
+	if (site.x() == -1) return QPoint_Figure();
+	Figure* meanie = board_fg->get(site)->get_top_figure();
+	if (!meanie->is_stable()) return QPoint_Figure();
 	return QPoint_Figure(site,meanie);
 }
 
@@ -305,69 +399,61 @@ void Game::revert_meanie_to_tree()
 {
 	QPoint_Figure meanie_data = find_stable_meanie();
 	QPoint site = meanie_data.pos;
-	Figure* meanie = meanie_data.fig;
 	if (site.x()!=-1)
 	{
-		meanie->set_type(E_FIGURE_TYPE::TREE,landscape->get_mesh(E_FIGURE_TYPE::TREE));
-		known_sounds->play("frog_reverse");
+		transmute_figure(site,E_FIGURE_TYPE::TREE);
+		known_sounds->play(E_SOUND::SOUND_FROG_REVERSE);
 	}
-	QTimer* h = meanie_timer;
-	meanie_timer = 0;
-	delete h;
+	meanie_timer->stop();
+	meanie_active = false;
 }
 
 void Game::meanie_timeout_slot()
 {
+	QMutexLocker locker(&mutex);
 	revert_meanie_to_tree();
 	update_statusBar_text(QObject::tr("Hyperdrive coil flux restabilized."));
 }
 
 void Game::antagonist_summon_meanie(QPoint antagonist_pos, Figure* antagonist)
 {
-	if (meanie_timer) return; // Nothing to do. There is a meanie already.
+	if (meanie_active) return; // Nothing to do. There is a meanie already.
 	//> Step 1: Transmute a tree into a meanie. ----------------------
-	vector<Antagonist_target> trees = this->get_antagonist_targets(antagonist_pos, true);
+	const vector<Antagonist_target>& trees = antagonist->get_sight().trees;
 	if (trees.size() == 0) return; // No trees no meanies.
 	uint index = qrand() % trees.size();
 	Antagonist_target target = trees.at(index);
+	// The sight may be a few ticks old. The tree may be gone by now.
 	Figure* tree = board_fg->get(target.board_pos);
-	if (!tree) throw "Null pointer encountered.";
+	if (!tree) return;
 	tree = tree->get_top_figure();
 	if (!tree->is_stable()) return; // Never mind. Try again the next frame!
-	if (!tree->get_type() == E_FIGURE_TYPE::TREE) throw "Tree is not a tree.";
-	tree->set_type(E_FIGURE_TYPE::MEANIE,landscape->get_mesh(E_FIGURE_TYPE::MEANIE));
-	known_sounds->play("frog");
+	if (tree->get_type() != E_FIGURE_TYPE::TREE) return;
+	transmute_figure(target.board_pos,E_FIGURE_TYPE::MEANIE);
+	known_sounds->play(E_SOUND::SOUND_FROG);
 	update_statusBar_text(QObject::tr("Warning! Hyperdrive coil flux unstable."));
 	//< --------------------------------------------------------------
 	//> Step 2: Set up the meanie lifetime timer. --------------------
 	{
-		meanie_timer = new QTimer(this);
-		meanie_timer->setSingleShot(true);
-		connect(meanie_timer, SIGNAL(timeout()), this, SLOT(meanie_timeout_slot()));
-		
+		meanie_active = true;
 		float spin = tree->get_spin_period();
 		if (spin < 0) spin = -spin;
 		int lifetime = (int)((spin/DEFAULT_MEANIE_SPEED_FACTOR + 
 			 2.0 * DEFAULT_FADING_TIME) * 1000);
-		meanie_timer->start(lifetime);
+		// Called from the simulation thread. The timer lives in the GUI thread.
+		QMetaObject::invokeMethod(this, "start_meanie_timer", Qt::QueuedConnection,
+			Q_ARG(int, lifetime));
 	}
 	//< --------------------------------------------------------------
 }
 
 void Game::antagonist_tree_manifestation(QPoint antagonist_pos, Figure* antagonist)
 {
-	int alt = landscape->get_board_sq()->get(antagonist_pos)->get_altitude() +
-	antagonist->get_altitude_above_square();
-	multimap<float,QPoint> mm = scanner->get_all_board_positions_in_h_fov(
-		antagonist->get_eye_position_in_world(antagonist_pos,alt),
-		antagonist->get_direction(),
-		antagonist->get_fov(),
-		landscape->get_width(),
-		landscape->get_height()
-	);
-	vector<QPoint> view = restrict_to_free_non_CONNECTION(
-		scanner->convert_ordered_multimap_to_vector(mm));
-	QPoint tree_pos = landscape->pick_initially_free_random_square(view);
+	// The sight may be a few ticks old and trees may have been planted since.
+	// Hence check the squares again.
+	vector<QPoint> free_view = restrict_to_free_non_CONNECTION(
+		antagonist->get_sight().free_squares);
+	QPoint tree_pos = landscape->pick_initially_free_random_square(free_view);
 	if (tree_pos.x()!= -1)
 	{
 		manifest_figure(tree_pos, E_FIGURE_TYPE::TREE, false);
@@ -380,11 +466,11 @@ bool Game::antagonist_attack(QPoint pos_player, QPoint pos_antagonist,
 	bool hitPlayer = false;
 	E_VISIBILITY player_vis = E_VISIBILITY::HIDDEN;
 //cout << "targets:" << targets.size() << endl;
-	vector<Attack_duration> attacks = antagonist->mount_attacks(targets);
+	const vector<Attack_duration>& attacks = antagonist->mount_attacks(targets);
 //cout << "attacks:" << attacks.size() << endl;
-	for (vector<Attack_duration>::iterator IT=attacks.begin();IT!=attacks.end();IT++)
+	for (vector<Attack_duration>::const_iterator CI=attacks.begin();CI!=attacks.end();CI++)
 	{
-		Attack_duration& attack = *IT;
+		const Attack_duration& attack = *CI;
 		if (attack.board_pos == pos_player)
 		{
 			hitPlayer = true;
@@ -408,7 +494,7 @@ bool Game::antagonist_attack(QPoint pos_player, QPoint pos_antagonist,
 					{
 						// Damage control.
 						int energy = player->update_energy_units(-1);
-						known_sounds->play("tick");
+						known_sounds->play(E_SOUND::SOUND_TICK);
 						player->reset_confidence();
 						update_statusBar_energy(energy);
 						if (energy < 0)
@@ -425,7 +511,7 @@ bool Game::antagonist_attack(QPoint pos_player, QPoint pos_antagonist,
 						antagonist_summon_meanie(pos_antagonist,antagonist);
 					}
 				} else { // antagonist->get_type() == E_FIGURE_TYPE::MEANIE
-					if (!hyperspace_timer)
+					if (!hyperspace_charging)
 					{
 						hyperspace_request();
 					}
@@ -451,15 +537,16 @@ bool Game::antagonist_attack(QPoint pos_player, QPoint pos_antagonist,
 						switch (victim->get_type())
 						{
 							case E_FIGURE_TYPE::ROBOT:
-								victim->set_type(E_FIGURE_TYPE::BLOCK,landscape->get_mesh(E_FIGURE_TYPE::BLOCK));
+								transmute_figure(attack.board_pos,E_FIGURE_TYPE::BLOCK);
 								break;
 							case E_FIGURE_TYPE::BLOCK:
-								victim->set_type(E_FIGURE_TYPE::TREE,landscape->get_mesh(E_FIGURE_TYPE::TREE));
+								transmute_figure(attack.board_pos,E_FIGURE_TYPE::TREE);
 								break;
 							case E_FIGURE_TYPE::TREE:
 								if (!is_base)
 								{
 									victim->set_state(E_MATTER_STATE::DISINTEGRATING,false);
+									figure_index->update(attack.board_pos);
 									break;
 								}
 							default: io->println(E_DEBUG_LEVEL::WARNING,
@@ -480,10 +567,7 @@ E_ANTAGONIST_ACTION Game::antagonist_turn_direction(QPoint pos_robot,
 {
 	float dx = (float)(pos_robot.x() - pos_antagonist.x());
 	float dy = (float)(pos_robot.y() - pos_antagonist.y());
-	QVector3D dir(dx,dy,0);
-	QMatrix4x4 A; A.setToIdentity();
-	A.rotate(-phi,QVector3D(0,0,1));
-	dir = A*dir;
+	QVector3D dir = Rotation_2d(-phi).apply_z(QVector3D(dx,dy,0));
 	dir.normalize();
 	E_ANTAGONIST_ACTION res = E_ANTAGONIST_ACTION::STILL;
 	if (dir.y() <= -0.05 || dir.y() >= 0.05)
@@ -507,7 +591,11 @@ E_ANTAGONIST_ACTION Game::antagonist_action(QPoint pos_antagonist, Figure* antag
 	if (antagonist->is_antagonist())
 	{
 		//> Determine turning direction. -----------------------------
-		vector<Antagonist_target> targets = this->get_antagonist_targets(pos_antagonist);
+		// Targets are rescanned by scan_antagonists(). They are attacked
+		// each tick regardless. Thus Attack_durations count ticks as ever.
+		if (antagonist->get_scan_age() < 0) scan_antagonist(pos_antagonist, antagonist);
+		vector<Antagonist_target>& targets = antagonist->get_sight().targets;
+		update_player_target(pos_antagonist, antagonist, targets);
 		QPoint pos_player = find_player_in_targets(targets);
 		if (pos_player.x() >= 0)
 		{
@@ -520,34 +608,69 @@ E_ANTAGONIST_ACTION Game::antagonist_action(QPoint pos_antagonist, Figure* antag
 		}
 		//< ----------------------------------------------------------
 		//> Attack! --------------------------------------------------
+		Timing_zone timing(E_TIMING_ZONE::ANTAGONIST_ATTACK);
 		hitPlayer = antagonist_attack(pos_player, pos_antagonist, antagonist, targets);
 		//< ----------------------------------------------------------
 	}
 	return action;
 }
 
-vector<QPoint_Figure> Game::get_all_top_figures()
+void Game::publish_snapshot()
 {
-	vector<QPoint_Figure> res;
-	for (int x=0;x<landscape->get_width();x++)
+	Render_snapshot* snapshot = snapshots->get_back();
+	snapshot->camera = player->get_viewer_data()->get_camera();
+	snapshot->frustum = player->get_viewer_data()->get_frustum();
+	snapshot->board_revision = get_board_revision();
+	snapshot->figures.clear();
+	QPoint player_site = player->get_site();
+	bool draw_self = status == E_GAME_STATUS::SURVEY;
+	const vector<QPoint>& occupied = figure_index->get_occupied();
+	for (vector<QPoint>::const_iterator CI=occupied.begin();CI!=occupied.end();CI++)
 	{
-		for (int y=0;y<landscape->get_height();y++)
+		Figure_stack* fgs = board_fg->get(*CI)->get_stack();
+		QMatrix4x4 A; A.setToIdentity();
+		A.translate(CI->x(),CI->y(),landscape->get_altitude(CI->x(),CI->y()));
+		for (int j=0;j<fgs->size();j++)
 		{
-			Figure* figure = board_fg->get(x,y);
-			if (figure)
+			Figure* f = fgs->at(j);
+			if (!draw_self && *CI == player_site &&
+				f->get_type()==E_FIGURE_TYPE::ROBOT
+			) continue; // Don't draw self unless in SURVEY mode.
+			// B: tranlate*rotate*scale for the object.
+			Figure_snapshot item;
+			item.mesh = f->get_mesh_prototype();
+			item.figure = f;
+			item.site = *CI;
+			item.pickable = *CI != player_site && f->get_state()==E_MATTER_STATE::STABLE;
+			item.transformation = A;
+			item.transformation.rotate(f->get_phi(),QVector3D(0,0,1));
+			float scale = Render_snapshot::get_appropriate_scale(f);
+			item.transformation.scale(scale);
+			item.fade = f->get_fade();
+			QVector3D foot = A.column(3).toVector3D();
+			item.bounds = item.mesh->bounds.transformed(foot, f->get_phi(), scale);
+			snapshot->figures.push_back(item);
+			if (f->get_state()==E_MATTER_STATE::TRANSMUTING && scale > 0 && f->get_old_mesh())
 			{
-				figure = figure->get_top_figure();
-				res.push_back(QPoint_Figure(QPoint(x,y),figure));
-//vector<Figure*> v = figure->get_above_figure_stack();
-//res.insert( res.end(), v.begin(), v.end() );
+				float old_mesh_fade = 1-f->get_fade();
+				item.mesh = f->get_old_mesh();
+				item.transformation.scale(old_mesh_fade/scale);
+				item.fade = old_mesh_fade;
+				item.pickable = false;
+				item.bounds = item.mesh->bounds.transformed(foot, f->get_phi(), old_mesh_fade);
+				snapshot->figures.push_back(item);
 			}
+			// The next figure in the stack will be on the new figure.
+			A.translate(QVector3D(0,0,Figure::get_height(f->get_type())));
 		}
 	}
-	return res;
+	snapshots->publish();
 }
 
 bool Game::do_progress(float dt)
 {
+	Timing_zone timing(E_TIMING_ZONE::DO_PROGRESS);
+	scanner->reset_arena();
 	//> Check game state for progress-ability. -----------------------
 	if (
 		(get_status() != E_GAME_STATUS::RUNNING) &&
@@ -557,18 +680,33 @@ bool Game::do_progress(float dt)
 	// Note that, as in real life, progress only ever happens to
 	// top-of-the-stack figures.
 	bool relevant_progress = false;
-	vector<QPoint_Figure> pfigures = get_all_top_figures();
 	bool hitPlayerOnce = false;
-	for (vector<QPoint_Figure>::const_iterator CI=pfigures.begin();CI!=pfigures.end();CI++)
+	//> Antagonists look. --------------------------------------------
+	update_player_viewshed();
+	scan_antagonists();
+	//< --------------------------------------------------------------
+	//> Antagonists attack and turn. ---------------------------------
+	// Indexing instead of iterating: A meanie summoned during this loop
+	// will be appended to the list. Nothing is removed from it here.
+	const vector<QPoint>& antagonists = figure_index->get_antagonists();
+	for (uint j=0;j<antagonists.size();j++)
 	{
-		QPoint pos = CI->pos;
-		Figure* figure = CI->fig;
+		QPoint pos = antagonists[j];
+		Figure* figure = board_fg->get(pos)->get_top_figure();
 		bool hitPlayer;
 		E_ANTAGONIST_ACTION action = antagonist_action(pos,figure,hitPlayer);
 		if (hitPlayer) hitPlayerOnce = true;
-		bool new_progress = figure->progress(dt, action);
+		bool new_progress = progress_kernel->add_rotation(figure, action);
 		relevant_progress = relevant_progress || new_progress;
 	}
+	progress_kernel->progress_rotations(dt);
+	// Turned antagonists are picked differently.
+	if (relevant_progress) figure_index->touch();
+	//< --------------------------------------------------------------
+	//> Figures in transition fade. Goners are removed. --------------
+	bool new_progress = progress_transitions(dt);
+	relevant_progress = relevant_progress || new_progress;
+	//< --------------------------------------------------------------
 	//< --------------------------------------------------------------
 	//> Regenerate player shields if appropriate. --------------------
 	//> Peace attained. Regenerate. ----------------------------------
@@ -586,8 +724,6 @@ bool Game::do_progress(float dt)
 		request_paintGL();
 	}
 	//< --------------------------------------------------------------
-	//< --------------------------------------------------------------
-	remove_goners_from_board();
 	return relevant_progress;
 }
 
@@ -603,7 +739,7 @@ E_POSSIBLE_PLAYER_ACTION Game::get_mouse_target(float mouse_gl_x, float mouse_gl
 	return get_possible_interactions(board_pos,figure);
 }
 
-vector<Antagonist_target> Game::get_antagonist_targets(QPoint board_pos, bool seek_trees)
+void Game::get_antagonist_targets(QPoint board_pos, Antagonist_sight& res)
 {
 	Figure* antagonist = this->get_board_fg()->get(board_pos);
 	antagonist = antagonist->get_top_figure();
@@ -613,16 +749,93 @@ vector<Antagonist_target> Game::get_antagonist_targets(QPoint board_pos, bool se
 	if (alt < 0) throw "Antagonist situated on slope square.";
 	alt += antagonist->get_altitude_above_square();
 	QVector3D site((float)board_pos.x(),(float)board_pos.y(),(float)alt);
-	QMatrix4x4 trans_rot; trans_rot.setToIdentity();
-	trans_rot.translate(site);
-	trans_rot.rotate(phi,QVector3D(0,0,1));
+	Rotation_2d rot(phi);
 	QVector3D eye_prototype = Figure::get_eye_position_relative_to_figure(antagonist->get_type());
-	QVector3D eye = trans_rot * eye_prototype;
-	QVector2D dir(cos(PI*phi/180.),sin(PI*phi/180.));
-	vector<Antagonist_target> res = scanner->get_antagonist_targets(
-		eye, dir, antagonist->get_fov(), get_landscape(), get_board_fg(),
-		seek_trees);
-	return res;
+	QVector3D eye = site + rot.apply_z(eye_prototype);
+	QVector2D dir(rot.c,rot.s);
+	scanner->get_antagonist_targets(
+		eye, dir, antagonist->get_fov(), get_landscape(),
+		figure_index->get_summaries(), res);
+}
+
+void Game::update_player_viewshed()
+{
+	QPoint site = player->get_site();
+	Figure* base = board_fg->get(site);
+	int number_of_blocks = base ? base->get_stack()->get_number_of_blocks() : 0;
+	if (site == player_viewshed->get_site() &&
+		number_of_blocks == player_viewshed->get_number_of_blocks()) return;
+	player_viewshed->compute(landscape, site, number_of_blocks);
+}
+
+void Game::update_player_target(QPoint pos_antagonist, Figure* antagonist,
+	vector<Antagonist_target>& targets)
+{
+	QPoint player_site = player->get_site();
+	for (vector<Antagonist_target>::iterator IT=targets.begin();IT!=targets.end();)
+	{
+		if (IT->board_pos == player_site)
+		{
+			IT = targets.erase(IT);
+		} else {
+			IT++;
+		}
+	}
+	int alt = landscape->get_board_sq()->get(pos_antagonist)->get_altitude() +
+		antagonist->get_altitude_above_square();
+	E_VISIBILITY vis = player_viewshed->get_visibility(
+		pos_antagonist,
+		antagonist->get_eye_position_in_world(pos_antagonist,alt),
+		antagonist->get_direction(),
+		antagonist->get_fov()
+	);
+	if (vis != E_VISIBILITY::HIDDEN) targets.push_back(Antagonist_target(vis,player_site));
+}
+
+void Game::scan_antagonist(QPoint board_pos, Figure* antagonist)
+{
+	Timing_zone timing(E_TIMING_ZONE::ANTAGONIST_SCAN);
+	get_antagonist_targets(board_pos, antagonist->get_sight());
+	antagonist->mark_scanned();
+}
+
+void Game::scan_antagonists()
+{
+	const vector<QPoint>& antagonists = figure_index->get_antagonists();
+	uint n = antagonists.size();
+	if (n == 0) return;
+	if (scan_cursor >= n) scan_cursor = 0;
+	for (vector<QPoint>::const_iterator CI=antagonists.begin();CI!=antagonists.end();CI++)
+	{
+		board_fg->get(*CI)->get_top_figure()->age_scan();
+	}
+	Profiler* profiler = Profiler::get_instance();
+	qint64 start = profiler->now();
+	qint64 budget = ((qint64)scan_budget_us)*1000;
+	uint next_cursor = scan_cursor;
+	// Pass 0 scans the urgent antagonists, pass 1 anybody.
+	for (int pass=0;pass<2;pass++)
+	{
+		for (uint k=0;k<n;k++)
+		{
+			uint j = (scan_cursor + k) % n;
+			QPoint pos = antagonists[j];
+			Figure* figure = board_fg->get(pos)->get_top_figure();
+			if (!figure->is_antagonist()) continue;
+			int age = figure->get_scan_age();
+			if (age == 0) continue; // Scanned in pass 0.
+			// Due ones are scanned regardless of the budget. Hence no sight
+			// is ever older than MAX_SCAN_AGE_TICKS.
+			bool is_due = age < 0 || age >= MAX_SCAN_AGE_TICKS;
+			bool urgent = is_due || figure->is_attacking() ||
+				find_player_in_targets(figure->get_sight().targets).x() >= 0;
+			if (pass == 0 && !urgent) continue;
+			if (!is_due && budget > 0 && profiler->now() - start >= budget) continue;
+			scan_antagonist(pos, figure);
+			next_cursor = (j + 1) % n;
+		}
+	}
+	scan_cursor = next_cursor;
 }
 
 QString Game::get_game_status_string()
@@ -641,7 +854,7 @@ QString Game::get_game_status_string()
 				QObject::tr(
 				"Victory! Interlandscape warp in progress. "
 				"Missed landscape energy: ").toStdString().c_str() <<
-				(count_landscape_energy()-8) <<
+				(landscape_energy-8) <<
 				".";
 			res = oss.str().c_str();
 			break;
@@ -651,23 +864,17 @@ QString Game::get_game_status_string()
 	return res;
 }
 
-int Game::count_landscape_energy()
+int Game::recount_landscape_energy()
 {
 	int energy = 0;
-	for (int x=0;x<landscape->get_width();x++)
+	const vector<QPoint>& occupied = figure_index->get_occupied();
+	for (vector<QPoint>::const_iterator CI=occupied.begin();CI!=occupied.end();CI++)
 	{
-		for (int y=0;y<landscape->get_height();y++)
+		Figure_stack* stack = board_fg->get(*CI)->get_stack();
+		for (int j=0;j<stack->size();j++)
 		{
-			Figure* base = board_fg->get(QPoint(x,y));
-			if (base)
-			{
-				vector<Figure*> stack = base->get_above_figure_stack();
-				for (vector<Figure*>::const_iterator CI=stack.begin();CI!=stack.end();CI++)
-				{
-					E_FIGURE_TYPE type = (*CI)->get_type();
-					energy += Figure::get_energy_value(type);
-				}
-			}
+			E_FIGURE_TYPE type = stack->at(j)->get_type();
+			energy += Figure::get_energy_value(type);
 		}
 	}
 	return energy;
@@ -792,6 +999,17 @@ bool Game::manifest_figure(QPoint pos, E_FIGURE_TYPE type, bool by_robot)
 	{
 		return false;
 	}
+	if (base_figure && base_figure->get_stack()->is_full())
+	{
+		if (by_robot)
+		{
+			ostringstream oss;
+			oss << "This stack is full. It holds no more than " <<
+				MAX_FIGURE_STACK_HEIGHT << " objects.";
+			update_statusBar_text(tr(oss.str().c_str()));
+		}
+		return false;
+	}
 	//< --------------------------------------------------------------
 	if (base_figure) base_figure = base_figure->get_top_figure();
 	if (by_robot)
@@ -849,8 +1067,10 @@ bool Game::manifest_figure(QPoint pos, E_FIGURE_TYPE type, bool by_robot)
 	} else {
 		board_fg->set(pos,new_figure);
 	}
+	figure_index->update(pos);
+	book_landscape_energy(Figure::get_energy_value(type));
 	update_game_status(E_UPDATE_GAME_STATUS_BY::MANIFESTOR);
-	known_sounds->play("delayed_plop");
+	known_sounds->play(E_SOUND::SOUND_DELAYED_PLOP);
 	return true;
 }
 
@@ -864,12 +1084,13 @@ void Game::disintegrate_figure(QPoint pos, bool by_robot)
 		fig = fig->get_top_figure();
 		if (fig->get_state() != E_MATTER_STATE::STABLE) return;
 		fig->set_state(E_MATTER_STATE::DISINTEGRATING, by_robot);
+		figure_index->update(pos);
 		if (fig->get_type()==E_FIGURE_TYPE::SENTINEL)
 		{
-			known_sounds->play("absorption_sentinel");
+			known_sounds->play(E_SOUND::SOUND_ABSORPTION_SENTINEL);
 			sentinel_disintegrating = true;
 		} else {
-			known_sounds->play("absorption");
+			known_sounds->play(E_SOUND::SOUND_ABSORPTION);
 		}
 	}
 	update_game_status(E_UPDATE_GAME_STATUS_BY::DISINTEGRATOR);
@@ -883,16 +1104,17 @@ bool Game::hyperspace_request()
 		update_statusBar_text(tr("Hyperdrive not available at this time."));
 		return false;
 	}
-	if (hyperspace_timer != 0)
+	if (hyperspace_charging)
 	{
 		update_statusBar_text(tr("Hyperdrive already in charging process."));
 		return false;
 	}
 	update_statusBar_text(tr("Hyperdrive activated. Charging coils now."));
-	hyperspace_timer = new QTimer(this);
-	hyperspace_timer->setSingleShot(true);
-    connect(hyperspace_timer, SIGNAL(timeout()), this, SLOT(hyperspace_jump()));
-    hyperspace_timer->start(DEFAULT_HYPERDRIVE_CHARGING_TIME);
+	hyperspace_charging = true;
+	// A meanie may request this from within the simulation thread.
+	int charging_time = (int)DEFAULT_HYPERDRIVE_CHARGING_TIME;
+	QMetaObject::invokeMethod(this, "start_hyperspace_timer", Qt::QueuedConnection,
+		Q_ARG(int, charging_time));
 	set_light_filtering_factor(hyperspace_light_factor,0);
 	return true;
 }
@@ -937,9 +1159,9 @@ QPoint Game::pick_hyperspace_destination(QPoint old_site, int old_alt)
 
 void Game::hyperspace_jump()
 {
-	if (!hyperspace_timer) throw "Unauthorized hyperdrive request!! Use hyperspace_timer.";
-	delete hyperspace_timer;
-	hyperspace_timer = 0;
+	QMutexLocker locker(&mutex);
+	if (!hyperspace_charging) throw "Unauthorized hyperdrive request!! Use hyperspace_timer.";
+	hyperspace_charging = false;
 
 	//> The order of these commands is important. --------------------
 	update_game_status(E_UPDATE_GAME_STATUS_BY::HYPERSPACE);
@@ -949,7 +1171,7 @@ void Game::hyperspace_jump()
 	update_game_status(E_UPDATE_GAME_STATUS_BY::HYPERSPACE);
 	if (status == E_GAME_STATUS::LOST) { return; }
 	//< --------------------------------------------------------------	
-	known_sounds->play("plop");
+	known_sounds->play(E_SOUND::SOUND_PLOP);
 	float new_phi = landscape->get_random_angle();
 	QPoint old_site = player->get_site();
 	int old_alt = landscape->get_board_sq()->get(old_site)->get_altitude() +
@@ -976,6 +1198,8 @@ void Game::hyperspace_jump()
 	);
 	if (board_fg->get(new_site)) throw "Hyperspace target square not empty. This is a bug.";
 	board_fg->set(new_site,new_robot);
+	figure_index->update(new_site);
+	book_landscape_energy(Figure::get_energy_value(E_FIGURE_TYPE::ROBOT));
 	set_light_filtering_factor(hyperspace_light_factor,1);
 	transfer(new_site);
 	revert_meanie_to_tree();
@@ -1009,48 +1233,95 @@ void Game::transfer(QPoint destination)
 	update_game_status(E_UPDATE_GAME_STATUS_BY::TRANSFER);
 }
 
-void Game::remove_goners_from_board()
+bool Game::progress_transitions(float dt)
 {
+	Timing_zone timing(E_TIMING_ZONE::TRANSITIONS);
 	bool absorbed_the_sentinel = false;
 	int energy_for_robot = 0;
-	for (int x=0;x<this->landscape->get_width();x++)
+	const vector<QPoint>& transitions = figure_index->get_transitions();
+	bool relevant_progress = false;
+	//> Fade all at once. --------------------------------------------
+	for (vector<QPoint>::const_iterator CI=transitions.begin();CI!=transitions.end();CI++)
 	{
-		for (int y=0;y<this->landscape->get_height();y++)
+		Figure* fig = board_fg->get(*CI);
+		if (fig && progress_kernel->add_fade(fig->get_top_figure())) relevant_progress = true;
+	}
+	progress_kernel->progress_fades(dt);
+	//< --------------------------------------------------------------
+	// Going backwards through the list is safe since update(..)
+	// moves only already visited entries.
+	for (int j=(int)transitions.size()-1;j>=0;j--)
+	{
+		QPoint pos = transitions[j];
+		Figure* fig = board_fg->get(pos);
+		if (fig)
 		{
-			Figure* fig = board_fg->get(x,y);
-			if (fig)
+			Figure* top = fig->get_top_figure();
+			if (!top->is_gone())
 			{
-				Figure* top = fig->get_top_figure();
-				if (top->is_gone() && top->get_type() == E_FIGURE_TYPE::SENTINEL)
-				{
-					absorbed_the_sentinel = true;
-				}
-				// Case 1: Check for gone top-of-the-stack-figure.
-				energy_for_robot += fig->check_for_and_delete_top_figure(true);
-				// Case 2: Check if this base figure is gone.
-				if (fig->is_gone())
-				{
-					energy_for_robot += fig->get_energy_for_robot();
-					board_fg->set(x,y,0);
-					delete fig;
-				}
+				// Figures having become STABLE drop out of the list.
+				if (top->is_stable()) figure_index->update(pos);
+				continue;
 			}
+			if (top->get_type() == E_FIGURE_TYPE::SENTINEL)
+			{
+				absorbed_the_sentinel = true;
+			}
+			int energy_removed = Figure::get_energy_value(top->get_type());
+			// Case 1: Check for gone top-of-the-stack-figure.
+			energy_for_robot += fig->check_for_and_delete_top_figure(true);
+			// Case 2: Check if this base figure is gone.
+			if (fig->is_gone())
+			{
+				energy_for_robot += fig->get_energy_for_robot();
+				board_fg->set(pos,0);
+				delete fig;
+			}
+			figure_index->update(pos);
+			book_landscape_energy(-energy_removed);
 		}
 	}
-	player->update_energy_units(energy_for_robot);
-	update_statusBar_energy(player->get_energy_units());
+	if (energy_for_robot != 0)
+	{
+		player->update_energy_units(energy_for_robot);
+		update_statusBar_energy(player->get_energy_units());
+	}
 	if (absorbed_the_sentinel) update_game_status(E_UPDATE_GAME_STATUS_BY::GONER_REMOVER);
+	return relevant_progress;
+}
+
+void Game::start_meanie_timer(int msec)
+{
+	if (timers_paused)
+	{
+		meanie_timer_remaining = msec;
+		meanie_timer_paused = true;
+		return;
+	}
+	meanie_timer->start(msec);
+}
+
+void Game::start_hyperspace_timer(int msec)
+{
+	if (timers_paused)
+	{
+		hyperspace_timer_remaining = msec;
+		hyperspace_timer_paused = true;
+		return;
+	}
+	hyperspace_timer->start(msec);
 }
 
 void Game::pause_timers()
 {
-	if (hyperspace_timer && hyperspace_timer->isActive())
+	timers_paused = true;
+	if (hyperspace_timer->isActive())
 	{
 		hyperspace_timer_remaining = hyperspace_timer->remainingTime();
 		hyperspace_timer->stop();
 		hyperspace_timer_paused = true;
 	}
-	if (meanie_timer && meanie_timer->isActive())
+	if (meanie_timer->isActive())
 	{
 		meanie_timer_remaining = meanie_timer->remainingTime();
 		meanie_timer->stop();
@@ -1060,14 +1331,15 @@ void Game::pause_timers()
 
 void Game::unpause_timers()
 {
-	if (hyperspace_timer && hyperspace_timer_paused)
+	if (hyperspace_timer_paused)
 	{
 		hyperspace_timer->start(hyperspace_timer_remaining);
 	}
-	if (meanie_timer && meanie_timer_paused)
+	if (meanie_timer_paused)
 	{
 		meanie_timer->start(meanie_timer_remaining);
 	}
+	timers_paused = false;
 	reset_timer_helpers();
 }
 
@@ -1085,18 +1357,28 @@ Game::Game(E_GAME_TYPE type, uint seed, Setup_game_data* setup, QOpenGLWidget* p
 	Mesh_Data* mesh_sentinel, Mesh_Data* mesh_sentinel_tower, Mesh_Data* mesh_sentry,
 	Mesh_Data* mesh_tree, Mesh_Data* mesh_robot,
 	Mesh_Data* mesh_block, Mesh_Data* mesh_meanie)
+	: mutex(QMutex::Recursive)
 {
 	this->framerate = framerate;
+	this->scan_budget_us = DEFAULT_SCAN_BUDGET_US;
+	this->scan_cursor = 0;
 	this->object_resilience = (float)(setup->spinBox_object_resilience);
-	this->meanie_timer = 0;
+	this->meanie_timer = new QTimer(this);
+	meanie_timer->setSingleShot(true);
+	connect(meanie_timer, SIGNAL(timeout()), this, SLOT(meanie_timeout_slot()));
+	this->meanie_active = false;
 	this->io = io;
 	this->known_sounds = known_sounds;
 	this->scanner = new Scanner(io);
 	this->game_type = type;
 	this->status = E_GAME_STATUS::SURVEY;
-	this->hyperspace_timer = 0;
+	this->hyperspace_timer = new QTimer(this);
+	hyperspace_timer->setSingleShot(true);
+	connect(hyperspace_timer, SIGNAL(timeout()), this, SLOT(hyperspace_jump()));
+	this->hyperspace_charging = false;
 	this->do_meanies = setup->checkBox_meanies;
 	this->sentinel_disintegrating = false;
+	this->timers_paused = false;
 	reset_timer_helpers();
 	//> Setup Landscape object. --------------------------------------
 	this->landscape = new Landscape(
@@ -1125,6 +1407,11 @@ Game::Game(E_GAME_TYPE type, uint seed, Setup_game_data* setup, QOpenGLWidget* p
 		mesh_meanie
    	);
 	this->board_fg = landscape->get_new_initialized_board_fg();
+	this->figure_index = new Figure_index(board_fg);
+	this->progress_kernel = new Progress_kernel();
+	this->player_viewshed = new Player_viewshed();
+	this->snapshots = new Snapshot_buffer();
+	this->landscape_energy = recount_landscape_energy();
 	//< --------------------------------------------------------------
 	//> Setup Player object. -----------------------------------------
 	this->player = new Player_Data(
@@ -1141,13 +1428,19 @@ Game::Game(E_GAME_TYPE type, uint seed, Setup_game_data* setup, QOpenGLWidget* p
 	player->get_viewer_data()->set_direction(0,115);
 	set_survey_view_data(0,0);
 	//< --------------------------------------------------------------
+	publish_snapshot();
 }
 
 Game::~Game()
 {
 	delete scanner;
+	delete figure_index;
+	delete progress_kernel;
+	delete player_viewshed;
+	delete snapshots;
 	delete player;
 	delete landscape;
 	delete hyperspace_timer;
+	delete meanie_timer;
 }
 }
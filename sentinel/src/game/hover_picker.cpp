@@ -0,0 +1,162 @@
+/**
+ * Sentinel Gl -- an OpenGL based remake of the Firebird classic the Sentinel.
+ * Copyright (C) May 25th, 2015 Markus-Hermann Koch, mhk@markuskoch.eu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+#include <QMutexLocker>
+#include "hover_picker.h"
+
+namespace game
+{
+//> Hover_target. ----------------------------------------------------
+bool Hover_target::is_up_to_date(float mouse_gl_x, float mouse_gl_y,
+	const QMatrix4x4& camera, uint board_revision) const
+{
+	return valid &&
+		this->mouse_gl_x == mouse_gl_x && this->mouse_gl_y == mouse_gl_y &&
+		this->board_revision == board_revision && this->camera == camera;
+}
+
+Hover_target::Hover_target()
+{
+	this->mouse_gl_x = 0;
+	this->mouse_gl_y = 0;
+	this->camera.setToIdentity();
+	this->board_revision = 0;
+	this->board_pos = QPoint(-1,-1);
+	this->figure = 0;
+	this->action = E_POSSIBLE_PLAYER_ACTION::NO;
+	this->valid = false;
+}
+//< ------------------------------------------------------------------
+
+//> Hover_picker. ----------------------------------------------------
+void Hover_picker::run()
+{
+	while (true)
+	{
+		//> Wait for a request. --------------------------------------
+		float x, y;
+		{
+			QMutexLocker locker(&request_mutex);
+			while (!request_pending && !stop_requested) request_posted.wait(&request_mutex);
+			if (stop_requested) return;
+			x = request_x;
+			y = request_y;
+			request_pending = false;
+		}
+		//< ----------------------------------------------------------
+		//> Pick unless the last pick still holds. -------------------
+		// Not waiting indefinitely: The GUI thread may hold the mutex while
+		// waiting for this thread to stop.
+		if (!game->get_mutex()->tryLock(LOCK_TIMEOUT_MS))
+		{
+			QMutexLocker locker(&request_mutex);
+			if (!request_pending)
+			{
+				request_x = x;
+				request_y = y;
+				request_pending = true;
+			}
+			continue;
+		}
+		QMatrix4x4 camera = game->get_player()->get_viewer_data()->get_camera();
+		uint revision = game->get_board_revision();
+		bool up_to_date;
+		{
+			QMutexLocker locker(&result_mutex);
+			up_to_date = result.is_up_to_date(x, y, camera, revision);
+		}
+		if (!up_to_date)
+		{
+			Hover_target target;
+			target.mouse_gl_x = x;
+			target.mouse_gl_y = y;
+			target.camera = camera;
+			target.board_revision = revision;
+			target.action = game->get_mouse_target(x, y, target.board_pos, target.figure);
+			target.valid = true;
+			QMutexLocker locker(&result_mutex);
+			if (target.board_pos != result.board_pos || target.figure != result.figure)
+				changed.storeRelease(1);
+			result = target;
+		}
+		game->get_mutex()->unlock();
+		//< ----------------------------------------------------------
+	}
+}
+
+void Hover_picker::request(float mouse_gl_x, float mouse_gl_y)
+{
+	QMutexLocker locker(&request_mutex);
+	request_x = mouse_gl_x;
+	request_y = mouse_gl_y;
+	request_pending = true;
+	request_posted.wakeOne();
+}
+
+bool Hover_picker::get_target(float mouse_gl_x, float mouse_gl_y,
+	QPoint& board_pos, Figure*& figure, E_POSSIBLE_PLAYER_ACTION& action)
+{
+	QMatrix4x4 camera = game->get_player()->get_viewer_data()->get_camera();
+	uint revision = game->get_board_revision();
+	QMutexLocker locker(&result_mutex);
+	if (!result.is_up_to_date(mouse_gl_x, mouse_gl_y, camera, revision)) return false;
+	board_pos = result.board_pos;
+	figure = result.figure;
+	action = result.action;
+	return true;
+}
+
+Hover_target Hover_picker::get_latest()
+{
+	QMutexLocker locker(&result_mutex);
+	return result;
+}
+
+bool Hover_picker::has_changed()
+{
+	return changed.fetchAndStoreOrdered(0) != 0;
+}
+
+void Hover_picker::stop()
+{
+	{
+		QMutexLocker locker(&request_mutex);
+		stop_requested = true;
+		request_posted.wakeOne();
+	}
+	wait();
+}
+
+Hover_picker::Hover_picker(Game* game, QObject* parent)
+	: QThread(parent)
+{
+	if (!game) throw "Null pointer encountered.";
+	this->game = game;
+	this->request_x = 0;
+	this->request_y = 0;
+	this->request_pending = false;
+	this->stop_requested = false;
+	this->changed.storeRelease(0);
+}
+
+Hover_picker::~Hover_picker()
+{
+	stop();
+}
+//< ------------------------------------------------------------------
+}
@@ -32,56 +32,56 @@ using std::endl;
 namespace game
 {
 //> Figure. ----------------------------------------------------------
-vector<Attack_duration> Figure::mount_attacks(vector<Antagonist_target>& targets)
+const vector<Attack_duration>& Figure::mount_attacks(const vector<Antagonist_target>& targets)
 {
-	// This function is a bit inefficient. However, as it stands it has
-	// little work to do.
-	vector<Attack_duration> new_attack;
 	// Only stable and disintegrating antagonists fight.
+	static const vector<Attack_duration> no_attacks;
 	if (state != E_MATTER_STATE::STABLE && state != E_MATTER_STATE::DISINTEGRATING)
-		{ return new_attack; }
+		{ return no_attacks; }
+	// attacks is updated in place. Thus it does not allocate once it has
+	// reached its usual size.
 	//> Step 1: Which old Attack_durations are to be kept? -----------
-	for (vector<Attack_duration>::const_iterator CI=attacks.begin();CI!=attacks.end();CI++)
+	uint kept = 0;
+	for (uint j=0;j<attacks.size();j++)
 	{
-		Attack_duration next = *CI;
 		bool found_it = false;
-		for (vector<Antagonist_target>::const_iterator CI2=targets.begin();CI2!=targets.end();CI2++)
+		for (vector<Antagonist_target>::const_iterator CI=targets.begin();CI!=targets.end();CI++)
 		{
-			if (next.board_pos == CI2->board_pos)
+			if (attacks[j].board_pos == CI->board_pos)
 			{
 				found_it = true;
 				break;
 			}
 		}
 		// Preserve old Attack_duration.
-		if (found_it) new_attack.push_back(next);
+		if (found_it) attacks[kept++] = attacks[j];
 	}
+	attacks.erase(attacks.begin()+kept,attacks.end());
 	//< --------------------------------------------------------------
 	//> Step 2: Which new QPoints are to be added? -------------------
 	for (vector<Antagonist_target>::const_iterator CI=targets.begin();CI!=targets.end();CI++)
 	{
-		Antagonist_target next = *CI;
 		bool found_it = false;
-		for (vector<Attack_duration>::const_iterator CI2=attacks.begin();CI2!=attacks.end();CI2++)
+		// Only the kept attacks need to be searched.
+		for (uint j=0;j<kept;j++)
 		{
-			if (next.board_pos == CI2->board_pos)
+			if (attacks[j].board_pos == CI->board_pos)
 			{
 				found_it = true;
 				break;
 			}
 		}
 		// Add new Attack duration.
-		if (!found_it) new_attack.push_back(Attack_duration(0,next.board_pos,next.visibility));
+		if (!found_it) attacks.push_back(Attack_duration(0,CI->board_pos,CI->visibility));
 	}
 	//< --------------------------------------------------------------
 	//> Step 3: Increase all counters by 1. --------------------------
-	for (vector<Attack_duration>::iterator IT=new_attack.begin();IT!=new_attack.end();IT++)
+	for (vector<Attack_duration>::iterator IT=attacks.begin();IT!=attacks.end();IT++)
 	{
 		IT->inc();
 	}
 	//< --------------------------------------------------------------
-	this->attacks = new_attack;
-	return new_attack;
+	return attacks;
 }
 
 void Figure::set_type(E_FIGURE_TYPE new_type, Mesh_Data* new_mesh)
@@ -92,6 +92,9 @@ void Figure::set_type(E_FIGURE_TYPE new_type, Mesh_Data* new_mesh)
 	type = new_type;
 	this->state = E_MATTER_STATE::TRANSMUTING;
 	this->fade = 0;
+	// Whatever the old type saw is of no concern to the new one.
+	this->scan_age = -1;
+	stack->update_cache();
 }
 
 void Figure::set_state(E_MATTER_STATE new_state, bool by_robot)
@@ -109,21 +112,18 @@ void Figure::set_state(E_MATTER_STATE new_state, bool by_robot)
 	}
 }
 
-void Figure::set_figure_above(Figure* fg, int c)
+void Figure::set_figure_above(Figure* fg)
 {
-	if (fg==0)
+	if (fg==0) throw "Null pointer encountered.";
+	if (fg->stack_index != 0) throw "Only base figures may be put upon another figure.";
+	Figure_stack* old_stack = fg->stack;
+	for (int j=0;j<old_stack->size();j++)
 	{
-		figure_above = 0;
-		return;
+		Figure* next = old_stack->at(j);
+		next->stack_index = stack->push(next);
+		next->stack = stack;
 	}
-	if ((c++)>1000) throw "Probably a cyclic stack encounter!";
-	if (figure_above == 0)
-	{
-		figure_above = fg;
-		fg->figure_below = this;
-	} else {
-		figure_above->set_figure_above(fg,c);
-	}	
+	delete old_stack;
 }
 
 float Figure::get_mesh_height(E_FIGURE_TYPE type)
@@ -180,46 +180,6 @@ bool Figure::is_antagonist()
 		(type == E_FIGURE_TYPE::SENTINEL || type == E_FIGURE_TYPE::SENTRY || type == E_FIGURE_TYPE::MEANIE);
 }
 
-bool Figure::progress(float dt, E_ANTAGONIST_ACTION action)
-{
-	if (this->state == E_MATTER_STATE::GONE) return false; // Nothing to do.
-	bool relevant_progress = false;
-	
-	if (!(action==E_ANTAGONIST_ACTION::STILL))
-	{
-		float sign = (action == E_ANTAGONIST_ACTION::MOVING_FORWARD) ? 1. : -1.;
-		float meanie_factor = (type==E_FIGURE_TYPE::MEANIE) ? DEFAULT_MEANIE_SPEED_FACTOR : 1.0;
-		if (spin_period != 0) phi += sign*360. * dt * meanie_factor / spin_period;
-		if (phi >= 360.) phi -= 360.;
-		if (phi < 0.) phi += 360.;
-		relevant_progress = true;
-	}
-	
-	if (state==E_MATTER_STATE::MANIFESTING ||
-		state==E_MATTER_STATE::DISINTEGRATING  || state==E_MATTER_STATE::TRANSMUTING)
-	{
-		float sign = (state==E_MATTER_STATE::MANIFESTING ||
-			state==E_MATTER_STATE::TRANSMUTING) ? +1.0 : -1.0;
-		fade += sign * dt / fading_time;
-		if (fade > 1)
-		{
-			if (state==E_MATTER_STATE::TRANSMUTING)
-			{
-				this->mesh_transmutation_origin = 0;
-			}
-			state = E_MATTER_STATE::STABLE;
-			fade = 1.0;
-		}
-		if (fade <= 0)
-		{
-			state = E_MATTER_STATE::GONE;
-			fade = 0.0;
-		}
-		relevant_progress = true;
-	}
-	return relevant_progress;
-}
-
 QVector3D Figure::get_eye_position_relative_to_figure(E_FIGURE_TYPE type)
 {
 	// These values are determined by looking at the .blend files
@@ -247,56 +207,39 @@ QVector3D Figure::get_eye_position_in_world(QPoint pos, int altitude_base)
 	return eye;
 }
 
-QVector3D Figure::get_direction()
+void Figure::set_phi(float phi)
 {
-	float phi = (this->phi)*PI/180;
-	return QVector3D(cos(phi),sin(phi),0);
+	this->phi = phi;
+	float rad = phi*PI/180;
+	direction = QVector3D(cos(rad),sin(rad),0);
 }
 
-vector<Figure*> Figure::get_above_figure_stack()
+Figure* Figure::get_top_figure()
 {
-	vector<Figure*> stack;
-	Figure* next = this;
-	while (next != 0)
-	{
-		stack.push_back(next);
-		next = next->figure_above;
-		if (stack.size() > 2000) throw "Insanely high stack! This is a bug.";
-	}
-	return stack;
+	Figure* res = stack->get_top();
+	if (res == 0) throw "Top Figure* is 0.";
+	return res;
 }
 
-vector<Figure*> Figure::get_below_figure_stack()
+Figure* Figure::get_above_figure()
 {
-	vector<Figure*> stack;
-	Figure* next = figure_below;
-	while (next != 0)
-	{
-		stack.push_back(next);
-		next = next->figure_below;
-		if (stack.size() > 2000) throw "Insanely high stack! This is a bug.";
-	}
-	return stack;
+	return (stack_index < stack->get_top_index()) ? stack->at(stack_index+1) : 0;
 }
 
-Figure* Figure::get_top_figure()
+Figure* Figure::get_below_figure()
 {
-	vector<Figure*> vec = get_above_figure_stack();
-	vector<Figure*>::const_reverse_iterator CRI = vec.rbegin();
-	Figure* res = *CRI;
-	if (res == 0) throw "Top Figure* is 0.";
-	return res;
+	return (stack_index > 0) ? stack->at(stack_index-1) : 0;
+}
+
+Mesh_bounds Figure::get_world_bounds(QPoint pos, float altitude, float scale)
+{
+	return mesh->bounds.transformed(
+		QVector3D((float)pos.x(),(float)pos.y(),altitude), phi, scale);
 }
 
 int Figure::get_altitude_above_square()
 {
-	int alt = 0;
-	vector<Figure*> stack = get_below_figure_stack();
-	for (vector<Figure*>::const_iterator CI=stack.begin();CI!=stack.end();CI++)
-	{
-		alt += Figure::get_height((*CI)->get_type());
-	}
-	return alt;
+	return stack->get_altitude(stack_index);
 }
 
 int Figure::get_energy_for_robot()
@@ -306,16 +249,12 @@ int Figure::get_energy_for_robot()
 
 int Figure::check_for_and_delete_top_figure(bool only_if_GONE)
 {
-	if (figure_above == 0) return 0; // Nothing to do.
-	vector<Figure*> stack = get_above_figure_stack();
-	vector<Figure*>::reverse_iterator RI = stack.rbegin();
-	Figure* top = *RI;
+	if (stack->get_top_index() <= stack_index) return 0; // Nothing to do.
+	Figure* top = stack->get_top();
 	int res = 0;
 	if (top->is_gone() || (!only_if_GONE))
 	{
-		RI++;
-		Figure* below = *RI;
-		below->figure_above = 0;
+		stack->pop();
 		res = top->get_energy_for_robot();
 		delete top;
 	}
@@ -349,35 +288,186 @@ Figure::Figure(E_FIGURE_TYPE type, E_MATTER_STATE state, Mesh_Data* mesh,
 		(this->state == E_MATTER_STATE::GONE) ? 0.0 : 1.0;
 	this->fading_time = fading_time;
 	this->mesh = mesh;
-	this->phi = phi;
+	set_phi(phi);
 	this->theta = theta;
 	this->spin_period = spin_period;
 	this->fov = fov;
-	this->figure_above = 0;
-	// Leave that as 0! For setting a figure below use the method set_figure_above()
-	// from the intended base-figure!
-	this->figure_below = 0;
 	this->absorption_triggered_by_robot = false;
+	this->scan_age = -1;
+	// Every figure starts out as the base of its own stack. For putting it
+	// upon another figure use the method set_figure_above() from the
+	// intended base-figure!
+	this->stack = new Figure_stack();
+	this->stack_index = stack->push(this);
 }
 
 Figure::Figure(const Figure& orig) :
 	Figure(orig.type, orig.state, orig.mesh, orig.phi, orig.theta, orig.spin_period,
 		orig.fov, orig.fading_time)
 {
-	if (orig.figure_above != 0)
+	for (int j=orig.stack_index+1;j<orig.stack->size();j++)
 	{
-		Figure* above = new Figure(*(orig.figure_above));
-		this->set_figure_above(above);
+		Figure* next = orig.stack->at(j);
+		this->set_figure_above(new Figure(next->type, next->state, next->mesh,
+			next->phi, next->theta, next->spin_period, next->fov, next->fading_time));
 	}
 }
 
 Figure::~Figure()
 {
-	delete this->figure_above;
-	// No! Don't do this! Consider that we already delete this->figure_above.
-	// Then we self-destruct. And the figure_above accesses us trying to set
-	// this->figure_above to 0. Not good!
-	// if (figure_below) figure_below->figure_above = 0;
+	// Figures are popped before being deleted. Hence deleting the figures
+	// above will not see them access this stack anymore.
+	while (stack->get_top_index() > stack_index) delete stack->pop();
+	if (stack_index == 0)
+	{
+		delete stack;
+	} else if (stack->get_top() == this) {
+		stack->pop();
+	}
+}
+//< ------------------------------------------------------------------
+
+//> Figure_stack. ----------------------------------------------------
+Figure* Figure_stack::at(int j)
+{
+	if (j < 0 || j > top_index) throw "Out of range.";
+	return figures[j];
+}
+
+int Figure_stack::get_altitude(int j)
+{
+	if (j < 0 || j > top_index) throw "Out of range.";
+	return altitudes[j];
+}
+
+int Figure_stack::push(Figure* figure)
+{
+	if (figure == 0) throw "Null pointer encountered.";
+	if (is_full()) throw "Insanely high stack! This is a bug.";
+	top_index++;
+	figures[top_index] = figure;
+	altitudes[top_index] = (top_index == 0) ? 0 :
+		altitudes[top_index-1] + Figure::get_height(figures[top_index-1]->get_type());
+	// Extends the column only if all figures beneath are blocks.
+	if (figure->get_type() == E_FIGURE_TYPE::BLOCK && number_of_blocks == top_index)
+		number_of_blocks++;
+	return top_index;
+}
+
+Figure* Figure_stack::pop()
+{
+	if (top_index < 0) throw "Attempting to pop from an empty stack.";
+	Figure* res = figures[top_index];
+	if (top_index < number_of_blocks) number_of_blocks = top_index;
+	figures[top_index] = 0;
+	top_index--;
+	return res;
+}
+
+void Figure_stack::update_cache()
+{
+	number_of_blocks = 0;
+	for (int j=0;j<=top_index;j++)
+	{
+		altitudes[j] = (j == 0) ? 0 : altitudes[j-1] + Figure::get_height(figures[j-1]->get_type());
+		if (figures[j]->get_type() == E_FIGURE_TYPE::BLOCK && number_of_blocks == j)
+			number_of_blocks++;
+	}
+}
+
+Figure_stack::Figure_stack()
+{
+	this->top_index = -1;
+	this->number_of_blocks = 0;
+}
+//< ------------------------------------------------------------------
+
+//> Progress_kernel. -------------------------------------------------
+bool Progress_kernel::add_rotation(Figure* figure, E_ANTAGONIST_ACTION action)
+{
+	if (figure->state == E_MATTER_STATE::GONE) return false; // Nothing to do.
+	if (action == E_ANTAGONIST_ACTION::STILL) return false;
+	float sign = (action == E_ANTAGONIST_ACTION::MOVING_FORWARD) ? 1. : -1.;
+	float meanie_factor = (figure->type==E_FIGURE_TYPE::MEANIE) ? DEFAULT_MEANIE_SPEED_FACTOR : 1.0;
+	float spin_period = figure->spin_period;
+	rotating.push_back(figure);
+	phi.push_back(figure->phi);
+	omega.push_back(spin_period == 0 ? 0. : sign*360. * meanie_factor / spin_period);
+	return true;
+}
+
+void Progress_kernel::progress_rotations(float dt)
+{
+	uint n = rotating.size();
+	direction_x.resize(n);
+	direction_y.resize(n);
+	// Both loops are free of branches and pointers. Keep it that way.
+	for (uint j=0;j<n;j++)
+	{
+		float p = phi[j] + omega[j]*dt;
+		phi[j] = p - 360.f*floorf(p*(1.f/360.f));
+	}
+	const float deg_to_rad = PI/180.;
+	for (uint j=0;j<n;j++)
+	{
+		direction_x[j] = cosf(phi[j]*deg_to_rad);
+		direction_y[j] = sinf(phi[j]*deg_to_rad);
+	}
+	for (uint j=0;j<n;j++)
+	{
+		Figure* figure = rotating[j];
+		figure->phi = phi[j];
+		figure->direction = QVector3D(direction_x[j],direction_y[j],0);
+	}
+	rotating.clear();
+	phi.clear();
+	omega.clear();
+}
+
+bool Progress_kernel::add_fade(Figure* figure)
+{
+	E_MATTER_STATE state = figure->state;
+	if (state != E_MATTER_STATE::MANIFESTING &&
+		state != E_MATTER_STATE::DISINTEGRATING && state != E_MATTER_STATE::TRANSMUTING)
+		return false;
+	float sign = (state==E_MATTER_STATE::MANIFESTING ||
+		state==E_MATTER_STATE::TRANSMUTING) ? +1.0 : -1.0;
+	fading.push_back(figure);
+	fade.push_back(figure->fade);
+	fade_rate.push_back(sign / figure->fading_time);
+	return true;
+}
+
+void Progress_kernel::progress_fades(float dt)
+{
+	uint n = fading.size();
+	for (uint j=0;j<n;j++)
+	{
+		fade[j] += fade_rate[j]*dt;
+	}
+	for (uint j=0;j<n;j++)
+	{
+		Figure* figure = fading[j];
+		float f = fade[j];
+		if (f > 1)
+		{
+			if (figure->state==E_MATTER_STATE::TRANSMUTING)
+			{
+				figure->mesh_transmutation_origin = 0;
+			}
+			figure->state = E_MATTER_STATE::STABLE;
+			f = 1.0;
+		}
+		if (f <= 0)
+		{
+			figure->state = E_MATTER_STATE::GONE;
+			f = 0.0;
+		}
+		figure->fade = f;
+	}
+	fading.clear();
+	fade.clear();
+	fade_rate.clear();
 }
 //< ------------------------------------------------------------------
 
@@ -485,6 +575,7 @@ void Square::set_altitude(int level, int x, int y)
 			QVector4D(1,1,1,1)
 		 ));
 	}
+	update_bounds();
 }
 
 void Square::set_sloped_altitudes(float alt_pp, float alt_mp, float alt_mm, float alt_pm,
@@ -526,6 +617,15 @@ void Square::set_sloped_altitudes(float alt_pp, float alt_mp, float alt_mm, floa
 		 ));
 	}
 	turn_sloped_square_by_90_degrees_if_necessary(this->vertices);
+	update_bounds();
+}
+
+void Square::update_bounds()
+{
+	vector<QVector3D> positions;
+	for (vector<Vertex_Data>::const_iterator CI=vertices.begin();CI!=vertices.end();CI++)
+		positions.push_back(CI->vertex.toVector3D());
+	bounds.compute(positions);
 }
 
 bool Square::transfer_vertices_to_GPU()
@@ -747,6 +847,18 @@ int Landscape::get_altitude(int x, int y)
 	return sq->get_altitude();
 }
 
+int Landscape::get_max_altitude(int x0, int y0, int x1, int y1)
+{
+	// The lowest level on which the rectangle touches at most 2x2 cells.
+	uint k = 0;
+	while ((x1>>k) - (x0>>k) > 1 || (y1>>k) - (y0>>k) > 1) k++;
+	const vector<int>& level = altitude_pyramid[k];
+	int w = pyramid_widths[k];
+	int res = std::max(level[(y0>>k)*w + (x0>>k)], level[(y0>>k)*w + (x1>>k)]);
+	res = std::max(res, level[(y1>>k)*w + (x0>>k)]);
+	return std::max(res, level[(y1>>k)*w + (x1>>k)]);
+}
+
 map<string,Square*> Landscape::get_adjacent_odd_even_squares(QPoint pos)
 {
 	map<string,Square*> res;
@@ -1371,6 +1483,50 @@ void Landscape::send_board_sq_to_GPU()
 	}
 }
 
+void Landscape::build_altitude_pyramid()
+{
+	altitude_pyramid.clear();
+	pyramid_widths.clear();
+	pyramid_heights.clear();
+	vector<int> level(width*height);
+	for (int y=0;y<height;y++)
+	{
+		for (int x=0;x<width;x++)
+		{
+			level[y*width+x] = board_sq.get(x,y)->get_altitude();
+		}
+	}
+	altitude_pyramid.push_back(level);
+	pyramid_widths.push_back(width);
+	pyramid_heights.push_back(height);
+	while (pyramid_widths.back() > 1 || pyramid_heights.back() > 1)
+	{
+		const vector<int>& below = altitude_pyramid.back();
+		int w_below = pyramid_widths.back();
+		int h_below = pyramid_heights.back();
+		int w = (w_below+1)/2;
+		int h = (h_below+1)/2;
+		vector<int> above(w*h);
+		for (int y=0;y<h;y++)
+		{
+			for (int x=0;x<w;x++)
+			{
+				// Odd sizes: The last cell of a row or column has but one child.
+				int x1 = std::min(2*x+1, w_below-1);
+				int y1 = std::min(2*y+1, h_below-1);
+				int m = below[2*y*w_below + 2*x];
+				m = std::max(m, below[2*y*w_below + x1]);
+				m = std::max(m, below[y1*w_below + 2*x]);
+				m = std::max(m, below[y1*w_below + x1]);
+				above[y*w+x] = m;
+			}
+		}
+		altitude_pyramid.push_back(above);
+		pyramid_widths.push_back(w);
+		pyramid_heights.push_back(h);
+	}
+}
+
 void Landscape::generate_landscape()
 {
 	string caller = "Landscape::generate_landscape()";
@@ -1401,6 +1557,10 @@ void Landscape::generate_landscape()
 
 	send_board_sq_to_GPU();
 	oss << "Conveying board data to GPU." << endl;
+
+	build_altitude_pyramid();
+	oss << "Building the max-altitude pyramid with " << altitude_pyramid.size() <<
+		" levels." << endl;
 	
 	if (io) io->println(E_DEBUG_LEVEL::VERBOSE, "generate_landscape()", oss.str());
 }
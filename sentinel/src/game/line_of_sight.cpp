@@ -0,0 +1,374 @@
+/**
+ * Sentinel Gl -- an OpenGL based remake of the Firebird classic the Sentinel.
+ * Copyright (C) May 25th, 2015 Markus-Hermann Koch, mhk@markuskoch.eu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+#include <cmath>
+#include <sstream>
+#include <iomanip>
+#include <QElapsedTimer>
+#include "line_of_sight.h"
+#include "landscape.h"
+
+using std::ostringstream;
+
+// The AVX2 kernel is compiled for its own target and only called on CPUs
+// that have AVX2. The rest of the program does not require it.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MHK_LOS_AVX2
+#include <immintrin.h>
+#endif
+
+namespace game
+{
+int get_line_of_sight_steps(QVector3D eye, QPoint target_sq)
+{
+	// Up to 50 squares 100 steps as ever. Beyond that two steps per square
+	// lest the walk jump over narrow ridges.
+	float dx = fabs(((float)target_sq.x()) - eye.x());
+	float dy = fabs(((float)target_sq.y()) - eye.y());
+	int steps = (int)(2*((dx > dy) ? dx : dy)) + 1;
+	return (steps > MIN_LINE_OF_SIGHT_STEPS) ? steps : MIN_LINE_OF_SIGHT_STEPS;
+}
+
+//> Line_of_sight_batch. ---------------------------------------------
+void Line_of_sight_batch::clear()
+{
+	target_x.clear();
+	target_y.clear();
+	step_x.clear();
+	step_y.clear();
+	step_z.clear();
+	steps.clear();
+	visible.clear();
+}
+
+int Line_of_sight_batch::add(QVector3D eye, QPoint target_sq, float alt_target, int steps)
+{
+	QVector3D target((float)target_sq.x(),(float)target_sq.y(),alt_target);
+	QVector3D step = (target - eye) / (float)steps;
+	target_x.push_back(target_sq.x());
+	target_y.push_back(target_sq.y());
+	step_x.push_back(step.x());
+	step_y.push_back(step.y());
+	step_z.push_back(step.z());
+	this->steps.push_back(steps);
+	visible.push_back(0);
+	return this->steps.size()-1;
+}
+//< ------------------------------------------------------------------
+
+//> Kernels. ---------------------------------------------------------
+namespace
+{
+/** Is the terrain beneath steps j0..j1 of line k lower than all of them?
+ * Rounding is monotonic. Hence all squares visited by these steps are within
+ * the rectangle spanned by the squares of the first and the last step. The
+ * rectangle is bounded by a single Landscape::get_max_altitude(..) lookup.
+ * Rectangles reaching beyond the board are never clear. */
+bool is_block_clear(Landscape* landscape, QVector3D eye,
+	const Line_of_sight_batch& batch, int k, int j0, int j1)
+{
+	float x0 = eye.x() + ((float)j0)*batch.step_x[k];
+	float y0 = eye.y() + ((float)j0)*batch.step_y[k];
+	float z0 = eye.z() + ((float)j0)*batch.step_z[k];
+	float x1 = eye.x() + ((float)j1)*batch.step_x[k];
+	float y1 = eye.y() + ((float)j1)*batch.step_y[k];
+	float z1 = eye.z() + ((float)j1)*batch.step_z[k];
+	int sq_x0 = (int)round(x0);
+	int sq_y0 = (int)round(y0);
+	int sq_x1 = (int)round(x1);
+	int sq_y1 = (int)round(y1);
+	int min_x = std::min(sq_x0,sq_x1);
+	int max_x = std::max(sq_x0,sq_x1);
+	int min_y = std::min(sq_y0,sq_y1);
+	int max_y = std::max(sq_y0,sq_y1);
+	if (min_x < 0 || min_y < 0 ||
+		max_x >= landscape->get_width() || max_y >= landscape->get_height()) return false;
+	return ((float)landscape->get_max_altitude(min_x,min_y,max_x,max_y)) < std::min(z0,z1);
+}
+
+void trace_scalar(QVector3D eye, Landscape* landscape, Line_of_sight_batch& batch)
+{
+	const int* altitudes = landscape->get_altitudes();
+	int width = landscape->get_width();
+	int height = landscape->get_height();
+	int n = batch.size();
+	for (int k=0;k<n;k++)
+	{
+		unsigned char is_free = 1;
+		bool is_done = false;
+		int last = batch.steps[k]-1;
+		for (int j0=1;j0<=last && !is_done;j0+=LINE_OF_SIGHT_BLOCK_STEPS)
+		{
+			int j1 = std::min(j0+LINE_OF_SIGHT_BLOCK_STEPS-1,last);
+			if (is_block_clear(landscape,eye,batch,k,j0,j1)) continue;
+			for (int j=j0;j<=j1;j++)
+			{
+				float x = eye.x() + ((float)j)*batch.step_x[k];
+				float y = eye.y() + ((float)j)*batch.step_y[k];
+				float z = eye.z() + ((float)j)*batch.step_z[k];
+				int sq_x = (int)round(x);
+				int sq_y = (int)round(y);
+				if ((sq_x == batch.target_x[k] && sq_y == batch.target_y[k]) ||
+					sq_x<0 || sq_x>=width || sq_y<0 || sq_y>=height)
+				{
+					is_done = true;
+					break;
+				}
+				if (((float)altitudes[sq_y*width+sq_x]) >= z)
+				{
+					is_free = 0;
+					is_done = true;
+					break;
+				}
+			}
+		}
+		batch.visible[k] = is_free;
+	}
+}
+
+#ifdef MHK_LOS_AVX2
+/** round(..) rounds halfway cases away from zero. _mm256_round_ps does not. */
+__attribute__((target("avx2")))
+inline __m256 round_half_away(__m256 v)
+{
+	__m256 sign = _mm256_set1_ps(-0.f);
+	__m256 a = _mm256_andnot_ps(sign, v);
+	__m256 floor_a = _mm256_floor_ps(a);
+	__m256 up = _mm256_and_ps(
+		_mm256_cmp_ps(_mm256_sub_ps(a, floor_a), _mm256_set1_ps(.5f), _CMP_GE_OQ),
+		_mm256_set1_ps(1.f));
+	return _mm256_or_ps(_mm256_add_ps(floor_a, up), _mm256_and_ps(sign, v));
+}
+
+__attribute__((target("avx2")))
+void trace_avx2(QVector3D eye, Landscape* landscape, Line_of_sight_batch& batch)
+{
+	const int LANES = 8;
+	const int* altitudes = landscape->get_altitudes();
+	int width = landscape->get_width();
+	int height = landscape->get_height();
+	int n = batch.size();
+	__m256 eye_x = _mm256_set1_ps(eye.x());
+	__m256 eye_y = _mm256_set1_ps(eye.y());
+	__m256 eye_z = _mm256_set1_ps(eye.z());
+	__m256i zero = _mm256_setzero_si256();
+	__m256i v_width = _mm256_set1_epi32(width);
+	__m256i v_height = _mm256_set1_epi32(height);
+	for (int k0=0;k0<n;k0+=LANES)
+	{
+		//> Load up to eight lines. Unused lanes stay inactive. --------
+		int lanes = (n-k0 < LANES) ? n-k0 : LANES;
+		float s_x[LANES], s_y[LANES], s_z[LANES];
+		int t_x[LANES], t_y[LANES], last[LANES];
+		int max_last = 0;
+		for (int l=0;l<LANES;l++)
+		{
+			int k = k0 + ((l < lanes) ? l : 0);
+			s_x[l] = batch.step_x[k];
+			s_y[l] = batch.step_y[k];
+			s_z[l] = batch.step_z[k];
+			t_x[l] = batch.target_x[k];
+			t_y[l] = batch.target_y[k];
+			last[l] = (l < lanes) ? batch.steps[k]-1 : 0;
+			if (last[l] > max_last) max_last = last[l];
+		}
+		__m256 step_x = _mm256_loadu_ps(s_x);
+		__m256 step_y = _mm256_loadu_ps(s_y);
+		__m256 step_z = _mm256_loadu_ps(s_z);
+		__m256i target_x = _mm256_loadu_si256((const __m256i*)t_x);
+		__m256i target_y = _mm256_loadu_si256((const __m256i*)t_y);
+		__m256i v_last = _mm256_loadu_si256((const __m256i*)last);
+		// All bits set for lanes still walking.
+		__m256i active = _mm256_cmpgt_epi32(v_last, zero);
+		__m256i blocked = zero;
+		//< ----------------------------------------------------------
+		for (int j0=1;j0<=max_last;j0+=LINE_OF_SIGHT_BLOCK_STEPS)
+		{
+			//> Lanes clear of the terrain rest during this block. -----
+			int active_bits = _mm256_movemask_ps(_mm256_castsi256_ps(active));
+			if (active_bits == 0) break;
+			int walk[LANES];
+			for (int l=0;l<LANES;l++)
+			{
+				walk[l] = 0;
+				if (!(active_bits & (1<<l))) continue;
+				int j1 = std::min(j0+LINE_OF_SIGHT_BLOCK_STEPS-1,last[l]);
+				if (!is_block_clear(landscape,eye,batch,k0+l,j0,j1)) walk[l] = -1;
+			}
+			__m256i walking = _mm256_and_si256(active,
+				_mm256_loadu_si256((const __m256i*)walk));
+			__m256i resting = _mm256_andnot_si256(walking, active);
+			//< ------------------------------------------------------
+			int j1 = std::min(j0+LINE_OF_SIGHT_BLOCK_STEPS-1,max_last);
+			for (int j=j0;j<=j1;j++)
+			{
+				__m256i v_j = _mm256_set1_epi32(j);
+				walking = _mm256_andnot_si256(_mm256_cmpgt_epi32(v_j, v_last), walking);
+				if (_mm256_testz_si256(walking, walking)) break;
+				__m256 f_j = _mm256_set1_ps((float)j);
+				__m256 x = _mm256_add_ps(eye_x, _mm256_mul_ps(f_j, step_x));
+				__m256 y = _mm256_add_ps(eye_y, _mm256_mul_ps(f_j, step_y));
+				__m256 z = _mm256_add_ps(eye_z, _mm256_mul_ps(f_j, step_z));
+				__m256i sq_x = _mm256_cvttps_epi32(round_half_away(x));
+				__m256i sq_y = _mm256_cvttps_epi32(round_half_away(y));
+				//> Lines that reached their target or left the board are free.
+				__m256i on_target = _mm256_and_si256(
+					_mm256_cmpeq_epi32(sq_x, target_x), _mm256_cmpeq_epi32(sq_y, target_y));
+				__m256i off_board = _mm256_or_si256(
+					_mm256_cmpgt_epi32(zero, sq_x), _mm256_cmpgt_epi32(zero, sq_y));
+				__m256i on_board = _mm256_and_si256(
+					_mm256_cmpgt_epi32(v_width, sq_x), _mm256_cmpgt_epi32(v_height, sq_y));
+				walking = _mm256_and_si256(_mm256_andnot_si256(
+					_mm256_or_si256(on_target, off_board), walking), on_board);
+				//< --------------------------------------------------
+				// Lanes not walking gather nothing.
+				__m256i index = _mm256_add_epi32(_mm256_mullo_epi32(sq_y, v_width), sq_x);
+				index = _mm256_and_si256(index, walking);
+				__m256i alt = _mm256_mask_i32gather_epi32(zero, altitudes, index, walking, 4);
+				__m256i hit = _mm256_and_si256(walking, _mm256_castps_si256(
+					_mm256_cmp_ps(_mm256_cvtepi32_ps(alt), z, _CMP_GE_OQ)));
+				blocked = _mm256_or_si256(blocked, hit);
+				walking = _mm256_andnot_si256(hit, walking);
+			}
+			// Lanes that stopped walking drop out. So do resting lanes
+			// whose last step was within this block.
+			active = _mm256_or_si256(resting, walking);
+			for (int l=0;l<LANES;l++)
+			{
+				if (j1 >= last[l]) walk[l] = 0; else walk[l] = -1;
+			}
+			active = _mm256_and_si256(active, _mm256_loadu_si256((const __m256i*)walk));
+		}
+		int blocked_bits = _mm256_movemask_ps(_mm256_castsi256_ps(blocked));
+		for (int l=0;l<lanes;l++)
+		{
+			batch.visible[k0+l] = (blocked_bits & (1<<l)) ? 0 : 1;
+		}
+	}
+}
+#endif
+
+bool cpu_has_avx2()
+{
+#ifdef MHK_LOS_AVX2
+	// May run before the static constructors of libgcc.
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
+
+const E_LOS_KERNEL fastest_kernel = cpu_has_avx2() ? E_LOS_KERNEL::AVX2 : E_LOS_KERNEL::SCALAR;
+}
+
+void trace_lines_of_sight(QVector3D eye, Landscape* landscape,
+	Line_of_sight_batch& batch, E_LOS_KERNEL kernel)
+{
+#ifdef MHK_LOS_AVX2
+	if (kernel == E_LOS_KERNEL::AVX2)
+	{
+		trace_avx2(eye, landscape, batch);
+		return;
+	}
+#endif
+	trace_scalar(eye, landscape, batch);
+}
+
+E_LOS_KERNEL get_line_of_sight_kernel()
+{
+	return fastest_kernel;
+}
+
+bool is_line_of_sight_kernel_supported(E_LOS_KERNEL kernel)
+{
+	switch (kernel)
+	{
+		case E_LOS_KERNEL::SCALAR: return true;
+		case E_LOS_KERNEL::AVX2: return cpu_has_avx2();
+		default: return false;
+	}
+}
+
+const char* get_line_of_sight_kernel_name(E_LOS_KERNEL kernel)
+{
+	const char* res;
+	switch (kernel)
+	{
+		case E_LOS_KERNEL::SCALAR: res = "scalar"; break;
+		case E_LOS_KERNEL::AVX2: res = "AVX2"; break;
+		default: throw "Unknown line of sight kernel.";
+	}
+	return res;
+}
+//< ------------------------------------------------------------------
+
+string benchmark_lines_of_sight(Landscape* landscape, int lines)
+{
+	const int* altitudes = landscape->get_altitudes();
+	int width = landscape->get_width();
+	int height = landscape->get_height();
+	const int BATCH_SIZE = 64;
+	E_LOS_KERNEL kernels[] = { E_LOS_KERNEL::SCALAR, E_LOS_KERNEL::AVX2 };
+	ostringstream oss;
+	oss << std::fixed << std::setprecision(2);
+	Line_of_sight_batch batch;
+	for (int k=0;k<2;k++)
+	{
+		if (!is_line_of_sight_kernel_supported(kernels[k])) continue;
+		// Same lines for each kernel.
+		unsigned int random = 12345;
+		int visible = 0;
+		qint64 ns = 0;
+		for (int traced=0;traced<lines;traced+=BATCH_SIZE)
+		{
+			//> Random eye up to four above a random square. -----------
+			random = random*1103515245 + 12345;
+			int eye_x = (random>>8) % width;
+			random = random*1103515245 + 12345;
+			int eye_y = (random>>8) % height;
+			random = random*1103515245 + 12345;
+			QVector3D eye((float)eye_x, (float)eye_y,
+				altitudes[eye_y*width+eye_x] + .5f + (float)((random>>8) % 350)/100.f);
+			//< ------------------------------------------------------
+			batch.clear();
+			for (int j=0;j<BATCH_SIZE;j++)
+			{
+				random = random*1103515245 + 12345;
+				int x = (random>>8) % width;
+				random = random*1103515245 + 12345;
+				int y = (random>>8) % height;
+				QPoint target(x,y);
+				batch.add(eye, target, (float)altitudes[y*width+x],
+					get_line_of_sight_steps(eye, target));
+			}
+			QElapsedTimer clock;
+			clock.start();
+			trace_lines_of_sight(eye, landscape, batch, kernels[k]);
+			ns += clock.nsecsElapsed();
+			for (int j=0;j<BATCH_SIZE;j++) visible += batch.visible[j];
+		}
+		if (oss.tellp() > 0) oss << ", ";
+		oss << get_line_of_sight_kernel_name(kernels[k]) << ": " <<
+			(ns > 0 ? ((double)lines)/((double)ns)*1.e3 : 0.) << " Mrays/s (" <<
+			visible << " visible)";
+	}
+	return oss.str();
+}
+//< ------------------------------------------------------------------
+}
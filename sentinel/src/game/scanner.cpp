@@ -17,7 +17,10 @@
  * */
 
 #include <cmath>
+#include <cfloat>
+#include <algorithm>
 #include "scanner.h"
+#include "profiler.h"
 
 using std::pair;
 
@@ -60,16 +63,6 @@ bool Scanner::inv_2x2(float in11, float in12, float in21, float in22,
 	return true;
 }
 
-QMatrix4x4 Scanner::get_complete_transformation_for_figure(
-	Figure* figure, QPoint board_pos, int altitude_square, const QMatrix4x4& camera)
-{
-	float phi = figure->get_phi();
-	QMatrix4x4 A; A = camera;
-	A.translate((float)board_pos.x(),(float)board_pos.y(),(float)altitude_square);
-	A.rotate(phi,QVector3D(0,0,1));
-	return A;
-}
-
 QPoint Scanner::get_board_pos_from_QVector3D(QVector3D& vec)
 {
 	return QPoint((int)round(vec.x()),(int)round(vec.y()));
@@ -101,50 +94,42 @@ bool Scanner::is_in_triangle(float mouse_gl_x, float mouse_gl_y,
 	return (lambda0 >= 0 && lambda1 >= 0 && lambda0 + lambda1 <= 1);
 }
 
-bool Scanner::is_figure_under_xray_mouse(float mouse_gl_x, float mouse_gl_y,
-	Figure* figure, const QMatrix4x4& A)
+void Scanner::get_mouse_ray(float mouse_gl_x, float mouse_gl_y,
+	const QMatrix4x4& camera_inverse, QVector3D& origin, QVector3D& direction)
 {
-	// Copy the prototype meshes from the figure. Never modify the latter!
-	vector<Vertex_Data> vertex_data(figure->get_mesh_prototype()->vertices);
-	vector<GLushort> elements(figure->get_mesh_prototype()->elements);
-	
-	// Remember: Each triplet of elements makes up a triangle!
-	if (elements.size()%3!=0) throw "Apparently I made a wrong assumption here...";
-	
-	vector<QVector4D> vertices;
-	for (uint j=0;j<vertex_data.size();j++)
-	{
-		QVector4D vec = A*(vertex_data[j].vertex);
-		// http://stackoverflow.com/questions/30320144/perspectivelookat-transformation-in-qt-opengl-behaving-unexpectedly-not-even-ke/30320197#30320197
-		vec /= vec.w();
-		vertices.push_back(vec);
-	}
-	
-	// n is the number of triangles. See: http://en.wikibooks.org/wiki/OpenGL_Programming/Modern_OpenGL_Tutorial_05#Elements_-_Index_Buffer_Objects_.28IBO.29
-	uint n = elements.size() / 3;
-	// Check each triangle whether or not it is under the mouse.
-	for (uint j=0;j<n;j++)
-	{
-		QVector4D a = vertices[elements[3*j]];
-		QVector4D b = vertices[elements[3*j+1]];
-		QVector4D c = vertices[elements[3*j+2]];
-	if (a.z()<-1. || a.z()>1. || b.z()<-1. || b.z()>1. ||
-		c.z()<-1. || c.z()>1.) return false;
-		if (is_in_triangle(mouse_gl_x,mouse_gl_y,a,b,c)) return true;
-	}
-	return false;
+	QVector4D near = camera_inverse * QVector4D(mouse_gl_x, mouse_gl_y, -1, 1);
+	QVector4D far = camera_inverse * QVector4D(mouse_gl_x, mouse_gl_y, 1, 1);
+	origin = near.toVector3DAffine();
+	direction = far.toVector3DAffine() - origin;
+}
+
+bool Scanner::is_figure_hit_by_ray(Figure* figure, QPoint board_pos, float altitude,
+	QVector3D origin, QVector3D direction)
+{
+	if (!figure->get_world_bounds(board_pos, altitude).may_be_hit_by(origin, direction))
+		return false;
+	const Mesh_bvh& bvh = figure->get_mesh_prototype()->bvh;
+	// The figure is drawn translated to its square and rotated by phi around
+	// the z axis. Undo both on the ray instead of doing both on the mesh.
+	float phi = figure->get_phi()*PI/180.;
+	float c = cos(phi);
+	float s = sin(phi);
+	QVector3D o = origin - QVector3D((float)board_pos.x(),(float)board_pos.y(),altitude);
+	QVector3D local_origin(c*o.x() + s*o.y(), -s*o.x() + c*o.y(), o.z());
+	QVector3D local_direction(c*direction.x() + s*direction.y(),
+		-s*direction.x() + c*direction.y(), direction.z());
+	return bvh.intersects(local_origin, local_direction, 1);
 }
 
 bool Scanner::is_square_under_xray_mouse(float mouse_gl_x, float mouse_gl_y,
-	Square* square, const QMatrix4x4& camera)
+	Square* square, const Mat4& camera)
 {
-	vector<Vertex_Data> vertex_data(square->vertices);
 	// Note that these vertices are already in world coordinates.
 	// Note that this shape is _not_ a kite due to the perspectivial distortion.
-	QVector4D a = camera * square->vertices[0].vertex;
-	QVector4D b = camera * square->vertices[1].vertex;
-	QVector4D c = camera * square->vertices[2].vertex;
-	QVector4D d = camera * square->vertices[3].vertex;
+	QVector4D a = (camera * Vec4(square->vertices[0].vertex)).to_QVector4D();
+	QVector4D b = (camera * Vec4(square->vertices[1].vertex)).to_QVector4D();
+	QVector4D c = (camera * Vec4(square->vertices[2].vertex)).to_QVector4D();
+	QVector4D d = (camera * Vec4(square->vertices[3].vertex)).to_QVector4D();
 	// http://stackoverflow.com/questions/30320144/perspectivelookat-transformation-in-qt-opengl-behaving-unexpectedly-not-even-ke/30320197#30320197
 	a /= a.w();
 	b /= b.w();
@@ -166,9 +151,7 @@ QVector3D Scanner::get_mouse_direction(float mouse_gl_x, float mouse_gl_y,
 	{
 		float h_fov = vd->get_fov_h();
 		float alpha = -mouse_gl_x * h_fov / 2.;
-		QMatrix4x4 rot; rot.setToIdentity();
-		rot.rotate(alpha,QVector3D(0,0,1));
-		dir = rot*dir;
+		dir = Rotation_2d(alpha).apply_z(dir);
 	}
 	//< --------------------------------------------------------------
 	//> Rotation with respect to theta. ------------------------------
@@ -181,10 +164,14 @@ QVector3D Scanner::get_mouse_direction(float mouse_gl_x, float mouse_gl_y,
 				QVector3D(sin(dtheta),0,cos(dtheta)) :
 				QVector3D(-sin(dtheta),0,cos(dtheta));
 		} else {
-			QVector3D axis(-dir.y(),dir.x(),0);
-			QMatrix4x4 rot; rot.setToIdentity();
-			rot.rotate(dtheta,axis);
-			dir = rot*dir;
+			// Turning by dtheta around the horizontal axis (-y,x,0) keeps
+			// dir in its vertical plane. Within that plane the horizontal
+			// length h and z are turned by -dtheta.
+			float h = sqrt(dir.x()*dir.x()+dir.y()*dir.y());
+			float z = dir.z();
+			float h_new = h;
+			Rotation_2d(-dtheta).apply(h_new, z);
+			dir = QVector3D(dir.x()*h_new/h, dir.y()*h_new/h, z);
 //cout << "nachher: " << dir.x() << ", " << dir.y() << ", " << dir.z()  << endl; 
 			//QVector3D d2 = dir;
 			//float theta = acos(d2.z());
@@ -203,16 +190,16 @@ QVector3D Scanner::get_mouse_direction(float mouse_gl_x, float mouse_gl_y,
 	return dir;
 }
 
-multimap<float, QPoint> Scanner::get_all_board_positions_in_h_fov(
-	QVector3D eye, QVector3D dir, float h_fov, int width, int height)
+void Scanner::get_all_board_positions_in_h_fov(QVector3D eye, QVector3D dir,
+	float h_fov, int width, int height, vector<QPoint>& res)
 {
-	multimap<float, QPoint> res;
+	res.clear();
 	if (h_fov < 0) throw "Negative field of view was given.";
 	//> Getting left and right view directions. ----------------------
 	// Normalize dir such that |(x,y)|==1.0.
 	{
 		float h = sqrt(dir.x()*dir.x()+dir.y()*dir.y());
-		if (h==0) return res;
+		if (h==0) return;
 		dir.setX(dir.x()/h);
 		dir.setY(dir.y()/h);
 		dir.setZ(dir.z()/h);
@@ -220,15 +207,21 @@ multimap<float, QPoint> Scanner::get_all_board_positions_in_h_fov(
 	float alpha = h_fov / 2.;
 	float sa = sin(alpha*PI/180.);
 	if (sa < 0) sa = -sa;
-	QMatrix4x4 A; A.setToIdentity();
-	A.rotate(-alpha, QVector3D(0,0,1));
-	QVector3D dir_left = A*dir;
-	A.rotate(h_fov, QVector3D(0,0,1)); // Inverts previous A _and_ turns on to +alpha! :-)
-	QVector3D dir_right = A*dir;
+	QVector3D dir_left = Rotation_2d(-alpha).apply_z(dir);
+	QVector3D dir_right = Rotation_2d(alpha).apply_z(dir);
 	// Note that dir_1.z() == 0.
 	QVector3D dir_1 = dir_right-dir_left;
 	dir_1.normalize();
 	//< --------------------------------------------------------------
+	//> Preparing the scratch buffers. -------------------------------
+	scan_entries.clear();
+	if ((int)scan_stamps.size() != width*height)
+	{
+		scan_stamps.assign(width*height,0);
+		scan_generation = 0;
+	}
+	scan_generation++;
+	//< --------------------------------------------------------------
 	//> Building the field. ------------------------------------------
 	float step = 1./sqrt(2.);
 	int c_lambda0 = 0;
@@ -257,21 +250,16 @@ multimap<float, QPoint> Scanner::get_all_board_positions_in_h_fov(
 			found_any_valid = true;
 			float dx = ((float)(next.x()))-eye.x();
 			float dy = ((float)(next.y()))-eye.y();
-			float dist = dx*dx+dy*dy;
-			bool is_new = true;
-			{
-				// Check whether the new value is really new. If not so ignore it.
-				pair<multimap<float,QPoint>::const_iterator,
-					multimap<float,QPoint>::const_iterator> range = res.equal_range(dist);
-				for (multimap<float,QPoint>::const_iterator CI=range.first;
-					CI!=range.second; ++CI)
-				{
-					if (CI->second == next) { is_new = false; break; }
-				}
-			}
-			if (is_new)
+			// Check whether the new value is really new. If not so ignore it.
+			int& stamp = scan_stamps[next.y()*width + next.x()];
+			if (stamp != scan_generation)
 			{
-				res.insert(pair<float,QPoint>(dist,next));
+				stamp = scan_generation;
+				Scan_entry entry;
+				entry.dist = dx*dx+dy*dy;
+				entry.order = scan_entries.size();
+				entry.pos = next;
+				scan_entries.push_back(entry);
 			}
 			c_lambda1++;
 		}
@@ -280,39 +268,40 @@ multimap<float, QPoint> Scanner::get_all_board_positions_in_h_fov(
 		c_lambda0++;
 	}
 	//< --------------------------------------------------------------
-	return res;
+	//> Ordering by distance. ----------------------------------------
+	// The order of discovery breaks ties. Hence std::sort suffices and
+	// there is no need for the temporary buffer of std::stable_sort.
+	std::sort(scan_entries.begin(),scan_entries.end());
+	for (vector<Scan_entry>::const_iterator CI=scan_entries.begin();
+		CI!=scan_entries.end();CI++)
+	{
+		res.push_back(CI->pos);
+	}
+	//< --------------------------------------------------------------
 }
 
-multimap<float,QPoint> Scanner::get_all_board_positions_in_h_fov(
+void Scanner::get_all_board_positions_in_h_fov(
 	float mouse_gl_x, float mouse_gl_y, Viewer_Data* viewer_data,
-	float h_fov, int width, int height)
+	float h_fov, int width, int height, vector<QPoint>& res)
 {
 	QVector3D dir = get_mouse_direction(mouse_gl_x, mouse_gl_y, viewer_data);
 	QVector3D eye = viewer_data->get_site();
-	return get_all_board_positions_in_h_fov(eye,dir,h_fov, width, height);
-}
-
-vector<QPoint> Scanner::convert_ordered_multimap_to_vector(multimap<float,QPoint>& mm)
-{
-	vector<QPoint> res;
-	for (multimap<float,QPoint>::const_iterator CI=mm.begin();CI!=mm.end();CI++)
-	{
-		res.push_back(CI->second);
-	}
-	return res;
+	get_all_board_positions_in_h_fov(eye,dir,h_fov, width, height, res);
 }
 
-vector<QPoint> Scanner::restrict_to_squares_under_xray_mouse(float mouse_gl_x,
-		float mouse_gl_y, vector<QPoint> candidates, Landscape* landscape,
+Scanner::Arena_points Scanner::restrict_to_squares_under_xray_mouse(float mouse_gl_x,
+		float mouse_gl_y, const vector<QPoint>& candidates, Landscape* landscape,
 		const QMatrix4x4& camera, bool stop_after_first)
 {
-	vector<QPoint> res;
+	Arena_points res((Arena_allocator<QPoint>(&arena)));
+	res.reserve(stop_after_first ? 1 : candidates.size());
+	Mat4 A(camera);
 	for (vector<QPoint>::const_iterator CI=candidates.begin();CI!=candidates.end();CI++)
 	{
 		QPoint current = *CI;
 		Square* sq = landscape->get_board_sq()->get(current);
 		if (sq==0) throw "0 pointer encountered.";
-		if (is_square_under_xray_mouse(mouse_gl_x,mouse_gl_y,sq,camera))
+		if (is_square_under_xray_mouse(mouse_gl_x,mouse_gl_y,sq,A))
 		{
 			res.push_back(current);
 			if (stop_after_first) break;
@@ -324,7 +313,7 @@ vector<QPoint> Scanner::restrict_to_squares_under_xray_mouse(float mouse_gl_x,
 QPoint Scanner::get_square_under_mouse(float mouse_gl_x, float mouse_gl_y,
 	vector<QPoint>& candidates, Landscape* landscape, Viewer_Data* viewer_data)
 {
-	vector<QPoint> restricted = restrict_to_squares_under_xray_mouse(
+	Arena_points restricted = restrict_to_squares_under_xray_mouse(
 		mouse_gl_x,
 		mouse_gl_y,
 		candidates,
@@ -335,12 +324,12 @@ QPoint Scanner::get_square_under_mouse(float mouse_gl_x, float mouse_gl_y,
 	return (restricted.size() == 0) ? QPoint(-1,-1) : restricted[0];
 }
 
-vector<QPoint_Figure> Scanner::get_all_stable_figures_in_line(
+Scanner::Arena_figures Scanner::get_all_stable_figures_in_line(
 	QPoint board_pos_under_mouse,
 	vector<QPoint>& board_positions_in_line,
 	Board<Figure>* board_fg)
 {
-	vector<QPoint_Figure> res;
+	Arena_figures res((Arena_allocator<QPoint_Figure>(&arena)));
 	for (vector<QPoint>::const_iterator CI=board_positions_in_line.begin();
 		CI!=board_positions_in_line.end();CI++)
 	{
@@ -349,38 +338,32 @@ vector<QPoint_Figure> Scanner::get_all_stable_figures_in_line(
 		if (pos == board_pos_under_mouse) break;
 		Figure* figure = board_fg->get(pos);
 		if (!figure) continue;
-		vector<Figure*> stack = figure->get_above_figure_stack();
-		for (vector<Figure*>::const_iterator CI2=stack.begin();CI2!=stack.end();CI2++)
+		Figure_stack* stack = figure->get_stack();
+		for (int j=0;j<stack->size();j++)
 		{
-			if ((*CI2)->get_state() == E_MATTER_STATE::STABLE)
+			if (stack->at(j)->get_state() == E_MATTER_STATE::STABLE)
 			{
-				res.push_back(QPoint_Figure(pos,*CI2));
+				res.push_back(QPoint_Figure(pos,stack->at(j)));
 			}
 		}
 	}
 	return res;
 }
 
-QPoint_Figure Scanner::get_figure_under_mouse(float mouse_gl_x, float mouse_gl_y,
-		Landscape* landscape, vector<QPoint_Figure>& candidates,
-		QMatrix4x4& camera)
+QPoint_Figure Scanner::get_figure_under_mouse(Landscape* landscape,
+	Arena_figures& candidates, QVector3D origin, QVector3D direction)
 {
-	for (vector<QPoint_Figure>::const_iterator CI=candidates.begin();
+	for (Arena_figures::const_iterator CI=candidates.begin();
 			CI!=candidates.end();CI++)
 	{
 		QPoint pos = CI->pos;
 		Figure* figure = CI->fig;
-		QMatrix4x4 complete_transformation;
 		float altitude = ((float)landscape->get_altitude(pos.x(),pos.y())) +
 			((float)figure->get_altitude_above_square());
-		float phi = figure->get_phi();
-		complete_transformation = camera;
-		complete_transformation.translate((float)pos.x(),(float)pos.y(),altitude);
-		complete_transformation.rotate(phi,QVector3D(0,0,1));
 		// Note: At this moment in time no xray is necessary since
 		// all figures are _befor_ the board_pos_under_mouse used during
 		// get_all_stable_figures_in_line(..).
-		if (is_figure_under_xray_mouse(mouse_gl_x, mouse_gl_y, figure, complete_transformation))
+		if (is_figure_hit_by_ray(figure, pos, altitude, origin, direction))
 		{
 			return QPoint_Figure(pos,figure);
 		}
@@ -389,30 +372,13 @@ QPoint_Figure Scanner::get_figure_under_mouse(float mouse_gl_x, float mouse_gl_y
 }
 
 
-// DEBUGGING CODE. REMOVE LATER ON. ---
-/*
-namespace
-{
-void print_mm(multimap<float,QPoint> mm)
-{
-cout << "Got the following field of view: " << endl;
-for (multimap<float,QPoint>::const_iterator CI=mm.begin(); CI!=mm.end();CI++)
-{
-	float dist = CI->first;
-	QPoint pos=CI->second;
-	cout << "[d=" << dist << "; (" << pos.x() << ", " << pos.y() << "); ";
-}
-cout << endl;
-}
-}
-*/
-// ------------------------------------
-
 void Scanner::get_mouse_target(float mouse_gl_x, float mouse_gl_y,
 		Viewer_Data* viewer_data, Landscape* landscape,
 		Board<Figure>* board_fg, QPoint player_board_pos,
 		QPoint& board_pos, Figure*& figure)
 {
+	Timing_zone timing(E_TIMING_ZONE::MOUSE_TARGET);
+	reset_arena();
 	//> First get all squares' board coords within line of sight. ----
 //	vector<QPoint> candidates = get_all_board_positions_in_line(
 //		mouse_gl_x, mouse_gl_y,
@@ -420,17 +386,17 @@ void Scanner::get_mouse_target(float mouse_gl_x, float mouse_gl_y,
 //		landscape->get_width(),
 //		landscape->get_height()
 //	);
-	multimap<float,QPoint> mm = get_all_board_positions_in_h_fov(
+	vector<QPoint>& candidates = view;
+	get_all_board_positions_in_h_fov(
 			mouse_gl_x, mouse_gl_y,
 			viewer_data,
 			viewer_data->get_fov_h(),
 			landscape->get_width(),
-			landscape->get_height()
+			landscape->get_height(),
+			candidates
 	);
 //cout << "FOV: " << viewer_data->get_fov_h() << endl;
-	vector<QPoint> candidates = convert_ordered_multimap_to_vector(mm);
 	
-//print_mm(mm);
 //cout << "Using the following points: "<< endl;
 //for (uint j=0;j<candidates.size();j++)
 //	cout << "(" << candidates[j].x() << "," << candidates[j].y() << "), ";
@@ -443,17 +409,18 @@ void Scanner::get_mouse_target(float mouse_gl_x, float mouse_gl_y,
 		viewer_data);
 	//< --------------------------------------------------------------
 	//> Get the closest figure if any. -------------------------------
-	vector<QPoint_Figure> fig_line = get_all_stable_figures_in_line(
+	Arena_figures fig_line = get_all_stable_figures_in_line(
 		board_pos,
 		candidates,
 		board_fg
 	);
-	QMatrix4x4 camera = viewer_data->get_camera();
+	QVector3D origin, direction;
+	get_mouse_ray(mouse_gl_x, mouse_gl_y, viewer_data->get_camera_inverse(), origin, direction);
 	QPoint_Figure qpf = get_figure_under_mouse(
-		mouse_gl_x, mouse_gl_y,
 		landscape,
 		fig_line,
-		camera
+		origin,
+		direction
 	);
 	if (qpf.fig != 0)
 	{
@@ -464,125 +431,188 @@ void Scanner::get_mouse_target(float mouse_gl_x, float mouse_gl_y,
 	//< --------------------------------------------------------------
 }
 
-int Scanner::get_block_stack_height(Figure* figure)
-{
-	int c=0;
-	while (figure && figure->get_type()==E_FIGURE_TYPE::BLOCK)
-	{
-		c++;
-		figure = figure->get_above_figure();
-		if (c>1000) throw "Circular stack detected?";
-	}
-	return c;
-}
-
-bool Scanner::can_see_square(Landscape* landscape,
-	QVector3D eye, QPoint target_sq, float alt_target_sq, bool can_see_from_below)
-{
-//cout << "alt_target: " << alt_target_sq << ", alt_self: " << eye.z() << endl;
-	if ((!can_see_from_below) && alt_target_sq >= eye.z()) return false;
-	int width = landscape->get_width();
-	int height = landscape->get_height();
-	QVector3D target((float)target_sq.x(),(float)target_sq.y(),alt_target_sq);
-	QVector3D dir = target - eye;
-	int steps = 100;
-	dir.setX(dir.x()/(float)steps);
-	dir.setY(dir.y()/(float)steps);
-	dir.setZ(dir.z()/(float)steps);
-	QVector3D current = eye;
-	for (int j=1;j<steps;j++)
-	{
-		current += dir;
-		QPoint pos = get_board_pos_from_QVector3D(current);
-		if (pos == target_sq ||
-			pos.x()<0 || pos.x()>=width || pos.y()<0 || pos.y()>=height) return true;
-		Square* sq = landscape->get_board_sq()->get(pos);
-		if (sq->get_altitude() >= current.z()) return false;
-	}
-	return true;
-}
-
-vector<Antagonist_target> Scanner::get_antagonist_targets(QVector3D eye,
+void Scanner::get_antagonist_targets(QVector3D eye,
 		QVector2D direction_2D, float fov_horizontal, Landscape* landscape,
-		Board<Figure>* board_fg, bool seek_trees)
+		const Square_summary* summaries, Antagonist_sight& res)
 {
+	res.clear();
+	int width = landscape->get_width();
 	QVector3D direction(direction_2D.x(),direction_2D.y(),0);
-	multimap<float,QPoint> mm = get_all_board_positions_in_h_fov(
+	get_all_board_positions_in_h_fov(
 		eye,
 		direction,
 		fov_horizontal,
 		landscape->get_width(),
-		landscape->get_height()
+		landscape->get_height(),
+		view
 	);
-	vector<QPoint> view = convert_ordered_multimap_to_vector(mm);
-	vector<Antagonist_target> res;
+	//> Collect the squares holding something that might be seen. ----
+	sight_candidates.clear();
 	for (vector<QPoint>::const_iterator CI=view.begin();CI!=view.end();CI++)
 	{
 		QPoint site = *CI;
-		Figure* base = board_fg->get(site);
-		if (!base) continue;
-		E_FIGURE_TYPE base_type = base->get_type();
-		bool tree_on_top = base->get_top_figure()->get_type() == E_FIGURE_TYPE::TREE;
-		if (
-			(seek_trees && !tree_on_top) ||
-			( (!seek_trees) && base_type != E_FIGURE_TYPE::BLOCK &&
-				base_type != E_FIGURE_TYPE::ROBOT )
-		) continue;
-		// If the atagonist can see alt_square and is above it visibility is FULL.
-		// If he is below it visibility is PARTIAL at best unless number_of_blocks > 0.
-		int number_of_blocks = get_block_stack_height(base);
-		Figure* figure = base->get_top_figure();
-		if ((!figure->is_stable()) && figure->get_state()!=E_MATTER_STATE::DISINTEGRATING)
+		const Square_summary& summary = summaries[site.y()*width + site.x()];
+		if (summary.stack_height == 0)
+		{
+			if (landscape->get_board_sq()->get(site)->get_type() != E_SQUARE_TYPE::CONNECTION)
+				res.free_squares.push_back(site);
+			continue;
+		}
+		E_FIGURE_TYPE type = (E_FIGURE_TYPE)summary.top_type;
+		E_MATTER_STATE state = (E_MATTER_STATE)summary.top_state;
+		Sight_candidate candidate;
+		candidate.site = site;
+		candidate.tree_on_top = type == E_FIGURE_TYPE::TREE;
+		candidate.is_target = summary.base_type == E_FIGURE_TYPE::BLOCK ||
+			summary.base_type == E_FIGURE_TYPE::ROBOT;
+		if (!candidate.tree_on_top && !candidate.is_target) continue;
+		if (state != E_MATTER_STATE::STABLE && state != E_MATTER_STATE::DISINTEGRATING)
 			continue; // Attack stable and disintegrating objects only.
-		E_FIGURE_TYPE type = figure->get_type();
+		int number_of_blocks = summary.number_of_blocks;
 		if (type == E_FIGURE_TYPE::BLOCK) number_of_blocks--; // Don't count the target itself.
-		float alt_target_feet = (float)(landscape->get_altitude(site.x(),site.y()) +
-			number_of_blocks);
-		bool can_see_sq = can_see_square(
-			landscape,
-			eye,
-			site,
-			(float)(landscape->get_altitude(site.x(),site.y())),
-			false
-		);
-		E_VISIBILITY vis = E_VISIBILITY::HIDDEN;
-		if (can_see_sq) // Anything goes if the square itself is visible!
+		candidate.alt_square = (float)landscape->get_altitude(site.x(),site.y());
+		candidate.alt_feet = candidate.alt_square + (float)number_of_blocks;
+		candidate.alt_body = candidate.alt_feet + ((float)(Figure::get_mesh_height(type)));
+		candidate.vis = E_VISIBILITY::HIDDEN;
+		sight_candidates.push_back(candidate);
+	}
+	//< --------------------------------------------------------------
+	//> Trace the lines of sight in three batches. -------------------
+	// If the atagonist can see alt_square and is above it visibility is FULL.
+	// If he is below it visibility is PARTIAL at best unless number_of_blocks > 0.
+	// If the feet are visible when the square is not then obviously these
+	// feet stand on a block and may be interacted with from below.
+	// If the feet are invisible but the body is seen it is in partial cover.
+	// Each batch holds the lines of those candidates the previous batches
+	// found hidden.
+	for (int pass=0;pass<3;pass++)
+	{
+		los_batch.clear();
+		los_owners.clear();
+		for (uint k=0;k<sight_candidates.size();k++)
 		{
-			vis = E_VISIBILITY::FULL;
-		} else {
-			// If the feet are visible when the square is not then
-			// obviously these feet stand on a block and may
-			// be interacted with from below.
-			bool can_see_feet = can_see_square(
-				landscape,
-				eye,
-				site,
-				alt_target_feet,
-				true
-			);
-			if (can_see_feet)
+			const Sight_candidate& candidate = sight_candidates[k];
+			if (candidate.vis != E_VISIBILITY::HIDDEN) continue;
+			float alt_target;
+			switch (pass)
 			{
-				vis = E_VISIBILITY::FULL;
-			} else {
-				// If the feet are invisible but the body is seen it is in partial cover.
-				bool can_see_body = can_see_square(
-					landscape,
-					eye,
-					site,
-					alt_target_feet+ ((float)(Figure::get_mesh_height(figure->get_type()))),
-					true
-				);
-				if (can_see_body) vis = E_VISIBILITY::PARTIAL;
+				case 0:
+					// The square is never seen from below.
+					if (candidate.alt_square >= eye.z()) continue;
+					alt_target = candidate.alt_square;
+					break;
+				case 1: alt_target = candidate.alt_feet; break;
+				default: alt_target = candidate.alt_body; break;
 			}
+			los_batch.add(eye, candidate.site, alt_target,
+				get_line_of_sight_steps(eye, candidate.site));
+			los_owners.push_back(k);
+		}
+		if (los_batch.size() == 0) continue;
+		trace_lines_of_sight(eye, landscape, los_batch, los_kernel);
+		for (int j=0;j<los_batch.size();j++)
+		{
+			if (!los_batch.visible[j]) continue;
+			sight_candidates[los_owners[j]].vis =
+				(pass < 2) ? E_VISIBILITY::FULL : E_VISIBILITY::PARTIAL;
 		}
-		if (vis != E_VISIBILITY::HIDDEN)
-			res.push_back(Antagonist_target(vis,site));
 	}
-	return res;
+	//< --------------------------------------------------------------
+	for (vector<Sight_candidate>::const_iterator CI=sight_candidates.begin();
+		CI!=sight_candidates.end();CI++)
+	{
+		if (CI->vis == E_VISIBILITY::HIDDEN) continue;
+		if (CI->tree_on_top) res.trees.push_back(Antagonist_target(CI->vis,CI->site));
+		if (CI->is_target) res.targets.push_back(Antagonist_target(CI->vis,CI->site));
+	}
+}
+
+//> Player_viewshed. -------------------------------------------------
+void Player_viewshed::compute(Landscape* landscape, QPoint site, int number_of_blocks)
+{
+	this->site = site;
+	this->number_of_blocks = number_of_blocks;
+	width = landscape->get_width();
+	height = landscape->get_height();
+	min_eye_square.resize(width*height);
+	min_eye_feet.resize(width*height);
+	min_eye_body.resize(width*height);
+	float alt_square = (float)landscape->get_altitude(site.x(),site.y());
+	float alt_feet = alt_square + (float)number_of_blocks;
+	float alt_body = alt_feet + Figure::get_mesh_height(E_FIGURE_TYPE::ROBOT);
+	// trace_lines_of_sight(..) walks from the eye to the target in steps.
+	// Step j is at eye + t*(target-eye), t=j/steps. The walk reaches the same
+	// squares no matter how high the eye is. The ray is above a square of
+	// altitude alt if and only if eye.z > (alt - t*target.z)/(1-t).
+	for (int y=0;y<height;y++)
+	{
+		for (int x=0;x<width;x++)
+		{
+			int key = y*width+x;
+			if (x == site.x() && y == site.y())
+			{
+				// Nobody looks at the player from the player's own square.
+				min_eye_square[key] = min_eye_feet[key] = min_eye_body[key] = FLT_MAX;
+				continue;
+			}
+			float bound_square = -FLT_MAX;
+			float bound_feet = -FLT_MAX;
+			float bound_body = -FLT_MAX;
+			QVector3D eye((float)x,(float)y,0);
+			int steps = get_line_of_sight_steps(eye,site);
+			QVector3D dir((float)(site.x()-x),(float)(site.y()-y),0);
+			dir /= (float)steps;
+			for (int j=1;j<steps;j++)
+			{
+				QVector3D current = eye + ((float)j)*dir;
+				QPoint pos((int)round(current.x()),(int)round(current.y()));
+				if (pos == site ||
+					pos.x()<0 || pos.x()>=width || pos.y()<0 || pos.y()>=height) break;
+				float alt = (float)landscape->get_board_sq()->get(pos)->get_altitude();
+				float t = ((float)j)/steps;
+				bound_square = std::max(bound_square, (alt - t*alt_square)/(1-t));
+				bound_feet = std::max(bound_feet, (alt - t*alt_feet)/(1-t));
+				bound_body = std::max(bound_body, (alt - t*alt_body)/(1-t));
+			}
+			// The square itself is never seen from below.
+			min_eye_square[key] = std::max(bound_square, alt_square);
+			min_eye_feet[key] = bound_feet;
+			min_eye_body[key] = bound_body;
+		}
+	}
+}
+
+E_VISIBILITY Player_viewshed::get_visibility(QPoint from, QVector3D eye,
+	QVector3D direction, float h_fov)
+{
+	if (site.x() < 0) return E_VISIBILITY::HIDDEN;
+	//> Is the player within the field of view? ----------------------
+	QVector2D to_player(((float)site.x())-eye.x(), ((float)site.y())-eye.y());
+	QVector2D dir(direction.x(),direction.y());
+	float cos_half_fov = cos(h_fov*PI/360.);
+	if (QVector2D::dotProduct(dir,to_player) <
+		cos_half_fov*dir.length()*to_player.length()) return E_VISIBILITY::HIDDEN;
+	//< --------------------------------------------------------------
+	int key = from.y()*width+from.x();
+	float z = eye.z();
+	if (z > min_eye_square[key] || z > min_eye_feet[key]) return E_VISIBILITY::FULL;
+	if (z > min_eye_body[key]) return E_VISIBILITY::PARTIAL;
+	return E_VISIBILITY::HIDDEN;
+}
+
+Player_viewshed::Player_viewshed()
+{
+	this->width = 0;
+	this->height = 0;
+	this->site = QPoint(-1,-1);
+	this->number_of_blocks = 0;
 }
+//< ------------------------------------------------------------------
 
 Scanner::Scanner(Io_Qt* io)
 {
 	this->io = io;
+	this->scan_generation = 0;
+	this->los_kernel = get_line_of_sight_kernel();
 }
 }
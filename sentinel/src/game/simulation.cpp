@@ -0,0 +1,157 @@
+/**
+ * Sentinel Gl -- an OpenGL based remake of the Firebird classic the Sentinel.
+ * Copyright (C) May 25th, 2015 Markus-Hermann Koch, mhk@markuskoch.eu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+#include <QElapsedTimer>
+#include <QtGlobal>
+#include "simulation.h"
+#include "game.h"
+
+namespace game
+{
+//> Render_snapshot. -------------------------------------------------
+float Render_snapshot::plop_fct(float x)
+{
+	float y = 0;
+	if (x < 0)
+	{
+		y = 0;
+	} else if (x < .5)
+	{
+		y = x*x; // parable up to y=.25
+	} else if (x< .65)
+	{
+		// parable matching first section and running up to 1.3.
+		y = 43.333*x*x - 42.833*x + 10.833;
+	} else if (x<1.0)
+	{
+		y = 2.4490*x*x - 4.8980*x + 3.4490;
+	} else {
+		y = 1.0;
+	}
+	return y;
+}
+
+float Render_snapshot::get_appropriate_scale(Figure* figure)
+{
+	/** Never shrink the Sentinel! */
+	if (figure->get_type()==E_FIGURE_TYPE::SENTINEL) return 1.0;
+	E_MATTER_STATE state = figure->get_state();
+	float scale = 1.0;
+	float fade = figure->get_fade();
+	switch (state)
+	{
+		case E_MATTER_STATE::STABLE: scale = 1.0; break;
+		case E_MATTER_STATE::MANIFESTING: // Fall-through
+		case E_MATTER_STATE::TRANSMUTING: scale = plop_fct(fade); break;
+		case E_MATTER_STATE::DISINTEGRATING: scale = fade; break;
+		case E_MATTER_STATE::GONE: scale = 0.0; break;
+		default: break;
+	}
+	return scale;
+}
+
+Render_snapshot::Render_snapshot()
+	: frustum(QMatrix4x4())
+{
+	this->camera.setToIdentity();
+	this->board_revision = 0;
+}
+//< ------------------------------------------------------------------
+
+//> Snapshot_buffer. -------------------------------------------------
+void Snapshot_buffer::publish()
+{
+	int old_middle = middle.fetchAndStoreOrdered(back | FRESH);
+	back = old_middle & INDEX_MASK;
+}
+
+bool Snapshot_buffer::acquire()
+{
+	if (!(middle.loadAcquire() & FRESH)) return false;
+	int old_middle = middle.fetchAndStoreOrdered(front);
+	front = old_middle & INDEX_MASK;
+	return true;
+}
+
+Snapshot_buffer::Snapshot_buffer()
+{
+	this->front = 0;
+	this->middle.storeRelease(1);
+	this->back = 2;
+}
+//< ------------------------------------------------------------------
+
+//> Simulation_thread. -----------------------------------------------
+void Simulation_thread::run()
+{
+	// qrand() is seeded per thread.
+	qsrand(seed);
+	float dt = 1./framerate;
+	qint64 period = (qint64)(1000./framerate);
+	QElapsedTimer clock;
+	clock.start();
+	qint64 next_tick = 0;
+	while (!stop_requested.loadAcquire())
+	{
+		// Not waiting indefinitely: The GUI thread may hold the mutex while
+		// waiting for this thread to stop.
+		if (!paused.loadAcquire() && game->get_mutex()->tryLock(period))
+		{
+			if (game->do_progress(dt)) game->publish_snapshot();
+			game->get_mutex()->unlock();
+		}
+		next_tick += period;
+		qint64 wait = next_tick - clock.elapsed();
+		if (wait > 0)
+		{
+			msleep(wait);
+		} else {
+			// Running late. Do not try to catch up with a burst of ticks.
+			next_tick = clock.elapsed();
+		}
+	}
+}
+
+void Simulation_thread::set_paused(bool paused)
+{
+	this->paused.storeRelease(paused ? 1 : 0);
+}
+
+void Simulation_thread::stop()
+{
+	stop_requested.storeRelease(1);
+	wait();
+}
+
+Simulation_thread::Simulation_thread(Game* game, float framerate, QObject* parent)
+	: QThread(parent)
+{
+	if (!game) throw "Null pointer encountered.";
+	this->game = game;
+	this->framerate = framerate;
+	this->seed = (uint)qrand();
+	this->paused.storeRelease(0);
+	this->stop_requested.storeRelease(0);
+}
+
+Simulation_thread::~Simulation_thread()
+{
+	stop();
+}
+//< ------------------------------------------------------------------
+}
@@ -0,0 +1,113 @@
+/**
+ * Sentinel Gl -- an OpenGL based remake of the Firebird classic the Sentinel.
+ * Copyright (C) May 25th, 2015 Markus-Hermann Koch, mhk@markuskoch.eu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+#include <cmath>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <QElapsedTimer>
+#include "vec_math.h"
+#include "config.h"
+
+using std::ostringstream;
+using std::vector;
+
+namespace game
+{
+Rotation_2d::Rotation_2d(float degrees)
+{
+	float radians = degrees*PI/180.;
+	this->c = cos(radians);
+	this->s = sin(radians);
+}
+
+Mat4::Mat4(const QMatrix4x4& A)
+{
+	const float* data = A.constData();
+	for (int k=0;k<4;k++)
+		columns[k] = Vec4(data[4*k], data[4*k+1], data[4*k+2], data[4*k+3]);
+}
+
+string benchmark_vec_math(int n)
+{
+	//> Random angles, directions and points. ------------------------
+	unsigned int random = 12345;
+	vector<float> angles(n);
+	vector<QVector3D> points(n);
+	for (int j=0;j<n;j++)
+	{
+		random = random*1103515245 + 12345;
+		angles[j] = (float)((random>>8) % 36000)/100.f;
+		float f[3];
+		for (int k=0;k<3;k++)
+		{
+			random = random*1103515245 + 12345;
+			f[k] = (float)((random>>8) % 6400)/100.f;
+		}
+		points[j] = QVector3D(f[0], f[1], f[2]);
+	}
+	QMatrix4x4 camera;
+	camera.setToIdentity();
+	camera.perspective(60, 4./3., .1, 100);
+	camera.lookAt(QVector3D(3,5,7), QVector3D(32,32,0), QVector3D(0,0,1));
+	//< --------------------------------------------------------------
+	ostringstream oss;
+	oss << std::fixed << std::setprecision(1);
+	// The sums keep the loops from being optimized away.
+	float sum_qt = 0;
+	float sum_simd = 0;
+	QElapsedTimer clock;
+	//> Turning around the z axis. -----------------------------------
+	clock.start();
+	for (int j=0;j<n;j++)
+	{
+		QMatrix4x4 rot; rot.setToIdentity();
+		rot.rotate(angles[j],QVector3D(0,0,1));
+		sum_qt += (rot*points[j]).x();
+	}
+	qint64 ns_qt = clock.nsecsElapsed();
+	clock.restart();
+	for (int j=0;j<n;j++)
+	{
+		sum_simd += Rotation_2d(angles[j]).apply_z(points[j]).x();
+	}
+	qint64 ns_simd = clock.nsecsElapsed();
+	oss << "rotate_z: QMatrix4x4 " << (double)ns_qt/(double)n << " ns, Rotation_2d " <<
+		(double)ns_simd/(double)n << " ns";
+	//< --------------------------------------------------------------
+	//> Projecting points. -------------------------------------------
+	clock.restart();
+	for (int j=0;j<n;j++)
+	{
+		sum_qt += (camera*QVector4D(points[j],1)).w();
+	}
+	ns_qt = clock.nsecsElapsed();
+	clock.restart();
+	Mat4 A(camera);
+	for (int j=0;j<n;j++)
+	{
+		sum_simd += (A*Vec4(points[j])).to_QVector4D().w();
+	}
+	ns_simd = clock.nsecsElapsed();
+	oss << "; project: QMatrix4x4 " << (double)ns_qt/(double)n << " ns, Mat4 " <<
+		(double)ns_simd/(double)n << " ns";
+	//< --------------------------------------------------------------
+	oss << " (" << sum_qt - sum_simd << " apart)";
+	return oss.str();
+}
+}
@@ -38,7 +38,16 @@
 // Hyperdrive coil chargin time in ms.
 #define DEFAULT_HYPERDRIVE_CHARGING_TIME 2500.0
 #define DEFAULT_MEANIE_SPEED_FACTOR 4.0
+// Time per tick the antagonists may spend scanning in microseconds.
+// 0 has every antagonist scan every tick.
+#define DEFAULT_SCAN_BUDGET_US 4000
+// Ticks after which an antagonist is rescanned regardless of the budget.
+#define MAX_SCAN_AGE_TICKS 6
+// Capacity of the inline array holding the figures stacked upon one square.
+#define MAX_FIGURE_STACK_HEIGHT 64
 
 // Default increase/decrease of FOV when pressing '+' or '-' keys.
 #define DEFAULT_DELTA_ZOOM 3.0
+// Light factor for the square or figure under the mouse.
+#define HOVER_HIGHLIGHT 1.35
 #endif
@@ -31,6 +31,7 @@
 
 #include <vector>
 #include <string>
+#include <map>
 #include <QOpenGLWidget>
 #include <QOpenGLFunctions>
 #include <QOpenGLTexture>
@@ -42,10 +43,12 @@
 #include <QVector2D>
 #include "config.h"
 #include "io_qt.h"
+#include "mesh_bvh.h"
 #include "form_game_setup.h"
 
 using std::vector;
 using std::string;
+using std::map;
 
 using namespace mhk_gl;
 
@@ -93,6 +96,20 @@ struct Antagonist_target
 		{ this->visibility = visibility; this->board_pos = board_pos; }
 };
 
+/** Everything a single scan of an antagonist found. */
+struct Antagonist_sight
+{
+	/** Robots and blocks within sight. To be attacked. */
+	vector<Antagonist_target> targets;
+	/** Squares with a tree on top within sight. Candidates for a meanie. */
+	vector<Antagonist_target> trees;
+	/** Empty non-CONNECTION squares within the field of view. Line of sight
+	 * is not checked for these. Candidates for tree manifestation. */
+	vector<QPoint> free_squares;
+
+	void clear() { targets.clear(); trees.clear(); free_squares.clear(); }
+};
+
 /** In openGL a vertex sports
  * + its 4D coordinates,
  * + for some reason a 3D normal vector which in this project will be
@@ -113,6 +130,89 @@ struct Vertex_Data
 	string toString();
 };
 
+/** Axis aligned box and bounding sphere of a mesh. Cheap stand-ins for the
+ * mesh whenever most objects are to be rejected quickly. */
+struct Mesh_bounds
+{
+	QVector3D box_min;
+	QVector3D box_max;
+	QVector3D sphere_center;
+	float sphere_radius;
+
+	/** Sets the box to the extent of the given positions and the sphere to
+	 * the smallest one around the box center holding them all. */
+	void compute(const vector<QVector3D>& positions);
+
+	/** @return the bounds of the mesh drawn translate*rotate*scale. I.e.
+	 *   scaled, then rotated by phi degrees around the z axis, then
+	 *   translated. The box will be the box around the rotated box. */
+	Mesh_bounds transformed(QVector3D translation, float phi, float scale) const;
+
+	/** @return false if the segment origin + t*direction, t in [0,1], surely
+	 *   misses the bounds. True if it may hit them. */
+	bool may_be_hit_by(QVector3D origin, QVector3D direction) const;
+
+	Mesh_bounds();
+};
+
+/** The six planes bounding what a camera sees. */
+class View_frustum
+{
+private:
+	/** (n,d) with n pointing inwards, |n|=1. Inside means dot(n,p)+d >= 0. */
+	QVector4D planes[6];
+
+public:
+	/** @return true if and only if the sphere lies completely outside. */
+	bool is_outside(QVector3D center, float radius) const;
+
+	/** @param QMatrix4x4& camera: perspective*lookAt. */
+	View_frustum(const QMatrix4x4& camera);
+};
+
+/** Resources by integer handle. Names stem from configuration files and
+ * are resolved to handles once at load. Per frame only handles are used.
+ * A handle stays valid for the lifetime of the table. */
+template<class T> class Resource_table
+{
+private:
+	vector<T> items;
+	map<string,int> handles;
+
+public:
+	/** Adds the resource under the given name or replaces the one there.
+	 * @return the handle of the name. */
+	int add(const string& name, T item)
+	{
+		map<string,int>::const_iterator CI = handles.find(name);
+		if (CI != handles.end())
+		{
+			items[CI->second] = item;
+			return CI->second;
+		}
+		int handle = (int)items.size();
+		items.push_back(item);
+		handles[name] = handle;
+		return handle;
+	}
+
+	/** Looks the name up. Meant for load time. */
+	int get_handle(const string& name) const
+	{
+		map<string,int>::const_iterator CI = handles.find(name);
+		if (CI == handles.end()) throw "Unknown resource name.";
+		return CI->second;
+	}
+
+	T get(int handle) const { return items[handle]; }
+	/** Same as get(get_handle(name)). Meant for load time. */
+	T get(const string& name) const { return items[get_handle(name)]; }
+	bool contains(const string& name) const { return handles.find(name) != handles.end(); }
+	int size() const { return (int)items.size(); }
+	/** All resources in order of their handles. E.g. for deletion. */
+	const vector<T>& get_items() const { return items; }
+};
+
 // Remember that &(vector[0]) gets you the array pointer and have a look
 // at http://doc.qt.io/qt-5/qtopengl-cube-geometryengine-cpp.html
 class Mesh_Data
@@ -132,6 +232,8 @@ public:
 	GLenum draw_mode;
 	
 	string program_name;
+	/** Handle of program_name in Widget_OpenGl::programs. Set at load. */
+	int program;
 	
 	QOpenGLTexture* texture;
 	
@@ -141,9 +243,14 @@ public:
 	QOpenGLBuffer buf_vertices;
 	// More traditional buffer holding elements.
 	QOpenGLBuffer buf_elements;
+	// Bounds in model coordinates. Computed by parse_blender_obj(..).
+	Mesh_bounds bounds;
+	// Triangles in model coordinates for ray picking. Built by parse_blender_obj(..).
+	Mesh_bvh bvh;
 
 	/** Parses a blender created wavefront .obj file content into this Mesh_Data.
-	 * Afterwards this->vertices and this->elements will be defined.
+	 * Afterwards this->vertices, this->elements, this->bounds and this->bvh
+	 * will be defined.
 	 * @param string src: Plain src from the obj file. Needs to be triangulated,
 	 *   hold normals and texture coordinates.
 	 * @return true if and only if all went fine. */
@@ -195,6 +302,19 @@ private:
 
 	// Needed for the apsect ratio.
 	QOpenGLWidget* parent;
+
+	// Incremented by every setter. The derived state below is valid as long
+	// as cache_version and cache_aspect match version and get_aspect().
+	uint version;
+	uint cache_version;
+	float cache_aspect;
+	QMatrix4x4 cache_camera;
+	QMatrix4x4 cache_camera_inverse;
+	View_frustum cache_frustum;
+	float cache_fov_h;
+
+	/** Recomputes the derived state unless it is up to date. */
+	void update_cache();
 	
 public:
 	float get_phi();
@@ -259,8 +379,15 @@ public:
 	  * QOpenGLWidget dimensions if available. 640/480 else. */
 	float get_aspect();
 	
-	/** @return the matrix A := perspective*lookAt based on this object's data. */
-	QMatrix4x4 get_camera();
+	/** @return the matrix A := perspective*lookAt based on this object's data.
+	 *   Cached until a setter is called or the aspect ratio changes. */
+	const QMatrix4x4& get_camera();
+
+	/** @return the inverse of get_camera(). Cached alike. */
+	const QMatrix4x4& get_camera_inverse();
+
+	/** @return the planes bounding get_camera(). Cached alike. */
+	const View_frustum& get_frustum();
 
 	string toString();
 	
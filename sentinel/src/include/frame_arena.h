@@ -0,0 +1,110 @@
+/**
+ * Sentinel Gl -- an OpenGL based remake of the Firebird classic the Sentinel.
+ * Copyright (C) May 25th, 2015 Markus-Hermann Koch, mhk@markuskoch.eu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * Monotonic memory for temporaries that live no longer than one frame.
+ * Allocating is bumping a pointer, deallocating does nothing at all and
+ * reset() hands everything back at once. The Scanner draws its
+ * temporaries from one of these.
+ *
+ * Only meant for types that need no destructor (QPoint, QVector4D, plain
+ * structs). Nothing allocated here survives the next reset().
+ */
+
+#ifndef MHK_FRAME_ARENA_H
+#define MHK_FRAME_ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+using std::vector;
+
+namespace game
+{
+class Frame_arena
+{
+private:
+	/** Every allocation starts at a multiple of this. */
+	static const size_t ALIGNMENT = 16;
+
+	/** Allocations are carved off the front of this block. */
+	char* block;
+	size_t capacity;
+	size_t used;
+	/** Blocks that ran full since the last reset(). */
+	vector<char*> full_blocks;
+	/** Bytes handed out since the last reset(). */
+	size_t frame_bytes;
+
+	void* allocate_bytes(size_t bytes);
+	/** Not copyable. The blocks are owned. */
+	Frame_arena(const Frame_arena&);
+	Frame_arena& operator=(const Frame_arena&);
+
+public:
+	/** @return uninitialized memory for n objects of type T. */
+	template<class T> T* allocate(size_t n)
+		{ return static_cast<T*>(allocate_bytes(n*sizeof(T))); }
+
+	/** Invalidates everything allocated so far. If the block ran full
+	 * since the last reset it is replaced by one large enough for that
+	 * frame. Thus a steady state is reached after the first few frames. */
+	void reset();
+
+	Frame_arena(size_t capacity=65536);
+	~Frame_arena();
+};
+
+/** Standard allocator drawing from a Frame_arena. For std::vectors that are
+ * to be thrown away at the end of the frame. */
+template<class T> class Arena_allocator
+{
+public:
+	typedef T value_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	template<class U> struct rebind { typedef Arena_allocator<U> other; };
+
+	Frame_arena* arena;
+
+	pointer address(reference x) const { return &x; }
+	const_pointer address(const_reference x) const { return &x; }
+	pointer allocate(size_type n, const void* hint=0) { return arena->allocate<T>(n); }
+	void deallocate(pointer p, size_type n) {}
+	size_type max_size() const { return ((size_t)-1)/sizeof(T); }
+	void construct(pointer p, const T& value) { new((void*)p) T(value); }
+	void destroy(pointer p) { p->~T(); }
+
+	Arena_allocator(Frame_arena* arena) { this->arena = arena; }
+	template<class U> Arena_allocator(const Arena_allocator<U>& other)
+		{ this->arena = other.arena; }
+};
+
+template<class T, class U>
+bool operator==(const Arena_allocator<T>& a, const Arena_allocator<U>& b)
+	{ return a.arena == b.arena; }
+template<class T, class U>
+bool operator!=(const Arena_allocator<T>& a, const Arena_allocator<U>& b)
+	{ return a.arena != b.arena; }
+}
+#endif
@@ -22,15 +22,17 @@
  * 
  * Markus-Hermann Koch, mhk@markuskoch.eu, 13.05.2015
  * 
- * Note about multithreading implied by QTimer: Apparently there is none.
- * According to
- * 
- *   http://stackoverflow.com/questions/23555631/can-i-use-qtimer-to-replace-qthread
- * 
- * QTimers run within the main GUI thread context and cause no race conditions.
- * Suits me fine. Sentinel runs fast enough as it does while the only chance
- * for multithreading would be view analysis for the diverse agents -- which
- * still is fast enough when queued.
+ * Note about multithreading: do_progress() is called from a Simulation_thread
+ * (see simulation.h) while the QTimers, their slots and all input handling
+ * remain within the main GUI thread context. Both sides lock get_mutex()
+ * before touching the game. Input that merely moves the view does not wait
+ * for it: The GUI queues it and applies it on a frame that gets tryLock().
+ * The renderer does not lock at all. It draws the
+ * Render_snapshots published by publish_snapshot().
+ * QTimers may only be started from the thread they live in. Hence
+ * meanie_timer and hyperspace_timer exist for the lifetime of the game and
+ * are started by queued invocation of start_meanie_timer(..) and
+ * start_hyperspace_timer(..). These respect a pause that began meanwhile.
  */
 
 #ifndef MHK_GAME_H
@@ -39,11 +41,14 @@
 #include <map>
 #include <QTimer>
 #include <QSound>
+#include <QMutex>
+#include <QAtomicInt>
 
 #include "form_game_setup.h"
 #include "landscape.h"
 #include "io_qt.h"
 #include "scanner.h"
+#include "simulation.h"
 
 using std::map;
 using std::pair;
@@ -59,39 +64,108 @@ enum E_UPDATE_GAME_STATUS_BY { SURVEYOR, MANIFESTOR, DISINTEGRATOR, GONER_REMOVE
 // ABSMANI means both absorption and manifestation are possible. Exchange means mind transfer.
 enum E_POSSIBLE_PLAYER_ACTION { NO, ABSORPTION, MANIFESTATION, ABSMANI, EXCHANGE };
 
+/** Handles of the sounds in Known_Sounds. */
+enum E_SOUND { SOUND_ABSORPTION_SENTINEL, SOUND_ABSORPTION, SOUND_DELAYED_PLOP, SOUND_TICK,
+	SOUND_FROG, SOUND_FROG_REVERSE, SOUND_PLOP, SOUND_VICTORY, SOUND_DEFEAT, NUMBER_OF_SOUNDS };
+
 class Known_Sounds
 {
 private:
-	bool sound_on;
-	map<string, QSound*> sounds;
+	/** Toggled by the GUI thread without the game mutex. */
+	QAtomicInt sound_on;
+	/** Indexed by E_SOUND. */
+	QSound* sounds[E_SOUND::NUMBER_OF_SOUNDS];
 
 public:
-	bool get_sound() { return sound_on; }
-	bool toggle_sound() { sound_on = !sound_on; return sound_on; }
+	bool get_sound() { return sound_on.loadAcquire(); }
+	bool toggle_sound() { sound_on.storeRelease(!sound_on.loadAcquire()); return get_sound(); }
 	
-	void play(string key)
+	/** Safe to call from the simulation thread: The sound is played
+	 * by the GUI thread the QSound objects live in. */
+	void play(E_SOUND sound)
 	{
-		if (sound_on) sounds.at(key)->play();
+		if (get_sound()) QMetaObject::invokeMethod(sounds[sound], "play", Qt::QueuedConnection);
 	}
 	
 	/** Default constructor setting sensible defaults. */
 	Known_Sounds()
 	{
-		sounds.insert(pair<string,QSound*>("absorption_sentinel",new QSound(":/sound/absorption_sentinel.wav")));
-		sounds.insert(pair<string,QSound*>("absorption",new QSound(":/sound/absorption.wav")));
-		sounds.insert(pair<string,QSound*>("delayed_plop",new QSound(":/sound/delayed_plop.wav")));
-		sounds.insert(pair<string,QSound*>("tick",new QSound(":/sound/tick.wav")));
-		sounds.insert(pair<string,QSound*>("frog",new QSound(":/sound/frog.wav")));
-		sounds.insert(pair<string,QSound*>("frog_reverse",new QSound(":/sound/frog_reverse.wav")));
-		sounds.insert(pair<string,QSound*>("plop",new QSound(":/sound/hyperspace_plop.wav")));
-		sounds.insert(pair<string,QSound*>("victory",new QSound(":/sound/victory.wav")));
-		sounds.insert(pair<string,QSound*>("defeat",new QSound(":/sound/defeat.wav")));
-		sound_on = true;
+		sounds[E_SOUND::SOUND_ABSORPTION_SENTINEL] = new QSound(":/sound/absorption_sentinel.wav");
+		sounds[E_SOUND::SOUND_ABSORPTION] = new QSound(":/sound/absorption.wav");
+		sounds[E_SOUND::SOUND_DELAYED_PLOP] = new QSound(":/sound/delayed_plop.wav");
+		sounds[E_SOUND::SOUND_TICK] = new QSound(":/sound/tick.wav");
+		sounds[E_SOUND::SOUND_FROG] = new QSound(":/sound/frog.wav");
+		sounds[E_SOUND::SOUND_FROG_REVERSE] = new QSound(":/sound/frog_reverse.wav");
+		sounds[E_SOUND::SOUND_PLOP] = new QSound(":/sound/hyperspace_plop.wav");
+		sounds[E_SOUND::SOUND_VICTORY] = new QSound(":/sound/victory.wav");
+		sounds[E_SOUND::SOUND_DEFEAT] = new QSound(":/sound/defeat.wav");
+		sound_on.storeRelease(1);
 	}
 	
 	~Known_Sounds();
 };
 
+/** Index of those board squares that are of interest during a game tick.
+ * Classification is by the top figure of each square's stack. The lists
+ * are kept up to date incrementally: Whoever changes a stack (manifestation,
+ * disintegration, transmutation, hyperspace, goner removal and fading)
+ * calls update(..) for the square in question. That way per-frame work
+ * is proportional to the number of active figures rather than board area.
+ * Note that of each stack only ever the top figure changes its matter state.
+ */
+class Figure_index
+{
+private:
+	Board<Figure>* board_fg;
+
+	/** Squares with a Sentinel, sentry or meanie on top of the stack. */
+	vector<QPoint> antagonists;
+	/** Squares with a tree on top of the stack. */
+	vector<QPoint> trees;
+	/** Squares which's top figure is MANIFESTING, DISINTEGRATING, TRANSMUTING or GONE. */
+	vector<QPoint> transitions;
+	/** Squares holding any figure at all. */
+	vector<QPoint> occupied;
+	/** Per square, row major: position within the respective list above. -1 if absent. */
+	vector<int> slots_antagonists;
+	vector<int> slots_trees;
+	vector<int> slots_transitions;
+	vector<int> slots_occupied;
+	/** Site of the meanie. There is at most one. (-1,-1) if there is none. */
+	QPoint meanie;
+	/** Per square, row major: summary of its stack. */
+	vector<Square_summary> summaries;
+	/** Incremented by update(..) and touch(). Anything derived from the
+	 * board stays valid as long as this does not change. */
+	uint revision;
+
+	/** Adds pos to or removes it from list, keeping list_positions up to date.
+	 * Removal swaps the last list entry into the vacated position. */
+	void set_membership(vector<QPoint>& list, vector<int>& list_positions, QPoint pos, bool member);
+
+public:
+	const vector<QPoint>& get_antagonists() { return antagonists; }
+	const vector<QPoint>& get_trees() { return trees; }
+	const vector<QPoint>& get_transitions() { return transitions; }
+	const vector<QPoint>& get_occupied() { return occupied; }
+	/** @return the site of the meanie or (-1,-1) if there is none. */
+	QPoint get_meanie() { return meanie; }
+	/** @return the stack summaries of all squares, row major. */
+	const Square_summary* get_summaries() { return &(summaries[0]); }
+	bool is_antagonist_site(QPoint pos);
+	uint get_revision() { return revision; }
+
+	/** Reclassifies the given square by its current top figure. */
+	void update(QPoint pos);
+	/** Marks the board as changed without a stack having changed.
+	 * E.g. after antagonists turned. */
+	void touch() { revision++; }
+	/** Reclassifies all squares. Needed only once after board setup. */
+	void rebuild();
+
+	Figure_index(Board<Figure>* board_fg);
+};
+
 class Game : public QObject
 {
 Q_OBJECT
@@ -133,6 +207,25 @@ private:
 	 * i.e. those that actually stand upon the squares. Use Figure methods
 	 * in oreder to access stacked items. */
 	Board<Figure>* board_fg;
+
+	/** Squares of interest by the type and state of their top figures.
+	 * Needs to be updated whenever a stack on board_fg changes. */
+	Figure_index* figure_index;
+	/** Batch update of antagonist rotation and figure fading. */
+	Progress_kernel* progress_kernel;
+	/** From where the player can be seen. Kept up to date by update_player_viewshed(). */
+	Player_viewshed* player_viewshed;
+
+	/** Serializes the simulation thread with the GUI thread. Recursive since
+	 * slots like hyperspace_jump() call further locking methods. */
+	QMutex mutex;
+	/** Hands the board state over to the renderer. */
+	Snapshot_buffer* snapshots;
+
+	/** Energy ledger: Sum of the energy values of all figures on the board.
+	 * Kept up to date by book_landscape_energy(..) on each manifestation,
+	 * transmutation and removal rather than recounted. */
+	int landscape_energy;
 	
 	/** Player Data object. */
 	Player_Data* player;
@@ -144,12 +237,18 @@ private:
 	/** From the checkbox concerning meanies within setup_data. */
 	bool do_meanies;
 	
-	/** A meanie */
+	/** A meanie's lifetime. */
 	QTimer* meanie_timer;
+	/** true while there is a meanie on the board. */
+	bool meanie_active;
 
-	/** Should be 0 as a rule unless an active hyperspace process is present. */
+	/** Charging time of the hyperdrive coils. */
 	QTimer* hyperspace_timer;
+	/** Should be false as a rule unless an active hyperspace process is present. */
+	bool hyperspace_charging;
 
+	/** true between pause_timers() and unpause_timers(). */
+	bool timers_paused;
 	/** QTimer pause related helpers. */
 	bool meanie_timer_paused;
 	int meanie_timer_remaining;
@@ -160,18 +259,23 @@ private:
 	
 	/** For damage control concerning antagonist attacks. */
 	float framerate;
+
+	/** Time per tick scan_antagonists() may spend in microseconds. 0 for no limit. */
+	int scan_budget_us;
+	/** Index into the antagonist list where the next round of scans starts. */
+	uint scan_cursor;
 	
 	/** Object 'confidence' */
 	float object_resilience;
 	
 	/** Checks whether the game status needs to be changed and does so if necessary.
 	* This function should be called at the end of end_survey(), disintegrate_figure(),
-	* manifest_figure(), remove_goners_from_board(), transfer(), and hyperspace().
+	* manifest_figure(), progress_transitions(), transfer(), and hyperspace().
 	* 1.) The game snaps from SURVEY to PRELIMINARY as soon as end_survey() is called.
 	* 2.) The game snaps from PRELIMINARY to RUNNING as soon as manifesting or
 	*   disintegrating figures are found on the board.
 	* 3.) The game snaps from RUNNING to SENTINEL_ABSORBED as soon as
-	*   remove_goners_from_board() has called and the board was found
+	*   progress_transitions() has called and the board was found
 	*   to be without The Sentinel.
 	* 4.) The game snaps to TOWER_TAKEN after transfer() was called moving
 	*   the player's consciousness onto The Sentinel's tower.
@@ -189,25 +293,29 @@ private:
 	void match_current_robot_to_viewer_Data();
 
 	/** Works on top of a figure stack and triggers its transmutation into the new type.
-	 * This requires that said top figure is STABLE. */
+	 * This requires that said top figure is STABLE. Else nothing happens.
+	 * Keeps figure_index and the energy ledger up to date. */
 	void transmute_figure(QPoint, E_FIGURE_TYPE new_type);
-	
-	/** Checks all stack-tops for Figures with matter state GONE,
-	* pops and deletes them. If afterwards the stack is empty the pointer
-	* on the figure board is reset to 0.
+
+	/** Adds delta to the landscape_energy ledger. Call it after the board
+	 * has been changed. In MHK_DEBUG builds the ledger is checked against
+	 * recount_landscape_energy() each time. */
+	void book_landscape_energy(int delta);
+	
+	/** Advances the fading of all stack-tops in transition by dt. Idle figures
+	* are not looked at. Those which just reached matter state GONE are
+	* popped and deleted right away. If afterwards the stack is empty the pointer
+	* on the figure board is reset to 0. Those which became STABLE leave
+	* the transition list.
 	* This function calls update_game_status(GONER_REMOVER) if and only
 	* if it has just removed The Sentinel from play.
+	* @return true if any figure was in transition.
 	*/
-	void remove_goners_from_board();
+	bool progress_transitions(float dt);
 
 	/** Tool fct for get_possible_interactions. */
 	bool is_stack_of_stable_blocks(Figure* figure);
 	
-	/** Analyses the game situation and player position in order
-	 * to determine how the player may interact with a given result
-	 * from this->get_mosue_target(). */
-	E_POSSIBLE_PLAYER_ACTION get_possible_interactions(QPoint,Figure*);
-
 	/** If the player is detected the antagonist wants to center his
 	 * attention on the player. If need be he turns against his usual
 	 * turning direction in order to get the player central to his view. 
@@ -235,8 +343,8 @@ private:
 	 */
 	vector<QPoint> restrict_to_free_non_CONNECTION(vector<QPoint> data);
 	
-	/** Tool function for SLOT revert_meanie_to_tree(). Scans the board
-	 * for a stable meanie. 
+	/** Tool function for SLOT revert_meanie_to_tree(). Looks up the
+	 * meanie within figure_index and checks whether it is stable. 
 	 * @return QPoint_Figure pair with either the info for the stable meanie
 	 * or [(-1,-1),0] if none was found. */
 	QPoint_Figure find_stable_meanie();
@@ -244,11 +352,11 @@ private:
 	/** Seeks a stable meanie and turns it into a tree. */
 	void revert_meanie_to_tree();
 
-	/** Turns an arbitrary tree into a meanie. */
+	/** Turns an arbitrary tree seen by the antagonist into a meanie. */
 	void antagonist_summon_meanie(QPoint antagonist_pos, Figure* antagonist);
 	
-	/** Employs methods from Scanner and Landscape to randomly manifest
-	 * a tree within the field of view of the antagonist. */
+	/** Randomly manifests a tree on one of the free squares of the
+	 * antagonist's latest scan. */
 	void antagonist_tree_manifestation(QPoint antagonist_pos, Figure* antagonist);
 	
 	/** Called by antagonist_action() which in turn is called by doProgress (and
@@ -286,13 +394,33 @@ private:
 	
 	/** 
 	 * Tool function for antagonist_action.
-	 * Employs this scanner in order to get a vector of all targets
-	 * the given antagonist sees right now. 
+	 * Employs this scanner in order to get all targets, trees and free
+	 * squares the given antagonist sees right now.
 	 * @param QPoint board_pos: Board position of the antagonist in question.
-	 * @param bool seek_trees: Should be set to false for any antagonist that
-	 *   is not seeking a tree in the hopes of making a meanie.
-	 * @return vector<Antagonist_target> of all possible targets for this antagonist. */
-	vector<Antagonist_target> get_antagonist_targets(QPoint board_pos, bool seek_trees=false);
+	 * @param Antagonist_sight& res: Will be cleared and filled. */
+	void get_antagonist_targets(QPoint board_pos, Antagonist_sight& res);
+
+	/** Recomputes player_viewshed if the player has moved or the number
+	 * of blocks beneath him has changed since. */
+	void update_player_viewshed();
+
+	/** Replaces whatever targets has on the player's square by what the
+	 * antagonist sees of the player right now according to player_viewshed.
+	 * Called each tick. Thus player detection is never out of date, no matter
+	 * how old the rest of the antagonist's sight is. */
+	void update_player_target(QPoint pos_antagonist, Figure* antagonist,
+		vector<Antagonist_target>& targets);
+
+	/** Fills the sight of the given antagonist anew. */
+	void scan_antagonist(QPoint board_pos, Figure* antagonist);
+
+	/** Rescans as many antagonists as fit into scan_budget_us, the others
+	 * keep attacking what they saw before. Urgent ones go first: Those that
+	 * never scanned, see the player, are attacking, or have not scanned for
+	 * MAX_SCAN_AGE_TICKS. The rest take turns. Antagonists that never
+	 * scanned or have not scanned for MAX_SCAN_AGE_TICKS are scanned
+	 * regardless of the budget. Thus no sight gets older than that. */
+	void scan_antagonists();
 	
 	/** Picks a random square as hyperspace destination. Will not be higher in
 	 * terms of altitude and rather far away from the point of origin.
@@ -302,12 +430,9 @@ private:
 	 */
 	QPoint pick_hyperspace_destination(QPoint old_site, int old_altitude);
 	
-	/** Checks each board square for stacks of figures (including those of height 1).
-	 * @return the figure on the top of each stack. Obviously a !=0 pointer. */
-	 vector<QPoint_Figure> get_all_top_figures();
-	 
-	 /** Counts the energy left in the landscape. */
-	 int count_landscape_energy();
+	 /** Counts the energy left in the landscape walking over all stacks.
+	  * Use landscape_energy instead. This is for initialization and checks. */
+	 int recount_landscape_energy();
 	 
 public:
 	E_GAME_TYPE get_game_type() { return this->game_type; }
@@ -316,9 +441,22 @@ public:
 	Landscape* get_landscape() { return this->landscape; }
 	Board<Figure>* get_board_fg() { return this->board_fg; }
 	bool toogle_sound() { return this->known_sounds->toggle_sound(); }
+	/** Lock this before calling any other method from outside the simulation. */
+	QMutex* get_mutex() { return &mutex; }
+	Snapshot_buffer* get_snapshots() { return snapshots; }
+	/** @return a number that changes whenever a figure on the board does. */
+	uint get_board_revision() { return figure_index->get_revision(); }
+	/** @param int microseconds: Time per tick the antagonists may spend
+	 *   scanning. 0 has every antagonist scan every tick. */
+	void set_scan_budget(int microseconds) { scan_budget_us = microseconds; }
+
+	/** Writes the drawable state of the board and the player's camera
+	 * into the back buffer of this->snapshots and publishes it.
+	 * The caller is required to hold get_mutex(). */
+	void publish_snapshot();
 
 	/** Updates the states of all non-player figures by dt for each calling
-	 * progress in turn. It also calls remove_goners_from_board().
+	 * progress in turn. It also calls progress_transitions().
 	 * @param float dt:
 	 * @return true if any figure has a visible progress.
 	 * Note: Will ALWAYS return false and do nothing else unless in
@@ -339,6 +477,11 @@ public:
 	 */
 	E_POSSIBLE_PLAYER_ACTION get_mouse_target(float mouse_gl_x, float mouse_gl_y,
 		QPoint& board_pos, Figure*& figure);
+
+	/** Analyses the game situation and player position in order
+	 * to determine how the player may interact with a given result
+	 * from this->get_mosue_target(). */
+	E_POSSIBLE_PLAYER_ACTION get_possible_interactions(QPoint,Figure*);
 	
 	/** @return a human readable string describing the game status. */
 	QString get_game_status_string();
@@ -390,9 +533,9 @@ public:
 	void disintegrate_figure(QPoint pos, bool by_robot);
 
 	/**
-	* Does nothing if hyperdrive_timer != 0.
+	* Does nothing if hyperspace_charging.
 	* Starts the warp drive. I.e.:
-	* Generates a timer object this->hyperdrive_timer which, after 3 seconds,
+	* Starts this->hyperspace_timer which, after 2.5 seconds,
 	* will implement the jump by calling hyperspace_jump().
 	* @return true if and only if the request was successfully issued.
 	*/
@@ -405,7 +548,8 @@ public:
 	void transfer(QPoint destination);
 
 	/** Stops and restarts the hayperdrive and meanie QTtimers 
-	 * hyperdrive_timer and meanie_timer, if they exist, that is. */
+	 * hyperdrive_timer and meanie_timer, if they are active, that is.
+	 * GUI thread only. */
 	void pause_timers();
 	void unpause_timers();
 	
@@ -425,7 +569,7 @@ public:
 	
 private slots:
 	/* Triggered by the timeout of the hyperdrive_timer. Resets
-	 * the timer to 0, the hyperspace_request to false and
+	 * hyperspace_charging to false and
 	 * actually implements the jump complete with 3 units of energy consumption.
 	 * Three cases:
 	 * 1.) The warp drive was activated from The Sentinel's tower.
@@ -445,6 +589,13 @@ private slots:
 	 * if the meanie was successful or if the player absorbed it) back into a tree
 	 * by means of transmutation. */
 	void meanie_timeout_slot();
+
+	/** Start this->meanie_timer and this->hyperspace_timer respectively.
+	 * Queued by the simulation thread. If the timers were paused meanwhile
+	 * the timer is left stopped and marked paused with all of msec remaining.
+	 * unpause_timers() will start it then. */
+	void start_meanie_timer(int msec);
+	void start_hyperspace_timer(int msec);
 };
 }
 
@@ -0,0 +1,138 @@
+/**
+ * Sentinel Gl -- an OpenGL based remake of the Firebird classic the Sentinel.
+ * Copyright (C) May 25th, 2015 Markus-Hermann Koch, mhk@markuskoch.eu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * Picking on the GPU. An alternative to the Scanner's picking on the CPU.
+ * The squares and the pickable figures of a Render_snapshot are drawn into a
+ * tiny offscreen framebuffer covering only the pixels around the mouse. Each
+ * one is drawn in a flat color encoding its id. The pixel under the mouse is
+ * copied into a pixel buffer object and read back during the next update.
+ * Thus the GPU is never waited for and the result is exactly what is drawn
+ * under the mouse. Squares and figures outside the few pixels are culled
+ * by their bounds, so the cost hardly depends on the size of the board.
+ *
+ * Needs framebuffer objects and GLSL 120 and nothing else: No textures,
+ * no multisampling, no integer formats. Software implementations like
+ * Mesa's llvmpipe do. Without pixel buffer objects the pixel is read
+ * back synchronously.
+ *
+ * All methods rendering or reading back need the OpenGL context to be
+ * current and must not be called from within paintGL(), since they bind
+ * a framebuffer of their own and leave blending disabled.
+ */
+
+#ifndef MHK_GPU_PICKER_H
+#define MHK_GPU_PICKER_H
+
+#include <vector>
+#include <QOpenGLFunctions>
+#include <QOpenGLBuffer>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLShaderProgram>
+#include "hover_picker.h"
+
+using std::vector;
+
+using namespace game;
+
+namespace display
+{
+class Gpu_picker
+{
+private:
+	/** Width and height of the offscreen framebuffer in pixels. Odd such that
+	 * the center pixel is centered on the mouse. */
+	static const int REGION = 3;
+
+	QOpenGLFunctions* gl;
+	/** The "pick_id" program. Not owned. */
+	QOpenGLShaderProgram* program;
+	QOpenGLFramebufferObject* fbo;
+	/** Receives the pixel under the mouse. */
+	QOpenGLBuffer pbo;
+	bool use_pbo;
+	/** The pixel read back synchronously if there is no pbo. */
+	unsigned char pixel[4];
+
+	/** A pass was rendered and is yet to be collected. */
+	bool pending;
+	/** Mouse, camera and board revision of the pending pass. */
+	Hover_target pending_target;
+	/** Board width and height of the pending pass. Squares have the ids
+	 * 1..width*height. Figures follow. */
+	int pending_width;
+	int pending_height;
+	/** Per figure id of the pending pass, starting at width*height+1. */
+	vector<const Figure*> pending_figures;
+	vector<QPoint> pending_sites;
+
+	/** The latest collected pick. */
+	Hover_target result;
+	/** true if the picked square or figure changed since the last has_changed(). */
+	bool changed;
+
+	/** Sets the flat color encoding id. */
+	void set_id(int handle_id_color, int id);
+	/** Draws object with the position attribute and elements only. */
+	void draw(Mesh_Data* object, QOpenGLBuffer* buf_vertices, const QMatrix4x4& A,
+		int handle_v_vertices, int handle_A);
+	/** Renders the pass for the given mouse coordinates and starts reading back. */
+	void render(float mouse_gl_x, float mouse_gl_y, int viewport_width, int viewport_height,
+		Landscape* landscape, const Render_snapshot* snapshot);
+
+public:
+	/** @return true if and only if the current context supports GPU picking. */
+	static bool is_supported();
+
+	/** Finishes the pending pass, if any, and decodes the pixel into the
+	 * latest pick. Waits for the GPU if it is not done yet. */
+	void collect();
+
+	/** Collects the pending pass. Then renders a new one unless the latest
+	 * pick was made with the given mouse coordinates, the camera of the
+	 * snapshot and its board revision.
+	 * @param int viewport_width, viewport_height: Size of the widget in the
+	 *   units mouse_gl_x and mouse_gl_y were derived from. */
+	void update(float mouse_gl_x, float mouse_gl_y, int viewport_width, int viewport_height,
+		Landscape* landscape, const Render_snapshot* snapshot);
+
+	/** Like Hover_picker::get_target(..). The caller compares with the live
+	 * camera and board revision while holding Game::get_mutex(). Collect
+	 * first in order not to miss a pending pass.
+	 * @return true if and only if board_pos and figure were filled. */
+	bool get_target(float mouse_gl_x, float mouse_gl_y, const QMatrix4x4& camera,
+		uint board_revision, QPoint& board_pos, Figure*& figure);
+
+	/** @return the latest pick. For highlighting only. */
+	const Hover_target& get_latest() { return result; }
+
+	/** @return true if and only if the picked square or figure changed since
+	 *   the last call. */
+	bool has_changed();
+
+	/** Forgets the latest pick and the pending pass. Needed when the game
+	 * changes, since a new board may have the same revision. */
+	void invalidate();
+
+	/** @param QOpenGLFunctions* gl: Functions of the current context.
+	 * @param QOpenGLShaderProgram* program: The linked "pick_id" program. */
+	Gpu_picker(QOpenGLFunctions* gl, QOpenGLShaderProgram* program);
+	~Gpu_picker();
+};
+}
+#endif
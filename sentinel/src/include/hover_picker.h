@@ -0,0 +1,118 @@
+/**
+ * Sentinel Gl -- an OpenGL based remake of the Firebird classic the Sentinel.
+ * Copyright (C) May 25th, 2015 Markus-Hermann Koch, mhk@markuskoch.eu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * Resolves what the mouse is pointing at on a thread of its own. The GUI
+ * thread requests a pick for the latest mouse position whenever the mouse
+ * moves or the view may have changed. The worker locks Game::get_mutex()
+ * and runs Game::get_mouse_target(..) only if the mouse, the camera or the
+ * board revision differ from those of its last result. Thus the action
+ * keys find their target ready and the renderer can highlight it.
+ */
+
+#ifndef MHK_HOVER_PICKER_H
+#define MHK_HOVER_PICKER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <QMatrix4x4>
+#include <QPoint>
+#include "game.h"
+
+namespace game
+{
+/** A pick and everything it depended upon. */
+struct Hover_target
+{
+	/** Mouse coordinates in [-1,1]^2. */
+	float mouse_gl_x;
+	float mouse_gl_y;
+	/** Camera of the player's viewer data at the time of the pick. */
+	QMatrix4x4 camera;
+	/** Game::get_board_revision() at the time of the pick. */
+	uint board_revision;
+	/** As filled by Game::get_mouse_target(..). */
+	QPoint board_pos;
+	Figure* figure;
+	E_POSSIBLE_PLAYER_ACTION action;
+	/** false until the first pick. */
+	bool valid;
+
+	/** @return true if and only if this pick was made under the given circumstances. */
+	bool is_up_to_date(float mouse_gl_x, float mouse_gl_y,
+		const QMatrix4x4& camera, uint board_revision) const;
+
+	Hover_target();
+};
+
+class Hover_picker : public QThread
+{
+private:
+	/** Waiting for the game mutex is given up after this many ms in order
+	 * to look at stop_requested. */
+	static const int LOCK_TIMEOUT_MS = 20;
+
+	Game* game;
+	/** Guards the request and the stop flag. */
+	QMutex request_mutex;
+	QWaitCondition request_posted;
+	float request_x;
+	float request_y;
+	bool request_pending;
+	bool stop_requested;
+	/** Guards result. Only ever taken while holding the game mutex or
+	 * while holding nothing else. */
+	QMutex result_mutex;
+	Hover_target result;
+	/** 1 if result points at something else since the last has_changed(). */
+	QAtomicInt changed;
+
+protected:
+	virtual void run();
+
+public:
+	/** Asks for a pick at the given mouse coordinates in [-1,1]^2.
+	 * Returns at once. Older requests not yet served are dropped. */
+	void request(float mouse_gl_x, float mouse_gl_y);
+
+	/** Fetches the cached pick if it is up to date with the given mouse
+	 * coordinates, the current camera and the current board.
+	 * The caller is required to hold Game::get_mutex().
+	 * @return true if and only if board_pos, figure and action were filled. */
+	bool get_target(float mouse_gl_x, float mouse_gl_y,
+		QPoint& board_pos, Figure*& figure, E_POSSIBLE_PLAYER_ACTION& action);
+
+	/** @return the latest pick, up to date or not. For highlighting only:
+	 *   Its figure is not to be dereferenced without holding Game::get_mutex()
+	 *   and checking the board revision. */
+	Hover_target get_latest();
+
+	/** @return true if and only if the picked square or figure changed since
+	 *   the last call. */
+	bool has_changed();
+
+	/** Ends the worker loop and waits for the thread to finish. */
+	void stop();
+
+	Hover_picker(Game* game, QObject* parent=0);
+	virtual ~Hover_picker();
+};
+}
+#endif
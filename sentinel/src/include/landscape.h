@@ -89,9 +89,80 @@ struct Attack_duration
 	}
 };
 
+class Figure;
+
+/** All figures stacked upon one board square, the base figure first.
+ * Stacks are short. Hence they are held within an inline array rather
+ * than as a linked list, caching the top index, the number of blocks and
+ * the altitude of each figure above the square. Thus getting the top,
+ * the height or iterating over the stack neither allocates nor chases
+ * pointers. The stack is owned by its base figure. */
+class Figure_stack
+{
+private:
+	/** figures[0] is the base figure, figures[top_index] the top of the stack. */
+	Figure* figures[MAX_FIGURE_STACK_HEIGHT];
+	/** altitudes[j] is the distance between the square and the foot of figures[j]. */
+	int altitudes[MAX_FIGURE_STACK_HEIGHT];
+	/** Index of the top figure. -1 for an empty stack. */
+	int top_index;
+	/** Number of blocks in the uninterrupted column starting at the base.
+	 * 0 unless the base is a block. Thus blocks on the tower are not
+	 * counted. */
+	int number_of_blocks;
+
+public:
+	/** @return the number of figures within this stack. */
+	int size() { return top_index+1; }
+	/** @return true if and only if no further figure may be pushed. */
+	bool is_full() { return top_index+1 >= MAX_FIGURE_STACK_HEIGHT; }
+	int get_top_index() { return top_index; }
+	/** @return the top figure. 0 if the stack is empty. */
+	Figure* get_top() { return top_index < 0 ? 0 : figures[top_index]; }
+	int get_number_of_blocks() { return number_of_blocks; }
+	/** @return the j-th figure counting from the base. Throws if out of range. */
+	Figure* at(int j);
+	/** @return the altitude of the j-th figure's foot above the square. */
+	int get_altitude(int j);
+
+	/** Puts the given figure on top of the stack.
+	 * @return the stack index of the new top figure. */
+	int push(Figure* figure);
+	/** Removes the top figure from the stack without deleting it.
+	 * @return said top figure. */
+	Figure* pop();
+	/** Recalculates block count and altitudes. To be called whenever
+	 * a figure within this stack changes its type. */
+	void update_cache();
+
+	Figure_stack();
+};
+
+/** What the scanner needs to know about the stack on one square.
+ * Kept by Figure_index for every square so that classifying a square is
+ * a single small load rather than a walk through figures. */
+struct Square_summary
+{
+	/** Number of figures on the square. 0 if it is empty. The other
+	 * fields are meaningless then. */
+	unsigned char stack_height;
+	/** E_FIGURE_TYPE of the base and the top figure. */
+	unsigned char base_type;
+	unsigned char top_type;
+	/** E_MATTER_STATE of the top figure. */
+	unsigned char top_state;
+	unsigned char number_of_blocks;
+	/** true if and only if a robot stands on top. */
+	bool has_robot;
+};
+
+class Progress_kernel;
+
 /** A game piece detached from its position on the board. */
 class Figure
 {
+	// Writes back phi, direction, fade and state in bulk.
+	friend class Progress_kernel;
 private:
 	/** Mesh_Data pointer for the figure. This figure has no rights
 	 * to do any changes on the mesh! */
@@ -110,6 +181,9 @@ private:
 	float fading_time;
 	/** Phi angle describing the orientation of the object. */
 	float phi;
+	/** Unit vector (cos(phi),sin(phi),0). Cached, since the scanner
+	 * and the antagonists ask for it far more often than phi changes. */
+	QVector3D direction;
 	/** Only relevant for the active robot during the moment it has been
 	 * transfered-to. After all it initially looks into the direction 
 	 * of the point of origin of transfer. */
@@ -122,12 +196,14 @@ private:
 	/** Horizontal field of view for this figure in degrees.
 	 * Determines the limits of possible line of sights at any given this->phi. */
 	float fov;
-	/** Pointer to the figure above this one. 0 if none present.
-	 * Note that this object will delete the figure above during its own destruction. */
-	Figure* figure_above;
-	/** Pointer to the figure below this one. 0 if none present. */
-	Figure* figure_below;
-	
+	/** The stack of the square this figure stands on. Every figure starts
+	 * out as base of a stack of its own. Once it is put upon another figure
+	 * it joins that figure's stack and its own stack is deleted.
+	 * Note that the base figure deletes the figures above during its own destruction. */
+	Figure_stack* stack;
+	/** Position of this figure within this->stack. 0 for base figures. */
+	int stack_index;
+
 	/** false as a rule. Will be set to true if the robot sets this figures
 	 * state to DISINTEGRATING. absorption_triggered_by_robot is used by
 	 * this->get_energy_for_robot(). */
@@ -137,6 +213,12 @@ private:
 	 * Oh yes... for all their weaknesses this is a strength: They can
 	 * attack multiple targets at the same time! */
 	vector<Attack_duration> attacks;
+	/** What the latest scan of this antagonist found. Game spreads the
+	 * scans over several ticks. Hence this may be a few ticks old.
+	 * The targets are attacked each tick nonetheless. */
+	Antagonist_sight sight;
+	/** Ticks since this->sight was scanned. -1 if it never was. */
+	int scan_age;
 
 public:
 	/**
@@ -147,9 +229,22 @@ public:
 	 * vector<QPoint> targets. Adds +1 to each counter that was
 	 * already present, removes counters which's QPoints are missing
 	 * within targets, and initializes new Attack_durations to hitherto
-	 * unknown points.
+	 * unknown points. The reference stays valid until the next call.
+	 * Antagonists that do not fight return an empty vector and keep
+	 * their attacks.
 	 */
-	vector<Attack_duration> mount_attacks(vector<Antagonist_target>& targets);
+	const vector<Attack_duration>& mount_attacks(const vector<Antagonist_target>& targets);
+	/** @return true if and only if this antagonist attacked anything last tick. */
+	bool is_attacking() { return attacks.size() > 0; }
+
+	/** Findings of the latest scan. Filled by Game. */
+	Antagonist_sight& get_sight() { return sight; }
+	/** @return ticks since the latest scan or -1 if there was none. */
+	int get_scan_age() { return scan_age; }
+	/** To be called right after this->get_sight() was filled. */
+	void mark_scanned() { scan_age = 0; }
+	/** To be called once per tick. */
+	void age_scan() { if (scan_age >= 0) scan_age++; }
 	
 	Mesh_Data* get_mesh_prototype() { return mesh; }
 	/** Relevant for transmutating objects. */
@@ -163,18 +258,17 @@ public:
 	float get_fade() { return fade; }
 	float get_fading_time() { return fading_time; }
 	float get_phi() { return phi; }
-	void set_phi(float phi) { this->phi = phi; }
+	void set_phi(float phi);
 	float get_theta() { return theta; }
 	void set_theta(float theta) { this->theta = theta; }
 	float get_fov() { return fov; }
 	float get_spin_period() { return spin_period; }
 	void set_spin_period(float spin_period) { this->spin_period = spin_period; }
 
-	/** Recursive. Will send this figure to the top of the stack.
-	 * Will also make sure that fg->figure_below is properly set.
-	 * Exception: the given pointer is 0. Then this->figure_above=0 and done.
-	 * @param c: is a debugging parameter. Do not set it. */
-	void set_figure_above(Figure* fg, int c=0);
+	/** Will send the given figure to the top of this figure's stack.
+	 * The given figure must be a base figure. Any figures stacked upon it
+	 * will be moved along with it. */
+	void set_figure_above(Figure* fg);
 
 	/** Height of the figure's mesh. Needed for exact visibility calculation. */
 	static float get_mesh_height(E_FIGURE_TYPE);
@@ -206,28 +300,32 @@ public:
 	 * will calculate the eye position in world coordinates. */
 	QVector3D get_eye_position_in_world(QPoint pos, int altitude_base);
 	
+	/** @return the bounds of this figure's mesh in world coordinates if the
+	 *   figure stands on the given square with its foot at the given
+	 *   altitude, turned by phi and drawn with the given scale. */
+	Mesh_bounds get_world_bounds(QPoint pos, float altitude, float scale=1.);
+
 	/** Direction of view depending on phi. */
-	QVector3D get_direction();
+	QVector3D get_direction() { return direction; }
 	
-	/** Starting at and including this Figure all figures within this stack
-	 * keeping their order. Hence the last figure will be on top. */
-	vector<Figure*> get_above_figure_stack();
+	/** @return the stack this figure is part of. Iterate over it from
+	 * this->get_stack_index() upwards for the figures from here on up. */
+	Figure_stack* get_stack() { return stack; }
+
+	/** @return the position of this figure within its stack. 0 for the base. */
+	int get_stack_index() { return stack_index; }
 
-	/** Starting below and excluding this Figure all figures within this stack
-	 * keeping their order. Hence the last figure will be at the bottom. */
-	vector<Figure*> get_below_figure_stack();
-	
 	/** Convenience function.
-	 * @return the last element of get_above_figure_stack(). */
+	 * @return the top figure of this figure's stack. */
 	Figure* get_top_figure();
 
 	/** @return the pointer to the figure above this one.
 	 * Should be 0 if there is none. */
-	Figure* get_above_figure() { return figure_above; }
+	Figure* get_above_figure();
 
 	/** @return the pointer to the figure below this one.
 	 * Should be 0 if there is none. */
-	Figure* get_below_figure() { return figure_below; }
+	Figure* get_below_figure();
 
 	/** How far is it from the base of this object to the actual square? 
 	 * e.g.: This distance is always 2 for The Sentinel since he always
@@ -235,26 +333,6 @@ public:
 	 * each other stackable item. */
 	int get_altitude_above_square();
 	
-	/** Progresses this->phi and this->fade with respect to the given dt.
-	 * @param float dt: Delta t in seconds since the last evaluation.
-	 * @param E_ANTAGONIST_ACTION action: A forward moving figure simply does
-	 *   this according to its self_spin value. A backward moving figure
-	 *   does the same in the other direction. This will happen, if the
-	 *   antagonist sees an object he wants to absorb, but sees it such
-	 *   that turning 'forward' would move the target further out of central
-	 *   focus. The antagonist then should turn backward until he is fully
-	 *   facing the object he is interacting with.
-	 *   Lastly, a still figure is fully focused on something and does not
-	 *   move at all.
-	 * @return true if and only if the progress made would warrant a
-	 *   repaint of the openGL scene if the Figure were within the viewport.
-	 * Note: This function also exercises the power to update matter state.
-	 * I.e.: If fading progresses to 0 the state will be set to GONE.
-	 * If fading progresses to 1 the state will be set to STABLE. 
-	 */
-	bool progress(float dt, E_ANTAGONIST_ACTION action=E_ANTAGONIST_ACTION::STILL);
-
-
 	/** @return energy value for this type as stated in game rules. */
 	static int get_energy_value(E_FIGURE_TYPE type);
 
@@ -262,12 +340,12 @@ public:
 	 *   Figure's energy value. This method is used to determine how 
 	 *  much energy the robot receives upon a Figure's destruction. 
 	 *  calls get_energy_value(..).
-	 *  Used by Game::remove_goners_from_board(). */
+	 *  Used by Game::progress_transitions(). */
 	int get_energy_for_robot();
 	
 	/** Looks at the top of this figure's stack and deletes it. 
 	 * Exception: This function does _not_ have this figure commit suicide.
-	 * If above_figure == 0 nothing will happen.
+	 * If this figure is the top of its stack nothing will happen.
 	 *   @param bool only_if_GONE: Do this deletion action only if the
 	 *     top of the stack figure is of status GONE.
 	 * @return 0 if !absorption_triggered_by_robot. Else it returns this
@@ -281,14 +359,68 @@ public:
 	Figure(E_FIGURE_TYPE type, E_MATTER_STATE state, Mesh_Data* mesh,
 		float phi, float theta, float spin_period, float fov, float fading_time);
 	/** Copy constructor. Makes an independent copy in all but one aspect:
-	 * the figure_below will be set to 0 for security reasons. 
+	 * the copy will be the base of a new stack for security reasons.
 	 * The stack above, however, will be copied analogously.
 	 */
 	Figure(const Figure& original);
-	/** The destructor deletes the figure_above. Does nothing to the figure below. */
+	/** The destructor deletes the figures above. Does nothing to the figures below.
+	 * A base figure also deletes its stack. */
 	~Figure();
 };
 
+/** Batched per-frame update of antagonist rotation and figure fading.
+ * The figures to be progressed are gathered into contiguous arrays
+ * (structure of arrays), advanced in tight branch-free loops and written
+ * back. The arrays are kept between frames so that after warm up no
+ * allocation takes place. */
+class Progress_kernel
+{
+private:
+	//> Rotation batch. ----------------------------------------------
+	vector<Figure*> rotating;
+	vector<float> phi;
+	/** Signed angle speed in degrees per second. 0 for still figures. */
+	vector<float> omega;
+	vector<float> direction_x;
+	vector<float> direction_y;
+	//< --------------------------------------------------------------
+	//> Fading batch. ------------------------------------------------
+	vector<Figure*> fading;
+	vector<float> fade;
+	/** Signed fade per second. Positive for manifesting and transmuting figures. */
+	vector<float> fade_rate;
+	//< --------------------------------------------------------------
+
+public:
+	/** Enqueues a figure for rotation by this->progress_rotations().
+	 * @param E_ANTAGONIST_ACTION action: A forward moving figure simply turns
+	 *   according to its spin period. A backward moving figure
+	 *   does the same in the other direction. This will happen, if the
+	 *   antagonist sees an object he wants to absorb, but sees it such
+	 *   that turning 'forward' would move the target further out of central
+	 *   focus. The antagonist then should turn backward until he is fully
+	 *   facing the object he is interacting with.
+	 *   Lastly, a still figure is fully focused on something and does not
+	 *   move at all. Neither do figures that are GONE.
+	 * @return true if and only if the figure is going to turn, thus warranting
+	 *   a repaint of the openGL scene if the Figure were within the viewport. */
+	bool add_rotation(Figure* figure, E_ANTAGONIST_ACTION action);
+	/** Advances phi and direction of all enqueued figures by dt seconds,
+	 * writes them back and empties the rotation batch. */
+	void progress_rotations(float dt);
+
+	/** Enqueues a figure for fading by this->progress_fades(). Only figures
+	 * that are MANIFESTING, DISINTEGRATING or TRANSMUTING have anything to do.
+	 * @return true if and only if the figure has been enqueued. */
+	bool add_fade(Figure* figure);
+	/** Advances the fade of all enqueued figures by dt seconds, writes them
+	 * back and empties the fading batch.
+	 * Note: This function also exercises the power to update matter state.
+	 * I.e.: If fading progresses to 0 the state will be set to GONE.
+	 * If fading progresses to 1 the state will be set to STABLE. */
+	void progress_fades(float dt);
+};
+
 class Square
 {
 private:
@@ -304,6 +436,10 @@ private:
 	 * to modify the Mesh_Data object. It is entitled to its own QOpenGLBuffer though. */
 	Mesh_Data* mesh_prototype;
 
+	/** Recomputes this->bounds from this->vertices. Called whenever the
+	 * latter change, i.e. during landscape generation only. */
+	void update_bounds();
+
 public:
 	Mesh_Data* get_mesh_prototype() { return mesh_prototype; }
 
@@ -322,6 +458,10 @@ public:
 	 */
 	vector<Vertex_Data> vertices;
 	
+	/** Bounds of this->vertices. Board squares never move, so renderer and
+	 * picker may use them each frame instead of visiting the corners. */
+	Mesh_bounds bounds;
+	
 	/** Buffer for the corner vertices this->vertices on the GPU. */
 	QOpenGLBuffer buf_vertices;
 	
@@ -612,6 +752,18 @@ private:
 	
 	/** Step 9: Send Squares to GPU. */
 	void send_board_sq_to_GPU();
+
+	/** altitude_pyramid[0] holds the altitude of each square, row major.
+	 * Each cell of level k+1 holds the maximum of the up to 2x2 cells of
+	 * level k beneath it. I.e. level k cell (x,y) is the maximum altitude
+	 * of the squares [x*2^k,(x+1)*2^k) x [y*2^k,(y+1)*2^k). */
+	vector<vector<int> > altitude_pyramid;
+	/** Widths and heights of the pyramid levels. */
+	vector<int> pyramid_widths;
+	vector<int> pyramid_heights;
+
+	/** Step 10: Build the max-altitude pyramid from the finished terrain. */
+	void build_altitude_pyramid();
 	 
 	/** Intended to be called only once by the constructor. Generates the landscape.
 	 * For details see ':/resources/doc/plan.txt'. */
@@ -660,6 +812,15 @@ public:
 	 *   is a CONNECTION not having a fixed altitude or -2 if x,y point
 	 *   beyond the board or the Square* in question is 0. */
 	int get_altitude(int x, int y);
+
+	/** @return an upper bound of the altitudes of all squares within
+	 *   [x0,x1] x [y0,y1]. This is answered from a single pyramid level
+	 *   by looking at no more than four cells. Hence it is cheap but may
+	 *   include a few squares around the rectangle. Requires the rectangle
+	 *   to be within the board and x0<=x1, y0<=y1. */
+	int get_max_altitude(int x0, int y0, int x1, int y1);
+	/** @return the altitudes of all squares, row major. */
+	const int* get_altitudes() { return &altitude_pyramid[0][0]; }
 	
 	/**
 	 * Initializes this object and calls this->generate_landscape().
@@ -0,0 +1,101 @@
+/**
+ * Sentinel Gl -- an OpenGL based remake of the Firebird classic the Sentinel.
+ * Copyright (C) May 25th, 2015 Markus-Hermann Koch, mhk@markuskoch.eu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * Batched line of sight tests. All lines of sight of one batch start at the
+ * same eye. Each line is walked in blocks of LINE_OF_SIGHT_BLOCK_STEPS
+ * steps. A block high above the terrain is skipped by a single lookup in
+ * the max-altitude pyramid of the Landscape. Only the others are walked
+ * step by step. On CPUs with AVX2 eight lines are walked at once, one per
+ * SIMD lane, gathering the altitudes of their squares in one go. Lanes
+ * whose block is clear rest meanwhile. Elsewhere a scalar kernel does the
+ * same one line at a time. The caller selects the kernel. Usually that
+ * is get_line_of_sight_kernel().
+ */
+
+#ifndef MHK_LINE_OF_SIGHT_H
+#define MHK_LINE_OF_SIGHT_H
+
+#include <vector>
+#include <string>
+#include <QPoint>
+#include <QVector3D>
+
+using std::vector;
+using std::string;
+
+namespace game
+{
+class Landscape;
+
+enum E_LOS_KERNEL { SCALAR, AVX2 };
+
+/** Lines of sight from one eye in structure of arrays layout. */
+class Line_of_sight_batch
+{
+public:
+	/** Per line: The target square. */
+	vector<int> target_x;
+	vector<int> target_y;
+	/** Per line: Step j of the walk is at eye + j*step. */
+	vector<float> step_x;
+	vector<float> step_y;
+	vector<float> step_z;
+	/** Per line: Number of steps. The walk visits steps 1..steps-1. */
+	vector<int> steps;
+	/** Per line: Filled by trace_lines_of_sight(..). 1 if the line is free. */
+	vector<unsigned char> visible;
+
+	int size() { return (int)steps.size(); }
+	/** Keeps the capacity. */
+	void clear();
+	/** Adds the line from eye to the given altitude above the center
+	 * of target_sq walked in the given number of steps.
+	 * @return the index of the new line. */
+	int add(QVector3D eye, QPoint target_sq, float alt_target, int steps);
+};
+
+/** Lines of sight are walked in at least this many steps. */
+const int MIN_LINE_OF_SIGHT_STEPS = 100;
+/** Steps per block checked against the max-altitude pyramid at once.
+ * About eight squares as there are two steps per square. */
+const int LINE_OF_SIGHT_BLOCK_STEPS = 16;
+/** @return the number of steps a line of sight from eye to target is
+ *   walked in. Enough for two steps per square crossed. */
+int get_line_of_sight_steps(QVector3D eye, QPoint target_sq);
+
+/** Walks all lines of the batch and fills batch.visible. A line is free if
+ * it reaches the target square or leaves the board before it runs into a
+ * square that is not strictly below it. All kernels agree on that.
+ * @param E_LOS_KERNEL kernel: Required to be supported by this CPU. */
+void trace_lines_of_sight(QVector3D eye, Landscape* landscape,
+	Line_of_sight_batch& batch, E_LOS_KERNEL kernel);
+
+/** @return the fastest kernel this CPU supports. Determined once. */
+E_LOS_KERNEL get_line_of_sight_kernel();
+/** @return true if and only if this CPU can run the given kernel. */
+bool is_line_of_sight_kernel_supported(E_LOS_KERNEL kernel);
+const char* get_line_of_sight_kernel_name(E_LOS_KERNEL kernel);
+
+/** Microbenchmark. Traces the given number of random lines of sight across
+ * the given terrain with each supported kernel. Batches hold 64 lines from
+ * one eye like the candidates of an antagonist would. Does not touch qrand().
+ * @return the throughput of each kernel in rays per second as text. */
+string benchmark_lines_of_sight(Landscape* landscape, int lines);
+}
+#endif
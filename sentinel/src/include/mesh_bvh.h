@@ -0,0 +1,91 @@
+/**
+ * Sentinel Gl -- an OpenGL based remake of the Firebird classic the Sentinel.
+ * Copyright (C) May 25th, 2015 Markus-Hermann Koch, mhk@markuskoch.eu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * Bounding volume hierarchy over the triangles of one mesh in model
+ * coordinates. Built once when the mesh is loaded. Answers whether a
+ * ray segment hits the mesh, descending only into the axis aligned boxes
+ * the ray passes. Thus picking a figure costs a handful of box tests and a
+ * few triangles instead of projecting all of its vertices. Rays are best
+ * rejected against the Mesh_bounds of the mesh before asking.
+ */
+
+#ifndef MHK_MESH_BVH_H
+#define MHK_MESH_BVH_H
+
+#include <vector>
+#include <QOpenGLFunctions>
+#include <QVector3D>
+
+using std::vector;
+
+namespace display
+{
+class Mesh_bvh
+{
+private:
+	/** Leaves hold at most this many triangles. */
+	static const int LEAF_SIZE = 4;
+
+	struct Node
+	{
+		/** Axis aligned bounding box. */
+		QVector3D lo;
+		QVector3D hi;
+		/** Leaf: Index of the first triangle. Else: Index of the left child.
+		 * The right child follows it. */
+		int first;
+		/** Leaf: Number of triangles. 0 for inner nodes. */
+		int count;
+	};
+
+	/** nodes[0] is the root. Empty if there are no triangles. */
+	vector<Node> nodes;
+	/** Three corners per triangle ordered such that each leaf's triangles
+	 * are consecutive. */
+	vector<QVector3D> corners;
+
+	/** Builds the subtree of the triangles order[first..first+count-1]
+	 * into nodes[index]. Reorders that section of order. */
+	void build_node(int index, vector<int>& order, int first, int count,
+		const vector<QVector3D>& centroids, const vector<QVector3D>& tri_corners);
+
+	/** Slab test. @return true if and only if origin+t*dir hits the box
+	 *   for some t in [0,t_max]. */
+	static bool intersects_box(const QVector3D& lo, const QVector3D& hi,
+		const QVector3D& origin, const QVector3D& inv_dir, float t_max);
+
+	/** Moeller-Trumbore, both sides. @return true if and only if
+	 *   origin+t*dir hits the triangle abc for some t in [0,t_max]. */
+	static bool intersects_triangle(const QVector3D& a, const QVector3D& b,
+		const QVector3D& c, const QVector3D& origin, const QVector3D& dir, float t_max);
+
+public:
+	/** (Re)builds the hierarchy.
+	 * @param vector<QVector3D>& positions: Vertex positions in model coordinates.
+	 * @param vector<GLushort>& elements: Three per triangle. */
+	void build(const vector<QVector3D>& positions, const vector<GLushort>& elements);
+
+	bool is_empty() const { return nodes.empty(); }
+
+	/** @return true if and only if origin+t*dir hits a triangle of the
+	 *   mesh for some t in [0,t_max]. All in model coordinates. */
+	bool intersects(const QVector3D& origin, const QVector3D& dir, float t_max) const;
+};
+}
+#endif
@@ -0,0 +1,158 @@
+/**
+ * Sentinel Gl -- an OpenGL based remake of the Firebird classic the Sentinel.
+ * Copyright (C) May 25th, 2015 Markus-Hermann Koch, mhk@markuskoch.eu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * Scoped timing zones. Put a Timing_zone on the stack at the beginning of
+ * a block and the time until the end of that block will be recorded.
+ * The Profiler keeps the last few hundred durations of each zone for
+ * rolling percentiles (shown by the 'I' key overlay) and a ring buffer
+ * of the latest events that can be exported in the Chrome trace event
+ * format (open it with chrome://tracing).
+ *
+ * Recording costs two clock reads and an uncontended mutex. Hence it
+ * stays compiled in and switched on.
+ *
+ * Built with COUNT_ALLOCATIONS (see CMakeLists.txt) the global operator new
+ * counts the heap allocations of each thread. Each zone then also records
+ * the number of allocations and bytes made while it was open. The goal is
+ * zero for a steady-state do_progress() tick. The test target
+ * test_tick_allocations checks that it is.
+ */
+
+#ifndef MHK_PROFILER_H
+#define MHK_PROFILER_H
+
+#include <vector>
+#include <string>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QThread>
+
+using std::vector;
+using std::string;
+
+namespace mhk_gl
+{
+/** Heap allocations made by one thread. */
+struct Allocation_count
+{
+	qint64 count;
+	qint64 bytes;
+};
+
+/** @return the heap allocations the calling thread has made so far.
+ *   Always 0 unless built with MHK_COUNT_ALLOCATIONS. */
+Allocation_count get_thread_allocations();
+
+enum E_TIMING_ZONE { UPDATE_AFTER_DT, PLAYER_ROTATION, DO_PROGRESS,
+	ANTAGONIST_SCAN, ANTAGONIST_ATTACK, TRANSITIONS, PAINT_GL, DRAW_LANDSCAPE,
+	MOUSE_TARGET, SUBMIT_DRAWS, NUMBER_OF_TIMING_ZONES };
+
+class Profiler
+{
+private:
+	/** Number of durations per zone the percentiles are calculated from. */
+	static const int HISTORY_SIZE = 256;
+	/** Number of events kept for the trace export. */
+	static const int TRACE_SIZE = 65536;
+
+	struct Trace_event
+	{
+		E_TIMING_ZONE zone;
+		int thread;
+		/** In ns since the profiler was created. */
+		qint64 start;
+		qint64 duration;
+		qint64 allocations;
+		qint64 allocated_bytes;
+	};
+
+	QMutex mutex;
+	QElapsedTimer clock;
+	/** Ring buffers of the latest durations in ns, one per zone. */
+	qint64 history[NUMBER_OF_TIMING_ZONES][HISTORY_SIZE];
+	/** Allocations and allocated bytes along with history. */
+	qint64 history_allocations[NUMBER_OF_TIMING_ZONES][HISTORY_SIZE];
+	qint64 history_bytes[NUMBER_OF_TIMING_ZONES][HISTORY_SIZE];
+	int history_next[NUMBER_OF_TIMING_ZONES];
+	int history_count[NUMBER_OF_TIMING_ZONES];
+	/** Ring buffer of the latest events. */
+	vector<Trace_event> trace;
+	int trace_next;
+	int trace_count;
+	/** Threads seen so far. Their index is the trace's thread id. */
+	vector<Qt::HANDLE> threads;
+
+	Profiler();
+
+public:
+	/** @return the one profiler of this process. */
+	static Profiler* get_instance();
+	static const char* get_zone_name(E_TIMING_ZONE zone);
+	/** @return true if and only if allocations are being counted. */
+	static bool counts_allocations();
+
+	/** @return ns since the profiler was created. */
+	qint64 now() { return clock.nsecsElapsed(); }
+	/** Adds an event. Thread safe.
+	 * @param Allocation_count allocations: Made during the event. */
+	void record(E_TIMING_ZONE zone, qint64 start, qint64 end,
+		Allocation_count allocations);
+
+	/** @param float p: In [0,1]. E.g. 0.99 for the 99th percentile.
+	 * @return the p-th percentile of the recent durations of the zone in ms.
+	 *   0 if nothing was recorded yet. */
+	float get_percentile(E_TIMING_ZONE zone, float p);
+	/** @return the mean allocations per event over the recent events of the zone.
+	 *   bytes will be filled with the mean allocated bytes per event. */
+	float get_mean_allocations(E_TIMING_ZONE zone, float& bytes);
+	/** @return one line of text per zone holding its p50, p90, and p99.
+	 *   Followed by the mean allocations if these are counted. */
+	vector<string> get_summary();
+
+	/** Writes the recorded events as Chrome trace event JSON.
+	 * @return true if and only if the file could be written. */
+	bool export_chrome_trace(string pfname);
+};
+
+/** Records the time between its construction and its destruction. */
+class Timing_zone
+{
+private:
+	E_TIMING_ZONE zone;
+	qint64 start;
+	Allocation_count allocations_at_start;
+public:
+	Timing_zone(E_TIMING_ZONE zone)
+	{
+		this->zone = zone;
+		this->start = Profiler::get_instance()->now();
+		this->allocations_at_start = get_thread_allocations();
+	}
+	~Timing_zone()
+	{
+		Profiler* profiler = Profiler::get_instance();
+		qint64 end = profiler->now();
+		Allocation_count allocations = get_thread_allocations();
+		allocations.count -= allocations_at_start.count;
+		allocations.bytes -= allocations_at_start.bytes;
+		profiler->record(zone, start, end, allocations);
+	}
+};
+}
+#endif
@@ -0,0 +1,180 @@
+/**
+ * Sentinel Gl -- an OpenGL based remake of the Firebird classic the Sentinel.
+ * Copyright (C) May 25th, 2015 Markus-Hermann Koch, mhk@markuskoch.eu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * The draw calls of one frame. The renderer first adds a Render_command
+ * for the dome, each square and each figure. Then sort() orders them by
+ * pass. The background pass (the dome) comes first in the order it was
+ * added. The opaque pass follows, sorted by program, texture, mesh and
+ * vertex buffer, with blending disabled. Last comes the transparent pass
+ * of everything with fade < 1, sorted back to front, blended and without
+ * writing depth. Finally submit() walks them and only binds what differs
+ * from the previous command.
+ *
+ * The shaders are GLSL 120, which knows no uniform blocks. Instead the
+ * per frame constants (light position, color and ambience) are uploaded
+ * to each program once per frame, when it is first bound. Uniform values
+ * stay with their program object. Per draw only the transformation goes
+ * up, plus color_light and fade whenever they differ from what the
+ * program last got.
+ *
+ * Commands are kept between frames. Hence a steady frame allocates
+ * nothing.
+ */
+
+#ifndef MHK_RENDER_QUEUE_H
+#define MHK_RENDER_QUEUE_H
+
+#include <vector>
+#include <QOpenGLFunctions>
+#include <QOpenGLBuffer>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+#include <QMatrix4x4>
+#include "data_structures.h"
+
+using std::vector;
+
+namespace display
+{
+enum E_RENDER_PASS { BACKGROUND_PASS, OPAQUE_PASS, TRANSPARENT_PASS };
+
+/** One glDrawElements(..) and the state it needs. */
+struct Render_command
+{
+	Mesh_Data* mesh;
+	QOpenGLShaderProgram* program;
+	/** May be 0. */
+	QOpenGLTexture* texture;
+	/** The mesh's own buffer or one in world coordinates like a square's. */
+	QOpenGLBuffer* buf_vertices;
+	/** Model to world. The camera is applied by submit(). */
+	QMatrix4x4 transformation;
+	float fade;
+	/** Factor for the light color. */
+	float highlight;
+	E_RENDER_PASS pass;
+	/** World position the transparent pass is ordered by. */
+	QVector3D center;
+	/** Distance of center along the view. Set by sort(..). */
+	float depth;
+};
+
+/** Lighting shared by all commands of a frame. */
+struct Render_lighting
+{
+	QVector3D position;
+	/** Already multiplied by brightness and filtering factor. */
+	QVector4D color;
+	float ambience;
+};
+
+/** State changes made by the last submit(). */
+struct Render_queue_stats
+{
+	int draws;
+	/** Draws with blending enabled. */
+	int blended;
+	int programs;
+	int textures;
+	int vertex_buffers;
+	/** glUniform* calls. */
+	int uniforms;
+};
+
+class Render_queue
+{
+private:
+	vector<Render_command> commands;
+	/** Indices into commands in the order of submission. */
+	vector<int> order;
+	Render_queue_stats stats;
+	/** Counts the calls to submit(..). */
+	uint frame;
+
+	/** Locations within a program and the values last uploaded to it. */
+	struct Program_state
+	{
+		QOpenGLShaderProgram* program;
+		int handle_v_vertices;
+		int handle_v_normals;
+		int handle_v_tex_coords;
+		int handle_v_vertex_colors;
+		int handle_pos_light;
+		int handle_color_light;
+		int handle_ambience;
+		int handle_fade;
+		int handle_A;
+		int handle_B;
+		/** Value of Render_queue::frame when the lighting was uploaded. */
+		uint lighting_frame;
+		/** Factor color_light was last uploaded with. */
+		float highlight;
+		float fade;
+	};
+	/** One per program ever submitted. Programs are expected to live as
+	 * long as the queue. There are only a handful. */
+	vector<Program_state> program_states;
+
+	/** Finds the state of the given bound program. Looks its locations
+	 * up by name the first time the program is seen. */
+	Program_state* get_program_state(QOpenGLShaderProgram* program);
+
+	/** Orders the opaque pass by state and the transparent pass by depth. */
+	struct State_less
+	{
+		const vector<Render_command>* commands;
+		bool operator()(int a, int b) const;
+	};
+
+public:
+	/** Forgets all commands. Keeps the capacity. */
+	void clear();
+
+	/** Adds a command. Its pass is TRANSPARENT_PASS if and only if fade < 1.
+	 * @param QVector3D center: Roughly the middle of the object in world
+	 *   coordinates. Orders the transparent pass.
+	 * @param QOpenGLBuffer* buf_vertices: 0 for the one of the mesh. */
+	void add(Mesh_Data* mesh, QOpenGLShaderProgram* program,
+		const QMatrix4x4& transformation, float fade, QVector3D center,
+		QOpenGLBuffer* buf_vertices=0, float highlight=1.);
+
+	/** Adds a command to the BACKGROUND_PASS. It is blended only if fade < 1. */
+	void add_background(Mesh_Data* mesh, QOpenGLShaderProgram* program,
+		const QMatrix4x4& transformation, float fade);
+
+	/** Sorts the commands. Call after the last add(..).
+	 * @param QMatrix4x4& camera: perspective*lookAt. Yields the depths. */
+	void sort(const QMatrix4x4& camera);
+
+	/** Draws all commands in their sorted order. Leaves blending enabled
+	 * and depth writes on. Programs may use any of the
+	 * attributes v_vertices, v_normals, v_tex_coords and v_vertex_colors
+	 * (v_colors for the sky) and any of the uniforms A, B, pos_light,
+	 * color_light, ambience and fade. Missing ones are skipped.
+	 * @param QMatrix4x4& camera: perspective*lookAt. */
+	void submit(QOpenGLFunctions* gl, const QMatrix4x4& camera,
+		const Render_lighting& lighting);
+
+	int size() { return (int)commands.size(); }
+	const Render_queue_stats& get_stats() { return stats; }
+
+	Render_queue();
+};
+}
+#endif
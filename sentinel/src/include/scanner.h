@@ -32,15 +32,16 @@
 #define MHK_SCANNER_H
 
 #include <vector>
-#include <map>
 #include <QVector3D>
 #include <QMatrix4x4>
 #include "data_structures.h"
 #include "landscape.h"
 #include "io_qt.h"
+#include "frame_arena.h"
+#include "line_of_sight.h"
+#include "vec_math.h"
 
 using std::vector;
-using std::multimap;
 
 using namespace display;
 
@@ -98,51 +99,88 @@ private:
 	static bool is_in_triangle(float mouse_gl_x, float mouse_gl_y,
 		QVector4D a, QVector4D b, QVector4D c);
 
-	/**
-	 * @param Figure* figure: Pointer to the target figure. Contains
-	 *   the phi angle required to build the complete transformation.
-	 * @param QPoint board_pos: (x,y) board coordinates of said figure.
-	 * @param int altitude_square: Altitude of the board square the figure
-	 *   stands on.
-	 * @param QMatrix4x4& camera: Camera transformation from Viewer_Data.
-	 * @return the complete transformation
-	 *   A := perspective * lookAt * translation * rotation
-	 * for the given figure. I.e.: The mapping of the prototype vertecies
-	 * into the final to-display-[-1,+1]^3 openGL cube.
-	 * Note that no similar function for Squares is needed since these
-	 * are stored in world coordinates already! Hence for them camera suffices.
-	 */
-	QMatrix4x4 get_complete_transformation_for_figure(Figure* figure,
-		QPoint board_pos, int altitude_square, const QMatrix4x4& camera);
+	/** Unprojects the mouse through the inverse camera.
+	 * @param QMatrix4x4& camera_inverse: See Viewer_Data::get_camera_inverse().
+	 * @param QVector3D& origin: Will be filled with the point under the mouse
+	 *   on the near plane in world coordinates.
+	 * @param QVector3D& direction: Will be filled such that origin+direction
+	 *   is the point under the mouse on the far plane. */
+	static void get_mouse_ray(float mouse_gl_x, float mouse_gl_y,
+		const QMatrix4x4& camera_inverse, QVector3D& origin, QVector3D& direction);
 
-	/** Checks whether or not the given figure may be found under the
-	 * given mouse coordinates ignoring line of sight obstructions.
-	 * @param float mouse_gl_x, mouse_gl_y: Mouse coordinates in [-1,1]^2.
-	 * @param Figure* figure: Target figure to be analyzed for mouse contact.
-	 * @param QMatrix4x4& complete_transformation: As returned by
-	 *   this->get_complete_transformation_for_figure(); i.e. the comprehensive
-	 *   matrix that transforms the prototype vertices of the given figures into
-	 *   the final [-1,1]^3 openGL cube.
-	 * @return true if and only if the target figure may be found under the mouse. */
-	bool is_figure_under_xray_mouse(float mouse_gl_x, float mouse_gl_y,
-		Figure* figure, const QMatrix4x4& complete_transformation);
+	/** Checks whether or not the mouse ray hits the given figure ignoring
+	 * line of sight obstructions. Rays missing the world bounds of the
+	 * figure are rejected right away. Others are moved into the model
+	 * coordinates of the figure and tested against the bounding volume
+	 * hierarchy of its mesh.
+	 * @param QPoint board_pos: (x,y) board coordinates of said figure.
+	 * @param float altitude: Altitude of the foot of the figure.
+	 * @param QVector3D origin, direction: As given by get_mouse_ray(..).
+	 * @return true if and only if the segment origin + t*direction,
+	 *   t in [0,1], hits the figure. */
+	static bool is_figure_hit_by_ray(Figure* figure, QPoint board_pos, float altitude,
+		QVector3D origin, QVector3D direction);
 
 	/**
 	 * @param float mouse_gl_x, mouse_gl_y: Mouse coordinates in [-1,1]^2.
 	 * @param Square* square: Square object pointer.
-	 * @param QMatrix4x4& camera: Camera transformation mapping the world-
+	 * @param Mat4& camera: Camera transformation mapping the world-
 	 *   coordinate vertices of the square into the [-1,1]^3 openGL cube.
 	 * @return true if and only if the mouse is over the given square.
 	 *   Note: This function does _not_ consider line of sight obstruction.
 	 *   It also does _not_ consider whether or not the square is viewed
 	 *   from above or below. */
 	bool is_square_under_xray_mouse(float mouse_gl_x, float mouse_gl_y,
-		Square* square, const QMatrix4x4& camera);
+		Square* square, const Mat4& camera);
 
-public: // Public for the benefit of Game::antagonist_attack()
-	/** Turns the given multimap into an ordered vector. */
-	vector<QPoint> convert_ordered_multimap_to_vector(multimap<float,QPoint>&);
+	/** Scratch entry of get_all_board_positions_in_h_fov(..). */
+	struct Scan_entry
+	{
+		/** Squared distance from the eye. */
+		float dist;
+		/** Order of discovery. Breaks ties between equal distances. */
+		int order;
+		QPoint pos;
+		bool operator<(const Scan_entry& other) const
+			{ return dist < other.dist || (dist == other.dist && order < other.order); }
+	};
+	/** Scratch buffers of get_all_board_positions_in_h_fov(..). They keep their
+	 * capacity from scan to scan. Hence a scan does not allocate once they
+	 * have grown large enough. */
+	vector<Scan_entry> scan_entries;
+	/** One stamp per square. A square has been seen by the running scan
+	 * if and only if its stamp equals scan_generation. */
+	vector<int> scan_stamps;
+	int scan_generation;
+	/** Scratch buffer of get_antagonist_targets(..) and get_mouse_target(..). */
+	vector<QPoint> view;
+
+	/** Scratch entry of get_antagonist_targets(..). A square holding
+	 * something the antagonist might see. */
+	struct Sight_candidate
+	{
+		QPoint site;
+		float alt_square;
+		float alt_feet;
+		float alt_body;
+		bool tree_on_top;
+		bool is_target;
+		E_VISIBILITY vis;
+	};
+	/** Scratch buffers of get_antagonist_targets(..). */
+	vector<Sight_candidate> sight_candidates;
+	Line_of_sight_batch los_batch;
+	/** Walks los_batch. The fastest one of this CPU. */
+	E_LOS_KERNEL los_kernel;
+	/** Per line of los_batch: Index of its Sight_candidate. */
+	vector<int> los_owners;
 
+	/** Temporaries of a single scan. Reset by reset_arena(). */
+	Frame_arena arena;
+	typedef vector<QPoint, Arena_allocator<QPoint> > Arena_points;
+	typedef vector<QPoint_Figure, Arena_allocator<QPoint_Figure> > Arena_figures;
+
+public: // Public for the benefit of Game::antagonist_attack()
 	/** The big brother of get_all_board_positions_in_line(..) for
 	 * an open horizontal field of view. For instance needed for the
 	 * antagonist's field of view.
@@ -150,18 +188,19 @@ public: // Public for the benefit of Game::antagonist_attack()
 	 *   @param QVector3D direction: View direction in world coordinates.
 	 *     Players may retrieve it using this->get_mouse_direction(..).
 	 *   @param float h_fov: The horizontal field of view in degrees >=0.
-	 * @return a multimap<float,QPoint> where the keys are squared distances from
-	 *   the eye position and the values are board coordinates of the
-	 *   pertinent squares. The square of the eye itself will _not_ be included.
-	 *   There is no game situation when any agent acts on his on square. */
-	multimap<float,QPoint> get_all_board_positions_in_h_fov(
-		QVector3D eye, QVector3D direction, float h_fov, int width, int height);
+	 *   @param vector<QPoint>& res: Will be cleared and filled with the board
+	 *     coordinates of the pertinent squares ordered by their distance from
+	 *     the eye. The square of the eye itself will _not_ be included.
+	 *     There is no game situation when any agent acts on his on square.
+	 *     Passing the same vector again and again saves the allocations. */
+	void get_all_board_positions_in_h_fov(QVector3D eye, QVector3D direction,
+		float h_fov, int width, int height, vector<QPoint>& res);
 
 private:
 	/** Convenience shortcut for player h_fov. */
-	multimap<float,QPoint> get_all_board_positions_in_h_fov(
+	void get_all_board_positions_in_h_fov(
 		float mouse_gl_x, float mouse_gl_y, Viewer_Data* viewer_data,
-		float h_fov, int width, int height);
+		float h_fov, int width, int height, vector<QPoint>& res);
 	
 	/**
 	 * @param float mouse_gl_x, mouse_gl_y: Mouse coordinates in [-1,1]^2.
@@ -177,8 +216,8 @@ private:
 	 * @return a shorter version of candidates that only holds those board
 	 *   positions as are returned as true by is_square_under_xray_mouse(..).
 	 */
-	vector<QPoint> restrict_to_squares_under_xray_mouse(float mouse_gl_x,
-		float mouse_gl_y, vector<QPoint> candidates, Landscape* landscape,
+	Arena_points restrict_to_squares_under_xray_mouse(float mouse_gl_x,
+		float mouse_gl_y, const vector<QPoint>& candidates, Landscape* landscape,
 		const QMatrix4x4& camera, bool stop_after_first=true);
 	
 	/**
@@ -219,17 +258,16 @@ private:
 	 * Note again: FOR PRACTICAL USE-CASE REASONS THIS FUNCTION ONLY RETURNS
 	 * STABLE Figure*s. For only these can be interacted with.
 	 */
-	vector<QPoint_Figure> get_all_stable_figures_in_line(
+	Arena_figures get_all_stable_figures_in_line(
 		QPoint board_pos_under_mouse,
 		vector<QPoint>& board_positions_in_line, Board<Figure>* board_fg);
 	
 	/**
-	 * @param float mouse_gl_x, mouse_gl_y: Mouse coordinates in [-1,1]^2.
 	 * @param Landscape* landscape: For getting the square altitude.
 	 * @param multimap<QPoint,Figure*> candidates returned by
 	 *   get_all_stable figures_in_line(..)
-	 * @param QMatrix4x4& camera: Enhanced into complete transformation and
-	 *   then passed on to is_figure_under_xray_mouse(..)
+	 * @param QVector3D origin, direction: The mouse ray as given by
+	 *   get_mouse_ray(..). Passed on to is_figure_hit_by_ray(..).
 	 * @return
 	 * 1. Let fg=0.
 	 * 2. If there are Figures under the mouse consider those figures that are
@@ -237,23 +275,14 @@ private:
 	 *    Of those stacked Figures pick the bottom one. fg = that figure.
 	 * return fg.
 	 */
-	QPoint_Figure get_figure_under_mouse(float mouse_gl_x, float mouse_gl_y,
-		Landscape* landscape, vector<QPoint_Figure>& candidates,
-		QMatrix4x4& camera);
-
-	/** @return the number of boulders on this figure, including the figure itself. */
-	int get_block_stack_height(Figure* figure);
-
-	/** For the antagonists. Is the line of sight free to the base of the
-	 * given target square at the given altitude? It is if for all flat squares
-	 * on the way from eye to target the line of sight is above the square.
-	 * @param bool can_see_from_below: If false the target is hidden from view
-	 *   if it is situated above the eye.
-	 */
-	bool can_see_square(Landscape* landscape,
-		QVector3D eye, QPoint target_sq, float alt_target_sq, bool can_see_from_below);
+	QPoint_Figure get_figure_under_mouse(Landscape* landscape,
+		Arena_figures& candidates, QVector3D origin, QVector3D direction);
 
 public:
+	/** Hands back all temporaries of the previous scans. Called at the
+	 * beginning of each tick and each mouse scan. */
+	void reset_arena() { arena.reset(); }
+
 	/**
 	 * Determines where the mouse is
 	 * pointing at. Writes its findings into board_pos and figure.
@@ -302,17 +331,62 @@ public:
 	 *   Their vertical fov is assumed to be 180 degrees from pole to pole.
 	 * @param float fov_horizontal: Horizontal field of view of this antagonist.
 	 * @param Landscape* landscape: Landscape pointer.
-	 * @param Board<Figure>* board_fg: Pointer to the figure centered board.
-	 * @param bool seek_trees: If true nothing but non-stacked trees will
-	 *   be returned. This is useful for meanie summoning.
-	 * @return vector of all Antagonist_targets seen by this antagonist right now.
+	 * @param Square_summary* summaries: Row major stack summaries of all
+	 *   squares as kept by Game's Figure_index.
+	 * @param Antagonist_sight& res: Will be cleared and filled in a single
+	 *   sweep with all Antagonist_targets seen by this antagonist right now,
+	 *   all trees it sees (for meanie summoning) and the empty squares in its
+	 *   field of view (for tree manifestation).
 	 */
-	vector<Antagonist_target> get_antagonist_targets(
+	void get_antagonist_targets(
 		QVector3D eye_in_world, QVector2D direction_in_world, float fov_horizontal,
-		Landscape* landscape, Board<Figure>* board_fg, bool seek_trees=false);
+		Landscape* landscape, const Square_summary* summaries, Antagonist_sight& res);
 	
 	Scanner(Io_Qt* io=0);
 };
+
+/** Reverse viewshed of the player's square. For each square it holds the
+ * minimum eye altitude from which the player's square, feet, and body are
+ * in line of sight (by the rules of trace_lines_of_sight(..)). Terrain
+ * never changes. Hence this needs to be computed anew only when the player
+ * moves or the number of blocks beneath him changes. Telling whether an
+ * antagonist sees the player then is an angle check and a lookup.
+ *
+ * Note that the rays are cast from the center of each square while an
+ * antagonist's eye is a little off center. */
+class Player_viewshed
+{
+private:
+	int width;
+	int height;
+	/** (-1,-1) until compute(..) was called. */
+	QPoint site;
+	int number_of_blocks;
+	/** Per square, row major: The player's square, feet, and body are
+	 * visible from an eye strictly above these altitudes. */
+	vector<float> min_eye_square;
+	vector<float> min_eye_feet;
+	vector<float> min_eye_body;
+
+public:
+	QPoint get_site() { return site; }
+	int get_number_of_blocks() { return number_of_blocks; }
+
+	/** @param QPoint site: The player's square.
+	 * @param int number_of_blocks: Number of blocks the player stands on. */
+	void compute(Landscape* landscape, QPoint site, int number_of_blocks);
+
+	/**
+	 * @param QPoint from: Square of the beholder.
+	 * @param QVector3D eye: Eye of the beholder in world coordinates.
+	 * @param QVector3D direction: View direction. z is ignored.
+	 * @param float h_fov: Horizontal field of view in degrees.
+	 * @return how well the player is seen, following the same rules as
+	 *   Scanner::get_antagonist_targets(..). */
+	E_VISIBILITY get_visibility(QPoint from, QVector3D eye, QVector3D direction, float h_fov);
+
+	Player_viewshed();
+};
 }
 
 #endif
@@ -0,0 +1,146 @@
+/**
+ * Sentinel Gl -- an OpenGL based remake of the Firebird classic the Sentinel.
+ * Copyright (C) May 25th, 2015 Markus-Hermann Koch, mhk@markuskoch.eu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * The game simulation runs on a thread of its own. Each tick it leaves
+ * behind an immutable Render_snapshot of everything paintGL() needs to know
+ * about the figures on the board. The snapshots are handed over to the GUI
+ * thread using a triple buffer. Thus the renderer never waits for the
+ * simulation and never looks at the live board.
+ *
+ * Everything else touching the Game object (input handling, QTimer slots)
+ * serializes with the simulation using Game::get_mutex().
+ */
+
+#ifndef MHK_SIMULATION_H
+#define MHK_SIMULATION_H
+
+#include <vector>
+#include <QThread>
+#include <QAtomicInt>
+#include <QMatrix4x4>
+#include "data_structures.h"
+#include "landscape.h"
+
+using std::vector;
+
+using namespace display;
+
+namespace game
+{
+class Game;
+
+/** Everything needed to draw a single figure mesh. */
+struct Figure_snapshot
+{
+	Mesh_Data* mesh;
+	/** The figure drawn. For comparison only. The renderer never dereferences it. */
+	const Figure* figure;
+	/** The square the figure's stack stands on. */
+	QPoint site;
+	/** true if Scanner::get_mouse_target(..) could pick the figure: It is
+	 * STABLE and not on the player's square. */
+	bool pickable;
+	/** translate*rotate*scale for the object. */
+	QMatrix4x4 transformation;
+	/** Alpha channel fading factor in [0,1]. Not yet multiplied by the light fade. */
+	float fade;
+	/** Bounds of the mesh in world coordinates. For view culling. */
+	Mesh_bounds bounds;
+};
+
+/** The state of the board at the end of one simulation tick, as far as
+ * drawing it is concerned. */
+class Render_snapshot
+{
+public:
+	/** Camera of the player's viewer data. */
+	QMatrix4x4 camera;
+	/** Planes bounding camera. */
+	View_frustum frustum;
+	/** Game::get_board_revision() the figures were taken at. */
+	uint board_revision;
+	/** Figures to be drawn. Transmuting figures contribute their old mesh, too. */
+	vector<Figure_snapshot> figures;
+
+	/** Maps fade in [0,1] to a goofy fct in [0,1.3].
+	 * @returns float that can be used in scale while drawing objects
+	 *   for a nice optical plop effect. Apply it on MANIFESTING figures. */
+	static float plop_fct(float fade);
+
+	/** Determines the scale with which the given figure is to be drawn. */
+	static float get_appropriate_scale(Figure*);
+
+	Render_snapshot();
+};
+
+/** Lock free single writer, single reader triple buffer. The writer fills
+ * get_back() and calls publish(). The reader calls acquire() and, if
+ * that returned true, finds the latest snapshot in get_front().
+ * Writers need to be serialized. Game does so using its mutex. */
+class Snapshot_buffer
+{
+private:
+	enum { INDEX_MASK = 3, FRESH = 4 };
+	Render_snapshot buffers[3];
+	/** Index of the buffer in between writer and reader. Ored with FRESH
+	 * if it holds a snapshot the reader has not yet seen. */
+	QAtomicInt middle;
+	/** Owned by the writer. */
+	int back;
+	/** Owned by the reader. */
+	int front;
+
+public:
+	Render_snapshot* get_back() { return &(buffers[back]); }
+	/** Hands the back buffer over to the reader. */
+	void publish();
+	/** Fetches the latest published snapshot, if there is a new one.
+	 * @return true if and only if get_front() has changed. */
+	bool acquire();
+	const Render_snapshot* get_front() { return &(buffers[front]); }
+
+	Snapshot_buffer();
+};
+
+/** Calls Game::do_progress() at the given framerate and publishes
+ * a snapshot whenever there was relevant progress. */
+class Simulation_thread : public QThread
+{
+private:
+	Game* game;
+	float framerate;
+	/** qrand() is seeded per thread. Taken from the creating thread. */
+	uint seed;
+	QAtomicInt paused;
+	QAtomicInt stop_requested;
+
+protected:
+	virtual void run();
+
+public:
+	/** While paused the game does not progress. */
+	void set_paused(bool paused);
+	/** Ends the simulation loop and waits for the thread to finish. */
+	void stop();
+
+	Simulation_thread(Game* game, float framerate, QObject* parent=0);
+	virtual ~Simulation_thread();
+};
+}
+#endif
@@ -0,0 +1,146 @@
+/**
+ * Sentinel Gl -- an OpenGL based remake of the Firebird classic the Sentinel.
+ * Copyright (C) May 25th, 2015 Markus-Hermann Koch, mhk@markuskoch.eu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * Small fixed size math for the hot paths of the Scanner and the Game.
+ * QMatrix4x4::rotate(..) normalizes its axis, builds a rotation matrix and
+ * multiplies it into the target. Most of the game only ever turns things
+ * around the z axis or within a vertical plane, which is a 2D rotation
+ * of two coordinates. Rotation_2d does just that.
+ *
+ * Vec4 and Mat4 transform points like QMatrix4x4*QVector4D does. On x86
+ * they use SSE, which every x86_64 CPU has. Hence no runtime dispatch is
+ * needed unlike for the AVX2 line of sight kernel. Elsewhere they fall
+ * back to plain floats. The results equal those of Qt as the sums are
+ * taken in the same order.
+ *
+ * Qt types are taken and given back at the boundaries. Nothing is kept.
+ */
+
+#ifndef MHK_VEC_MATH_H
+#define MHK_VEC_MATH_H
+
+#include <string>
+#include <QVector2D>
+#include <QVector3D>
+#include <QVector4D>
+#include <QMatrix4x4>
+
+#if defined(__SSE__) || defined(_M_X64)
+#define MHK_VEC_MATH_SSE
+#include <xmmintrin.h>
+#endif
+
+using std::string;
+
+namespace game
+{
+/** Rotation of the plane by a fixed angle. */
+class Rotation_2d
+{
+public:
+	float c;
+	float s;
+
+	/** (x,y) -> (c*x - s*y, s*x + c*y). */
+	void apply(float& x, float& y) const
+	{
+		float rx = c*x - s*y;
+		y = s*x + c*y;
+		x = rx;
+	}
+
+	QVector2D apply(const QVector2D& p) const
+	{
+		return QVector2D(c*p.x() - s*p.y(), s*p.x() + c*p.y());
+	}
+
+	/** Same as a QMatrix4x4 rotated by the angle around (0,0,1) times p. */
+	QVector3D apply_z(const QVector3D& p) const
+	{
+		return QVector3D(c*p.x() - s*p.y(), s*p.x() + c*p.y(), p.z());
+	}
+
+	/** @param float degrees: Counter clockwise like QMatrix4x4::rotate(..). */
+	Rotation_2d(float degrees);
+};
+
+/** Four floats in one SSE register. */
+class Vec4
+{
+public:
+#ifdef MHK_VEC_MATH_SSE
+	__m128 v;
+	Vec4(__m128 v) : v(v) {}
+	Vec4(float x, float y, float z, float w) : v(_mm_setr_ps(x,y,z,w)) {}
+	Vec4 operator+(const Vec4& b) const { return Vec4(_mm_add_ps(v, b.v)); }
+	Vec4 operator-(const Vec4& b) const { return Vec4(_mm_sub_ps(v, b.v)); }
+	Vec4 operator*(float a) const { return Vec4(_mm_mul_ps(v, _mm_set1_ps(a))); }
+	void store(float* dst) const { _mm_storeu_ps(dst, v); }
+#else
+	float v[4];
+	Vec4(float x, float y, float z, float w) { v[0]=x; v[1]=y; v[2]=z; v[3]=w; }
+	Vec4 operator+(const Vec4& b) const
+		{ return Vec4(v[0]+b.v[0], v[1]+b.v[1], v[2]+b.v[2], v[3]+b.v[3]); }
+	Vec4 operator-(const Vec4& b) const
+		{ return Vec4(v[0]-b.v[0], v[1]-b.v[1], v[2]-b.v[2], v[3]-b.v[3]); }
+	Vec4 operator*(float a) const { return Vec4(v[0]*a, v[1]*a, v[2]*a, v[3]*a); }
+	void store(float* dst) const { for (int k=0;k<4;k++) dst[k] = v[k]; }
+#endif
+	Vec4() : Vec4(0,0,0,0) {}
+	explicit Vec4(const QVector4D& p) : Vec4(p.x(), p.y(), p.z(), p.w()) {}
+	explicit Vec4(const QVector3D& p, float w=1) : Vec4(p.x(), p.y(), p.z(), w) {}
+
+	QVector4D to_QVector4D() const
+	{
+		float f[4];
+		store(f);
+		return QVector4D(f[0], f[1], f[2], f[3]);
+	}
+};
+
+/** 4x4 matrix of four column vectors. Like QMatrix4x4 without the flags. */
+class Mat4
+{
+public:
+	Vec4 columns[4];
+
+	Vec4 operator*(const Vec4& p) const
+	{
+#ifdef MHK_VEC_MATH_SSE
+		__m128 r = _mm_mul_ps(columns[0].v, _mm_shuffle_ps(p.v, p.v, _MM_SHUFFLE(0,0,0,0)));
+		r = _mm_add_ps(r, _mm_mul_ps(columns[1].v, _mm_shuffle_ps(p.v, p.v, _MM_SHUFFLE(1,1,1,1))));
+		r = _mm_add_ps(r, _mm_mul_ps(columns[2].v, _mm_shuffle_ps(p.v, p.v, _MM_SHUFFLE(2,2,2,2))));
+		r = _mm_add_ps(r, _mm_mul_ps(columns[3].v, _mm_shuffle_ps(p.v, p.v, _MM_SHUFFLE(3,3,3,3))));
+		return Vec4(r);
+#else
+		return columns[0]*p.v[0] + columns[1]*p.v[1] + columns[2]*p.v[2] + columns[3]*p.v[3];
+#endif
+	}
+
+	/** Copies the column major data of A. */
+	explicit Mat4(const QMatrix4x4& A);
+};
+
+/** Microbenchmark. Turns the given number of random vectors around the
+ * z axis and projects as many random points, once with QMatrix4x4 as the
+ * Scanner used to and once with Rotation_2d and Mat4.
+ * @return nanoseconds per operation of each as text. */
+string benchmark_vec_math(int n);
+}
+#endif
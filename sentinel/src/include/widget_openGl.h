@@ -66,6 +66,9 @@
 #include "io_qt.h"
 #include "data_structures.h"
 #include "game.h"
+#include "hover_picker.h"
+#include "gpu_picker.h"
+#include "render_queue.h"
 
 using std::ostream;
 using std::ostringstream;
@@ -120,6 +123,18 @@ struct Known_Texture_Resources
 	Known_Texture_Resources();
 };
 
+/** Handles into Widget_OpenGl::objects of the meshes each scenery has its own of. */
+struct Scenery_meshes
+{
+	int sky;
+	int foundation;
+	int sq_connection;
+	int sq_odd;
+	int sq_even;
+	int tree;
+	int tower;
+};
+
 class Widget_OpenGl : public QOpenGLWidget, public QOpenGLFunctions
 {
 Q_OBJECT
@@ -161,13 +176,15 @@ private:
 	Known_Texture_Resources known_texture_resources;
 
 	/** Filled by compile_programs using the resource ":/misc/kernels.txt" */
-	map<string,QOpenGLShaderProgram*> programs;
+	Resource_table<QOpenGLShaderProgram*> programs;
 	/** Shader pointers created by compile_programs(). Needed for deletion later on. */
 	vector<QOpenGLShader*> shaders;
 	/** Texure objects by resource their key in this->known_texture_resources. */
-	map<string, QOpenGLTexture*> textures;
+	Resource_table<QOpenGLTexture*> textures;
 	/** All kinds of 3D objects required for the game. */
-	map<string,Mesh_Data*> objects;
+	Resource_table<Mesh_Data*> objects;
+	/** Indexed by E_SCENERY. Filled by initialize_objects(). */
+	vector<Scenery_meshes> scenery_meshes;
 	/** How many frames per seconds should be endeavoured? */
 	float framerate;
 	/** Where in space is the light source? */
@@ -183,8 +200,31 @@ private:
 	float light_ambience;
 	/** Pointer to the game object. */
 	Game* game;
+	/** Runs game->do_progress(). Exists as long as this->game does. */
+	Simulation_thread* simulation;
+	/** Keeps track of what the mouse is pointing at. Exists as long as this->game does. */
+	Hover_picker* hover_picker;
+	/** Picks on the GPU instead. Created by initializeGL() if the context
+	 * supports it. 0 else. */
+	Gpu_picker* gpu_picker;
+	/** Toggled by the 'G' key. Use gpu_picker rather than hover_picker. */
+	bool use_gpu_picking;
+	/** The draw calls of the current frame. Refilled by draw_landscape(..). */
+	Render_queue render_queue;
+	/** Toggled by the 'I' key. Shows rolling percentiles of the timing zones. */
+	bool show_timing_overlay;
+	/** Zoom, zoom reset and u-turn requested by the wheel, the keys and the
+	 * mouse buttons. These never wait for the simulation. update_after_dt()
+	 * applies them as soon as it gets hold of the game mutex. */
+	float pending_zoom;
+	bool pending_zoom_reset;
+	bool pending_u_turn;
+	/** Set if update_after_dt() did not get hold of the game mutex. The view
+	 * changes of that frame are published along with the next one. */
+	bool is_snapshot_stale;
 	
 	// Is triggered every 1/framerate seconds. Calls this->update_after_dt() causing repaintGL()
+	// The game itself progresses on this->simulation.
 	QTimer* timer_framerate;
 	
 	/** Updates the statusBar with a pause message. */	
@@ -197,9 +237,15 @@ private:
 	 * given dFOV. Makes sure that player max and min opening are maintained. */
 	void update_zoom(float dFOV);
 
+	/** Applies pending_zoom, pending_zoom_reset and pending_u_turn.
+	 * The caller is required to hold the game mutex. */
+	void apply_pending_view_input();
+
 public:
 	void set_io(Io_Qt* io) { this->io = io; }
-	void set_game(Game* game) { this->game = game; }
+	/** Stops the simulation of the old game, if any, and starts the one
+	 * of the new game, if any. */
+	void set_game(Game* game);
 	void set_scenery(E_SCENERY scenery) { this->scenery = scenery; }
 
 	/** Setting up light source, color and rest light ambience.
@@ -266,7 +312,8 @@ private:
 		QOpenGLTexture* texture, bool do_transfer_to_GPU);
 	
 	/** Call after compile_programs and load_textures have run.
-	 * Prepares the 3D objects for the game and fills this->objects.
+	 * Prepares the 3D objects for the game and fills this->objects
+	 * as well as this->scenery_meshes.
 	 * @return true.
 	 */
 	bool initialize_objects();
@@ -275,11 +322,6 @@ private:
 	void set_context_to_default_state();
 	//< --------------------------------------------------------------
 	//> Helper functions for paintGL(). ------------------------------
-	/** Maps fade in [0,1] to a goofy fct in [0,1.3].
-	 * @returns float that can be used in scale while drawing objects
-	 *   for a nice optical plop effect. Apply it on MANIFESTING figures. */
-	float plop_fct(float fade);
-	
 	/** Clears the screen using default settings*/
 	void clear_screen(QVector4D color=default_display.backgroundcolor);
 	
@@ -291,41 +333,27 @@ private:
 	 * @throws char* if vd cannot be retrieved or is 0. */
 	Viewer_Data* get_viewer_data();
 		
-	/** Draws an object using the terrain shaders.
-	 * @param Mesh_Data* object: Pointer to the mesh data for the object to be drawn.
-	 * @param QMatrix4x4& camera: Final transformation to be applied to
-	 *   the vertices prior to drawing. Consists of (perspective*lookAt).
-	 * @param QMatrix4x4& trans_rot: May be the identity matrix if the target
-	 *   mesh is in world coordinates already. Else (translation*rotation)
-	 *   transformation to be applied prior to the camera transformation.
-	 *   This matrix is also needed for the diffuse lighting algorithm.
-	 * @param float fade: Alpha channel fading factor in [0,1].
-	 * @param QOpenGLBuffer* buf_vertices: If given use these vertices instead
-	 *   of the ones already present in Mesh_Data. This is useful for
-	 *   this->draw_square() with its world coordinate vertex set.
-	 *   May be 0 in order to use the buffer within Mesh_Data.
-	 */
-	void draw_terrain_object(Mesh_Data* object, QMatrix4x4& camera,
-		QMatrix4x4& trans_rot_object, float fade, QOpenGLBuffer* buf_vertices=0);
-
-	/** Basically just calls draw_terrain_object using the world coordinate
-	 * vertex buffer within sq. */
-	void draw_square(Square* sq, QMatrix4x4& camera, float fade);
-
-	/** Draws the thunderdome. I.e. the sky and the flat plain beneath it. 
-	 * fade is the value of the alpha channel. */
-	void draw_dome(QMatrix4x4& camera, float fade);
-	
-	/** Tool function for draw_landscape(). Determines the scale for the given figure. */
-	float get_appropriate_scale(Figure*);
+	/** Adds the thunderdome to this->render_queue. I.e. the sky and the
+	 * flat plain beneath it. fade is the value of the alpha channel. */
+	void queue_dome(float fade);
 	
-	/** Draws the landscape based on this->game->get_landscape(). */
+	/** Draws the landscape based on this->game->get_landscape() and the
+	 * figures based on the latest Render_snapshot of the game. The draw
+	 * calls are collected in this->render_queue, sorted and submitted. */
 	void draw_landscape(float fade);
+
+	/** Draws the Profiler summary on top of the scene using a QPainter. */
+	void draw_timing_overlay();
 	//< --------------------------------------------------------------
 	/** @return mouse coordinates on the glScreen in [-1,1].
 	 * Will be limited to that interval even if the mouse is elsewhere if clamp==true. */
 	float get_Gl_mouse_x(bool clamp=true);
 	float get_Gl_mouse_y(bool clamp=true);
+
+	/** Like Game::get_mouse_target(..) for the current mouse position.
+	 * Takes the pick of this->gpu_picker or this->hover_picker if that is
+	 * up to date. The caller is required to hold the game mutex. */
+	E_POSSIBLE_PLAYER_ACTION get_mouse_target(QPoint& board_pos, Figure*& figure);
 	
 	/** If the player is not in cursor mode this will handle his dynamic rotation. 
 	 * @param float framerate: dt=1./framerate. Required for the update of viewer_data.
@@ -348,6 +376,7 @@ protected:
     virtual void paintGL();
 	
 	virtual void mouseReleaseEvent(QMouseEvent* e);
+	virtual void mouseMoveEvent(QMouseEvent* e);
 	virtual void wheelEvent(QWheelEvent*);
 	virtual void keyPressEvent(QKeyEvent*);
 	
@@ -0,0 +1,243 @@
+/**
+ * Sentinel Gl -- an OpenGL based remake of the Firebird classic the Sentinel.
+ * Copyright (C) May 25th, 2015 Markus-Hermann Koch, mhk@markuskoch.eu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <QMutexLocker>
+#include "profiler.h"
+
+using std::ofstream;
+using std::ostringstream;
+
+//> Allocation counting. ---------------------------------------------
+#ifdef MHK_COUNT_ALLOCATIONS
+namespace
+{
+thread_local qint64 thread_allocation_count = 0;
+thread_local qint64 thread_allocation_bytes = 0;
+}
+
+void* operator new(std::size_t size)
+{
+	thread_allocation_count++;
+	thread_allocation_bytes += size;
+	void* res = malloc(size ? size : 1);
+	if (!res) throw std::bad_alloc();
+	return res;
+}
+
+void* operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) throw()
+{
+	free(p);
+}
+
+void operator delete[](void* p) throw()
+{
+	free(p);
+}
+#endif
+//< ------------------------------------------------------------------
+
+namespace mhk_gl
+{
+Allocation_count get_thread_allocations()
+{
+	Allocation_count res;
+#ifdef MHK_COUNT_ALLOCATIONS
+	res.count = thread_allocation_count;
+	res.bytes = thread_allocation_bytes;
+#else
+	res.count = 0;
+	res.bytes = 0;
+#endif
+	return res;
+}
+
+Profiler* Profiler::get_instance()
+{
+	static Profiler profiler;
+	return &profiler;
+}
+
+const char* Profiler::get_zone_name(E_TIMING_ZONE zone)
+{
+	const char* res;
+	switch (zone)
+	{
+		case E_TIMING_ZONE::UPDATE_AFTER_DT: res = "update_after_dt"; break;
+		case E_TIMING_ZONE::PLAYER_ROTATION: res = "player_dynamic_rotation"; break;
+		case E_TIMING_ZONE::DO_PROGRESS: res = "do_progress"; break;
+		case E_TIMING_ZONE::ANTAGONIST_SCAN: res = "antagonist scan"; break;
+		case E_TIMING_ZONE::ANTAGONIST_ATTACK: res = "antagonist attack"; break;
+		case E_TIMING_ZONE::TRANSITIONS: res = "fading and goner removal"; break;
+		case E_TIMING_ZONE::PAINT_GL: res = "paintGL"; break;
+		case E_TIMING_ZONE::DRAW_LANDSCAPE: res = "draw_landscape"; break;
+		case E_TIMING_ZONE::MOUSE_TARGET: res = "get_mouse_target"; break;
+		case E_TIMING_ZONE::SUBMIT_DRAWS: res = "submit draws"; break;
+		default: throw "Unknown timing zone.";
+	}
+	return res;
+}
+
+bool Profiler::counts_allocations()
+{
+#ifdef MHK_COUNT_ALLOCATIONS
+	return true;
+#else
+	return false;
+#endif
+}
+
+void Profiler::record(E_TIMING_ZONE zone, qint64 start, qint64 end,
+	Allocation_count allocations)
+{
+	QMutexLocker locker(&mutex);
+	//> Thread index. ------------------------------------------------
+	// There are but two or three threads. Linear search it is.
+	Qt::HANDLE handle = QThread::currentThreadId();
+	int thread = -1;
+	for (uint j=0;j<threads.size();j++)
+	{
+		if (threads[j] == handle) { thread = j; break; }
+	}
+	if (thread == -1)
+	{
+		thread = threads.size();
+		threads.push_back(handle);
+	}
+	//< --------------------------------------------------------------
+	history[zone][history_next[zone]] = end - start;
+	history_allocations[zone][history_next[zone]] = allocations.count;
+	history_bytes[zone][history_next[zone]] = allocations.bytes;
+	history_next[zone] = (history_next[zone] + 1) % HISTORY_SIZE;
+	if (history_count[zone] < HISTORY_SIZE) history_count[zone]++;
+	Trace_event& event = trace[trace_next];
+	event.zone = zone;
+	event.thread = thread;
+	event.start = start;
+	event.duration = end - start;
+	event.allocations = allocations.count;
+	event.allocated_bytes = allocations.bytes;
+	trace_next = (trace_next + 1) % TRACE_SIZE;
+	if (trace_count < TRACE_SIZE) trace_count++;
+}
+
+float Profiler::get_percentile(E_TIMING_ZONE zone, float p)
+{
+	qint64 data[HISTORY_SIZE];
+	int n;
+	{
+		QMutexLocker locker(&mutex);
+		n = history_count[zone];
+		std::copy(history[zone], history[zone]+n, data);
+	}
+	if (n == 0) return 0;
+	int k = (int)(p * (n-1) + .5);
+	std::nth_element(data, data+k, data+n);
+	return ((float)data[k])/1.e6;
+}
+
+float Profiler::get_mean_allocations(E_TIMING_ZONE zone, float& bytes)
+{
+	QMutexLocker locker(&mutex);
+	int n = history_count[zone];
+	bytes = 0;
+	if (n == 0) return 0;
+	qint64 count_sum = 0;
+	qint64 bytes_sum = 0;
+	for (int j=0;j<n;j++)
+	{
+		count_sum += history_allocations[zone][j];
+		bytes_sum += history_bytes[zone][j];
+	}
+	bytes = ((float)bytes_sum)/n;
+	return ((float)count_sum)/n;
+}
+
+vector<string> Profiler::get_summary()
+{
+	vector<string> res;
+	for (int zone=0;zone<NUMBER_OF_TIMING_ZONES;zone++)
+	{
+		E_TIMING_ZONE z = (E_TIMING_ZONE)zone;
+		ostringstream oss;
+		oss << std::fixed << std::setprecision(2) << get_zone_name(z) <<
+			": p50 " << get_percentile(z,.5) <<
+			" p90 " << get_percentile(z,.9) <<
+			" p99 " << get_percentile(z,.99) << " ms";
+		if (counts_allocations())
+		{
+			float bytes;
+			float count = get_mean_allocations(z,bytes);
+			oss << std::setprecision(1) << ", " << count << " allocs (" <<
+				bytes << " B)";
+		}
+		res.push_back(oss.str());
+	}
+	return res;
+}
+
+bool Profiler::export_chrome_trace(string pfname)
+{
+	ofstream out(pfname.c_str());
+	if (!out.good()) return false;
+	QMutexLocker locker(&mutex);
+	out << "{\"traceEvents\":[\n";
+	// Oldest event first.
+	int first = (trace_next - trace_count + TRACE_SIZE) % TRACE_SIZE;
+	out << std::fixed << std::setprecision(3);
+	for (int j=0;j<trace_count;j++)
+	{
+		const Trace_event& event = trace[(first + j) % TRACE_SIZE];
+		out << "{\"name\":\"" << get_zone_name(event.zone) <<
+			"\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread <<
+			",\"ts\":" << ((double)event.start)/1.e3 <<
+			",\"dur\":" << ((double)event.duration)/1.e3;
+		if (counts_allocations())
+		{
+			out << ",\"args\":{\"allocs\":" << event.allocations <<
+				",\"bytes\":" << event.allocated_bytes << "}";
+		}
+		out << "}" << ((j+1 < trace_count) ? ",\n" : "\n");
+	}
+	out << "],\"displayTimeUnit\":\"ms\"}\n";
+	return out.good();
+}
+
+Profiler::Profiler()
+{
+	for (int zone=0;zone<NUMBER_OF_TIMING_ZONES;zone++)
+	{
+		history_next[zone] = 0;
+		history_count[zone] = 0;
+	}
+	trace = vector<Trace_event>(TRACE_SIZE);
+	trace_next = 0;
+	trace_count = 0;
+	clock.start();
+}
+}
@@ -74,6 +74,120 @@ string Vertex_Data::toString()
 }
 //< ------------------------------------------------------------------
 
+//> Mesh_bounds. -----------------------------------------------------
+void Mesh_bounds::compute(const vector<QVector3D>& positions)
+{
+	if (positions.empty())
+	{
+		*this = Mesh_bounds();
+		return;
+	}
+	box_min = box_max = positions[0];
+	for (vector<QVector3D>::const_iterator CI=positions.begin();CI!=positions.end();CI++)
+	{
+		for (int k=0;k<3;k++)
+		{
+			if ((*CI)[k] < box_min[k]) box_min[k] = (*CI)[k];
+			if ((*CI)[k] > box_max[k]) box_max[k] = (*CI)[k];
+		}
+	}
+	sphere_center = (box_min + box_max) / 2.;
+	sphere_radius = 0;
+	for (vector<QVector3D>::const_iterator CI=positions.begin();CI!=positions.end();CI++)
+	{
+		float r = (*CI - sphere_center).length();
+		if (r > sphere_radius) sphere_radius = r;
+	}
+}
+
+Mesh_bounds Mesh_bounds::transformed(QVector3D translation, float phi, float scale) const
+{
+	float c = cos(phi*PI/180.);
+	float s = sin(phi*PI/180.);
+	Mesh_bounds res;
+	QVector3D center = scale*sphere_center;
+	res.sphere_center = translation +
+		QVector3D(c*center.x() - s*center.y(), s*center.x() + c*center.y(), center.z());
+	res.sphere_radius = scale*sphere_radius;
+	// Rotating the box around its center and boxing it again.
+	QVector3D box_center = scale*(box_min + box_max)/2.;
+	QVector3D half = scale*(box_max - box_min)/2.;
+	QVector3D rotated_center = translation + QVector3D(
+		c*box_center.x() - s*box_center.y(), s*box_center.x() + c*box_center.y(), box_center.z());
+	QVector3D rotated_half(fabs(c)*half.x() + fabs(s)*half.y(),
+		fabs(s)*half.x() + fabs(c)*half.y(), half.z());
+	res.box_min = rotated_center - rotated_half;
+	res.box_max = rotated_center + rotated_half;
+	return res;
+}
+
+bool Mesh_bounds::may_be_hit_by(QVector3D origin, QVector3D direction) const
+{
+	//> Sphere: Closest approach of the segment to the center. ------
+	float dir_sq = QVector3D::dotProduct(direction, direction);
+	if (dir_sq == 0) return false;
+	float t = QVector3D::dotProduct(sphere_center - origin, direction) / dir_sq;
+	t = (t < 0) ? 0 : ((t > 1) ? 1 : t);
+	if ((origin + t*direction - sphere_center).lengthSquared() > sphere_radius*sphere_radius)
+		return false;
+	//< --------------------------------------------------------------
+	//> Box: Slab test. ----------------------------------------------
+	float t0 = 0;
+	float t1 = 1;
+	for (int k=0;k<3;k++)
+	{
+		if (direction[k] == 0)
+		{
+			if (origin[k] < box_min[k] || origin[k] > box_max[k]) return false;
+			continue;
+		}
+		float near = (box_min[k] - origin[k]) / direction[k];
+		float far = (box_max[k] - origin[k]) / direction[k];
+		if (near > far) { float swap = near; near = far; far = swap; }
+		if (near > t0) t0 = near;
+		if (far < t1) t1 = far;
+		if (t0 > t1) return false;
+	}
+	//< --------------------------------------------------------------
+	return true;
+}
+
+Mesh_bounds::Mesh_bounds()
+{
+	this->sphere_radius = 0;
+}
+//< ------------------------------------------------------------------
+
+//> View_frustum. ----------------------------------------------------
+bool View_frustum::is_outside(QVector3D center, float radius) const
+{
+	for (int j=0;j<6;j++)
+	{
+		if (QVector3D::dotProduct(planes[j].toVector3D(), center) + planes[j].w() < -radius)
+			return true;
+	}
+	return false;
+}
+
+View_frustum::View_frustum(const QMatrix4x4& camera)
+{
+	// Gribb and Hartmann: A point p is within the clip volume if and only if
+	// -w <= x,y,z <= w for (x,y,z,w) = camera*p. Each of these six
+	// inequalities is a plane in world coordinates.
+	QVector4D w = camera.row(3);
+	for (int j=0;j<3;j++)
+	{
+		planes[2*j] = w + camera.row(j);
+		planes[2*j+1] = w - camera.row(j);
+	}
+	for (int j=0;j<6;j++)
+	{
+		float length = planes[j].toVector3D().length();
+		if (length > 0) planes[j] /= length;
+	}
+}
+//< ------------------------------------------------------------------
+
 //> Mesh_Data. -------------------------------------------------------
 vector<GLushort> Mesh_Data::obj_index_to_vector(const string obj)
 {
@@ -216,6 +330,12 @@ bool Mesh_Data::parse_blender_obj(string src)
 			gl_tex_coords[j]
 		));
 	}
+	//< --------------------------------------------------------------
+	//> Step 6: Bounds and bounding volume hierarchy. ---------------
+	vector<QVector3D> positions(n);
+	for (uint j=0;j<n;j++) positions[j] = gl_vertices[j].toVector3D();
+	bounds.compute(positions);
+	bvh.build(positions, elements);
 	if (io)
 	{
 		ostringstream oss;
@@ -285,7 +405,7 @@ void Mesh_Data::release()
 }
 
 Mesh_Data::Mesh_Data(Io_Qt* io)
-	: program_name("undef"), texture(0),
+	: program_name("undef"), program(-1), texture(0),
 	  buf_vertices(QOpenGLBuffer::VertexBuffer), buf_elements(QOpenGLBuffer::IndexBuffer)
 {
 	this->io = io;
@@ -331,6 +451,7 @@ QVector3D Viewer_Data::get_site()
 void Viewer_Data::set_opening(float opening)
 {
 	this->opening = opening;
+	this->version++;
 	viewer_data_changed();	
 }
 
@@ -364,12 +485,14 @@ void Viewer_Data::set_direction(float phi, float theta, float alpha)
 void Viewer_Data::set_dir_view(QVector3D dir_view)
 {
 	this->dir_view = dir_view;
+	this->version++;
 	viewer_data_changed();
 }
 
 void Viewer_Data::set_dir_up(QVector3D dir_up)
 {
 	this->dir_up = dir_up;
+	this->version++;
 	viewer_data_changed();
 }
 
@@ -417,6 +540,7 @@ void Viewer_Data::turn_around_z_axis()
 void Viewer_Data::set_site(QVector3D site)
 {
 	this->site = site;
+	this->version++;
 	viewer_data_changed();
 }
 
@@ -461,10 +585,8 @@ void Viewer_Data::update_viewer_data_for_transfer(QPoint old_site, QPoint new_si
 
 float Viewer_Data::get_fov_h()
 {
-	float v_stretch = tan(get_opening()*deg_to_radians / 2.);
-	float h_stretch = get_aspect() * v_stretch;
-	float half_h_fov = atan(h_stretch)/deg_to_radians;
-	return half_h_fov * 2.0f;
+	update_cache();
+	return cache_fov_h;
 }
 
 float Viewer_Data::get_aspect()
@@ -473,16 +595,41 @@ float Viewer_Data::get_aspect()
 	return ((float)parent->width())/((float)parent->height());
 }
 
-QMatrix4x4 Viewer_Data::get_camera()
+void Viewer_Data::update_cache()
 {
 	float aspect = get_aspect();
+	if (version == cache_version && aspect == cache_aspect) return;
 	if (aspect*opening > 120) this->opening = 120/aspect;
 	float fov = opening;
-	QMatrix4x4 A;
-	A.setToIdentity();
-	A.perspective(fov, aspect, near, far);
-	A.lookAt(site,site+dir_view,dir_up);
-	return A;
+	cache_camera.setToIdentity();
+	cache_camera.perspective(fov, aspect, near, far);
+	cache_camera.lookAt(site,site+dir_view,dir_up);
+	cache_camera_inverse = cache_camera.inverted();
+	cache_frustum = View_frustum(cache_camera);
+	float v_stretch = tan(opening*deg_to_radians / 2.);
+	float h_stretch = aspect * v_stretch;
+	float half_h_fov = atan(h_stretch)/deg_to_radians;
+	cache_fov_h = half_h_fov * 2.0f;
+	cache_version = version;
+	cache_aspect = aspect;
+}
+
+const QMatrix4x4& Viewer_Data::get_camera()
+{
+	update_cache();
+	return cache_camera;
+}
+
+const QMatrix4x4& Viewer_Data::get_camera_inverse()
+{
+	update_cache();
+	return cache_camera_inverse;
+}
+
+const View_frustum& Viewer_Data::get_frustum()
+{
+	update_cache();
+	return cache_frustum;
 }
 
 string Viewer_Data::toString()
@@ -497,8 +644,12 @@ string Viewer_Data::toString()
 
 Viewer_Data::Viewer_Data(QOpenGLWidget* parent, QVector3D site, float phi,
 	float theta, float alpha, float near, float far, float opening)
-		: deg_to_radians(0.01745329251), parent(parent)
+		: deg_to_radians(0.01745329251), parent(parent), cache_frustum(QMatrix4x4())
 {
+	this->version = 1;
+	this->cache_version = 0;
+	this->cache_aspect = 0;
+	this->cache_fov_h = 0;
 	this->set_site(site);
 	this->set_perspective(near, far, opening);
 	this->set_direction(phi, theta, alpha);
@@ -92,14 +92,16 @@ void Form_main::setup_Widget_OpenGl()
 		this,SLOT(update_statusBar_text(QString)));
 	connect(uiMainWindow->openGLWidget,SIGNAL(disable_program(QString)),
 		this,SLOT(disable_program(QString)));
+	// Queued: These delete the game. The widget may still be holding
+	// its mutex while emitting.
 	connect(uiMainWindow->openGLWidget,SIGNAL(exit_requested()),
-		this,SLOT(exit_program()));
+		this,SLOT(exit_program()),Qt::QueuedConnection);
 	connect(uiMainWindow->openGLWidget,SIGNAL(fullscreen_key_pressed()),
 		this,SLOT(toggle_fullscreen()));
 	connect(uiMainWindow->openGLWidget,SIGNAL(request_new_game()),
-		this,SLOT(request_new_game()));
+		this,SLOT(request_new_game()),Qt::QueuedConnection);
 	connect(uiMainWindow->openGLWidget,SIGNAL(request_restart_game()),
-		this,SLOT(restart_game()));
+		this,SLOT(restart_game()),Qt::QueuedConnection);
 }
 
 void Form_main::setup_form()
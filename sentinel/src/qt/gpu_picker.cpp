@@ -0,0 +1,240 @@
+/**
+ * Sentinel Gl -- an OpenGL based remake of the Firebird classic the Sentinel.
+ * Copyright (C) May 25th, 2015 Markus-Hermann Koch, mhk@markuskoch.eu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+#include <QOpenGLContext>
+#include <QPair>
+#include "gpu_picker.h"
+
+namespace display
+{
+bool Gpu_picker::is_supported()
+{
+	QOpenGLContext* context = QOpenGLContext::currentContext();
+	return context && QOpenGLFramebufferObject::hasOpenGLFramebufferObjects();
+}
+
+void Gpu_picker::set_id(int handle_id_color, int id)
+{
+	// 8 bits per channel survive the framebuffer exactly.
+	program->setUniformValue(handle_id_color, QVector4D(
+		(float)(id & 0xff)/255.f,
+		(float)((id >> 8) & 0xff)/255.f,
+		(float)((id >> 16) & 0xff)/255.f,
+		1.f));
+}
+
+void Gpu_picker::draw(Mesh_Data* object, QOpenGLBuffer* buf_vertices, const QMatrix4x4& A,
+	int handle_v_vertices, int handle_A)
+{
+	object->buf_elements.bind();
+	if (buf_vertices) { buf_vertices->bind(); } else { object->buf_vertices.bind(); }
+	program->enableAttributeArray(handle_v_vertices);
+	program->setAttributeBuffer(
+		handle_v_vertices, GL_FLOAT, 0, 4, sizeof(Vertex_Data));
+	program->setUniformValue(handle_A, A);
+	gl->glDrawElements(object->draw_mode, object->elements.size(), GL_UNSIGNED_SHORT, 0);
+	program->disableAttributeArray(handle_v_vertices);
+	if (buf_vertices) { buf_vertices->release(); } else { object->buf_vertices.release(); }
+	object->buf_elements.release();
+}
+
+void Gpu_picker::render(float mouse_gl_x, float mouse_gl_y, int viewport_width, int viewport_height,
+	Landscape* landscape, const Render_snapshot* snapshot)
+{
+	//> Projection onto the pixels around the mouse. -----------------
+	// Scales the REGION pixels around the mouse up to the whole of clip space.
+	QMatrix4x4 pick;
+	pick.setToIdentity();
+	pick.scale((float)viewport_width/(float)REGION, (float)viewport_height/(float)REGION, 1);
+	pick.translate(-mouse_gl_x, -mouse_gl_y, 0);
+	QMatrix4x4 camera = pick * snapshot->camera;
+	View_frustum frustum(camera);
+	//< --------------------------------------------------------------
+	//> Offscreen framebuffer. ---------------------------------------
+	fbo->bind();
+	gl->glViewport(0, 0, REGION, REGION);
+	gl->glDisable(GL_BLEND);
+	gl->glDisable(GL_DITHER);
+	gl->glEnable(GL_DEPTH_TEST);
+	gl->glClearColor(0, 0, 0, 0); // Id 0: Nothing.
+	gl->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	program->bind();
+	int handle_v_vertices = program->attributeLocation("v_vertices");
+	int handle_A = program->uniformLocation("A");
+	int handle_id_color = program->uniformLocation("id_color");
+	//< --------------------------------------------------------------
+	//> Squares within the few pixels. They are in world coordinates. -
+	Board<Square>* board_sq = landscape->get_board_sq();
+	int width = board_sq->get_width();
+	int height = board_sq->get_height();
+	for (int y=0;y<height;y++)
+	{
+		for (int x=0;x<width;x++)
+		{
+			Square* sq = board_sq->get(x,y);
+			if (frustum.is_outside(sq->bounds.sphere_center, sq->bounds.sphere_radius)) continue;
+			set_id(handle_id_color, 1 + y*width + x);
+			draw(sq->get_mesh_prototype(), &(sq->buf_vertices), camera,
+				handle_v_vertices, handle_A);
+		}
+	}
+	//< --------------------------------------------------------------
+	//> Pickable figures within the few pixels. ----------------------
+	pending_figures.clear();
+	pending_sites.clear();
+	for (vector<Figure_snapshot>::const_iterator CI=snapshot->figures.begin();
+		CI!=snapshot->figures.end();CI++)
+	{
+		if (!CI->pickable) continue;
+		if (frustum.is_outside(CI->bounds.sphere_center, CI->bounds.sphere_radius)) continue;
+		set_id(handle_id_color, 1 + width*height + (int)pending_figures.size());
+		pending_figures.push_back(CI->figure);
+		pending_sites.push_back(CI->site);
+		draw(CI->mesh, 0, camera*CI->transformation, handle_v_vertices, handle_A);
+	}
+	program->release();
+	//< --------------------------------------------------------------
+	//> Read back the center pixel. ----------------------------------
+	if (use_pbo)
+	{
+		pbo.bind();
+		// With a pack buffer bound the last argument is an offset into it.
+		// The call returns at once.
+		gl->glReadPixels(REGION/2, REGION/2, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		pbo.release();
+	} else {
+		gl->glReadPixels(REGION/2, REGION/2, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+	}
+	fbo->release();
+	gl->glEnable(GL_DITHER);
+	//< --------------------------------------------------------------
+	pending = true;
+	pending_target.mouse_gl_x = mouse_gl_x;
+	pending_target.mouse_gl_y = mouse_gl_y;
+	pending_target.camera = snapshot->camera;
+	pending_target.board_revision = snapshot->board_revision;
+	pending_width = width;
+	pending_height = height;
+}
+
+void Gpu_picker::collect()
+{
+	if (!pending) return;
+	pending = false;
+	//> Fetch the pixel. ---------------------------------------------
+	if (use_pbo)
+	{
+		pbo.bind();
+		const unsigned char* mapped = (const unsigned char*)pbo.map(QOpenGLBuffer::ReadOnly);
+		if (mapped)
+		{
+			for (int k=0;k<4;k++) pixel[k] = mapped[k];
+			pbo.unmap();
+		} else {
+			for (int k=0;k<4;k++) pixel[k] = 0;
+		}
+		pbo.release();
+	}
+	int id = pixel[0] | (pixel[1] << 8) | (pixel[2] << 16);
+	//< --------------------------------------------------------------
+	//> Decode. ------------------------------------------------------
+	Hover_target target = pending_target;
+	target.board_pos = QPoint(-1,-1);
+	target.figure = 0;
+	int squares = pending_width*pending_height;
+	if (id > squares && id - squares - 1 < (int)pending_figures.size())
+	{
+		// Still alive as long as the board revision has not changed.
+		target.figure = const_cast<Figure*>(pending_figures[id-squares-1]);
+		target.board_pos = pending_sites[id-squares-1];
+	} else if (id > 0 && id <= squares) {
+		target.board_pos = QPoint((id-1)%pending_width, (id-1)/pending_width);
+	}
+	target.valid = true;
+	//< --------------------------------------------------------------
+	if (target.board_pos != result.board_pos || target.figure != result.figure) changed = true;
+	result = target;
+}
+
+void Gpu_picker::update(float mouse_gl_x, float mouse_gl_y, int viewport_width, int viewport_height,
+	Landscape* landscape, const Render_snapshot* snapshot)
+{
+	// The last pass was rendered an update ago. The GPU is done with it.
+	collect();
+	if (result.is_up_to_date(
+		mouse_gl_x, mouse_gl_y, snapshot->camera, snapshot->board_revision)) return;
+	render(mouse_gl_x, mouse_gl_y, viewport_width, viewport_height, landscape, snapshot);
+}
+
+bool Gpu_picker::get_target(float mouse_gl_x, float mouse_gl_y, const QMatrix4x4& camera,
+	uint board_revision, QPoint& board_pos, Figure*& figure)
+{
+	if (!result.is_up_to_date(mouse_gl_x, mouse_gl_y, camera, board_revision)) return false;
+	board_pos = result.board_pos;
+	figure = result.figure;
+	return true;
+}
+
+void Gpu_picker::invalidate()
+{
+	pending = false;
+	result = Hover_target();
+	changed = true;
+}
+
+bool Gpu_picker::has_changed()
+{
+	bool res = changed;
+	changed = false;
+	return res;
+}
+
+Gpu_picker::Gpu_picker(QOpenGLFunctions* gl, QOpenGLShaderProgram* program)
+	: pbo(QOpenGLBuffer::PixelPackBuffer)
+{
+	if (!gl || !program) throw "Null pointer encountered.";
+	if (!is_supported()) throw "Framebuffer objects are not supported by this context.";
+	this->gl = gl;
+	this->program = program;
+	this->fbo = new QOpenGLFramebufferObject(REGION, REGION, QOpenGLFramebufferObject::Depth);
+	//> Pixel buffer object if available. ----------------------------
+	QOpenGLContext* context = QOpenGLContext::currentContext();
+	QPair<int,int> version = context->format().version();
+	this->use_pbo = (version >= qMakePair(2,1) ||
+		context->hasExtension("GL_ARB_pixel_buffer_object")) && pbo.create();
+	if (use_pbo)
+	{
+		pbo.bind();
+		pbo.setUsagePattern(QOpenGLBuffer::StreamRead);
+		pbo.allocate(4);
+		pbo.release();
+	}
+	//< --------------------------------------------------------------
+	for (int k=0;k<4;k++) this->pixel[k] = 0;
+	this->pending = false;
+	this->pending_width = 0;
+	this->pending_height = 0;
+	this->changed = false;
+}
+
+Gpu_picker::~Gpu_picker()
+{
+	if (pbo.isCreated()) pbo.destroy();
+	delete fbo;
+}
+}
@@ -0,0 +1,187 @@
+/**
+ * Sentinel Gl -- an OpenGL based remake of the Firebird classic the Sentinel.
+ * Copyright (C) May 25th, 2015 Markus-Hermann Koch, mhk@markuskoch.eu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include "mesh_bvh.h"
+
+namespace display
+{
+namespace
+{
+/** Orders triangle indices by one coordinate of their centroids. */
+struct Centroid_less
+{
+	const vector<QVector3D>* centroids;
+	int axis;
+	bool operator()(int a, int b) const
+		{ return (*centroids)[a][axis] < (*centroids)[b][axis]; }
+};
+
+QVector3D min_3D(const QVector3D& a, const QVector3D& b)
+{
+	return QVector3D(std::min(a.x(),b.x()),std::min(a.y(),b.y()),std::min(a.z(),b.z()));
+}
+
+QVector3D max_3D(const QVector3D& a, const QVector3D& b)
+{
+	return QVector3D(std::max(a.x(),b.x()),std::max(a.y(),b.y()),std::max(a.z(),b.z()));
+}
+}
+
+void Mesh_bvh::build(const vector<QVector3D>& positions, const vector<GLushort>& elements)
+{
+	nodes.clear();
+	corners.clear();
+	if (elements.size()%3 != 0) throw "Mesh_bvh expects three elements per triangle.";
+	int n = elements.size()/3;
+	if (n == 0) return;
+	//> Per triangle corners and centroids. --------------------------
+	vector<QVector3D> tri_corners(3*n);
+	vector<QVector3D> centroids(n);
+	vector<int> order(n);
+	for (int j=0;j<n;j++)
+	{
+		for (int k=0;k<3;k++) tri_corners[3*j+k] = positions.at(elements[3*j+k]);
+		centroids[j] = (tri_corners[3*j] + tri_corners[3*j+1] + tri_corners[3*j+2]) / 3.f;
+		order[j] = j;
+	}
+	//< --------------------------------------------------------------
+	// A binary tree with leaves of at least one triangle has < 2n nodes.
+	nodes.reserve(2*n);
+	nodes.push_back(Node());
+	build_node(0, order, 0, n, centroids, tri_corners);
+	corners.reserve(3*n);
+	for (int j=0;j<n;j++)
+	{
+		for (int k=0;k<3;k++) corners.push_back(tri_corners[3*order[j]+k]);
+	}
+}
+
+void Mesh_bvh::build_node(int index, vector<int>& order, int first, int count,
+	const vector<QVector3D>& centroids, const vector<QVector3D>& tri_corners)
+{
+	//> Bounds of the triangles and of their centroids. --------------
+	QVector3D lo(FLT_MAX,FLT_MAX,FLT_MAX);
+	QVector3D hi(-FLT_MAX,-FLT_MAX,-FLT_MAX);
+	QVector3D c_lo = lo;
+	QVector3D c_hi = hi;
+	for (int j=first;j<first+count;j++)
+	{
+		for (int k=0;k<3;k++)
+		{
+			lo = min_3D(lo, tri_corners[3*order[j]+k]);
+			hi = max_3D(hi, tri_corners[3*order[j]+k]);
+		}
+		c_lo = min_3D(c_lo, centroids[order[j]]);
+		c_hi = max_3D(c_hi, centroids[order[j]]);
+	}
+	nodes[index].lo = lo;
+	nodes[index].hi = hi;
+	//< --------------------------------------------------------------
+	if (count <= LEAF_SIZE)
+	{
+		nodes[index].first = first;
+		nodes[index].count = count;
+		return;
+	}
+	//> Median split along the widest centroid extent. ---------------
+	QVector3D extent = c_hi - c_lo;
+	Centroid_less less;
+	less.centroids = &centroids;
+	less.axis = 0;
+	if (extent.y() > extent[less.axis]) less.axis = 1;
+	if (extent.z() > extent[less.axis]) less.axis = 2;
+	int half = count/2;
+	std::nth_element(order.begin()+first, order.begin()+first+half,
+		order.begin()+first+count, less);
+	//< --------------------------------------------------------------
+	int left = nodes.size();
+	nodes.push_back(Node());
+	nodes.push_back(Node());
+	nodes[index].first = left;
+	nodes[index].count = 0;
+	build_node(left, order, first, half, centroids, tri_corners);
+	build_node(left+1, order, first+half, count-half, centroids, tri_corners);
+}
+
+bool Mesh_bvh::intersects_box(const QVector3D& lo, const QVector3D& hi,
+	const QVector3D& origin, const QVector3D& inv_dir, float t_max)
+{
+	float t0 = 0;
+	float t1 = t_max;
+	for (int k=0;k<3;k++)
+	{
+		float near = (lo[k] - origin[k]) * inv_dir[k];
+		float far = (hi[k] - origin[k]) * inv_dir[k];
+		if (near > far) std::swap(near, far);
+		// NaN (0*inf) on a slab boundary compares false and changes nothing.
+		if (near > t0) t0 = near;
+		if (far < t1) t1 = far;
+		if (t0 > t1) return false;
+	}
+	return true;
+}
+
+bool Mesh_bvh::intersects_triangle(const QVector3D& a, const QVector3D& b,
+	const QVector3D& c, const QVector3D& origin, const QVector3D& dir, float t_max)
+{
+	QVector3D e1 = b - a;
+	QVector3D e2 = c - a;
+	QVector3D p = QVector3D::crossProduct(dir, e2);
+	float det = QVector3D::dotProduct(e1, p);
+	if (fabs(det) < 1e-12) return false; // Ray parallel to the triangle.
+	float inv_det = 1.f/det;
+	QVector3D s = origin - a;
+	float u = QVector3D::dotProduct(s, p) * inv_det;
+	if (u < 0 || u > 1) return false;
+	QVector3D q = QVector3D::crossProduct(s, e1);
+	float v = QVector3D::dotProduct(dir, q) * inv_det;
+	if (v < 0 || u + v > 1) return false;
+	float t = QVector3D::dotProduct(e2, q) * inv_det;
+	return t >= 0 && t <= t_max;
+}
+
+bool Mesh_bvh::intersects(const QVector3D& origin, const QVector3D& dir, float t_max) const
+{
+	if (nodes.empty()) return false;
+	QVector3D inv_dir(1.f/dir.x(), 1.f/dir.y(), 1.f/dir.z());
+	// The tree is balanced. Its depth is about log2(triangles/LEAF_SIZE).
+	int stack[64];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		const Node& node = nodes[stack[--top]];
+		if (!intersects_box(node.lo, node.hi, origin, inv_dir, t_max)) continue;
+		if (node.count > 0)
+		{
+			for (int j=node.first;j<node.first+node.count;j++)
+			{
+				if (intersects_triangle(corners[3*j], corners[3*j+1], corners[3*j+2],
+					origin, dir, t_max)) return true;
+			}
+		} else {
+			stack[top++] = node.first;
+			stack[top++] = node.first+1;
+		}
+	}
+	return false;
+}
+}
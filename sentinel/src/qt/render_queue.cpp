@@ -0,0 +1,274 @@
+/**
+ * Sentinel Gl -- an OpenGL based remake of the Firebird classic the Sentinel.
+ * Copyright (C) May 25th, 2015 Markus-Hermann Koch, mhk@markuskoch.eu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+#include <algorithm>
+#include "render_queue.h"
+#include "profiler.h"
+
+namespace display
+{
+bool Render_queue::State_less::operator()(int a, int b) const
+{
+	const Render_command& ca = (*commands)[a];
+	const Render_command& cb = (*commands)[b];
+	if (ca.pass != cb.pass) return ca.pass < cb.pass;
+	if (ca.pass == E_RENDER_PASS::BACKGROUND_PASS) return a < b;
+	if (ca.pass == E_RENDER_PASS::TRANSPARENT_PASS)
+	{
+		// Back to front.
+		if (ca.depth != cb.depth) return ca.depth > cb.depth;
+		return a < b;
+	}
+	if (ca.program != cb.program) return ca.program < cb.program;
+	if (ca.texture != cb.texture) return ca.texture < cb.texture;
+	if (ca.mesh != cb.mesh) return ca.mesh < cb.mesh;
+	if (ca.buf_vertices != cb.buf_vertices) return ca.buf_vertices < cb.buf_vertices;
+	return a < b;
+}
+
+void Render_queue::clear()
+{
+	commands.clear();
+	order.clear();
+}
+
+void Render_queue::add(Mesh_Data* mesh, QOpenGLShaderProgram* program,
+	const QMatrix4x4& transformation, float fade, QVector3D center,
+	QOpenGLBuffer* buf_vertices, float highlight)
+{
+	if (!mesh || !program) throw "Null pointer encountered.";
+	Render_command command;
+	command.mesh = mesh;
+	command.program = program;
+	command.texture = mesh->texture;
+	command.buf_vertices = buf_vertices ? buf_vertices : &(mesh->buf_vertices);
+	command.transformation = transformation;
+	command.fade = fade;
+	command.highlight = highlight;
+	command.pass = fade < 1 ? E_RENDER_PASS::TRANSPARENT_PASS : E_RENDER_PASS::OPAQUE_PASS;
+	command.center = center;
+	command.depth = 0;
+	order.push_back(commands.size());
+	commands.push_back(command);
+}
+
+void Render_queue::add_background(Mesh_Data* mesh, QOpenGLShaderProgram* program,
+	const QMatrix4x4& transformation, float fade)
+{
+	add(mesh, program, transformation, fade, QVector3D(0,0,0));
+	commands.back().pass = E_RENDER_PASS::BACKGROUND_PASS;
+}
+
+void Render_queue::sort(const QMatrix4x4& camera)
+{
+	// The w of the clip coordinates is the distance along the view.
+	QVector4D w_row = camera.row(3);
+	for (vector<Render_command>::iterator IT=commands.begin();IT!=commands.end();IT++)
+	{
+		if (IT->pass != E_RENDER_PASS::TRANSPARENT_PASS) continue;
+		IT->depth = QVector4D::dotProduct(w_row, QVector4D(IT->center, 1));
+	}
+	State_less less;
+	less.commands = &commands;
+	std::sort(order.begin(), order.end(), less);
+}
+
+Render_queue::Program_state* Render_queue::get_program_state(QOpenGLShaderProgram* program)
+{
+	for (vector<Program_state>::iterator IT=program_states.begin();IT!=program_states.end();IT++)
+	{
+		if (IT->program == program) return &(*IT);
+	}
+	Program_state state;
+	state.program = program;
+	state.handle_v_vertices = program->attributeLocation("v_vertices");
+	state.handle_v_normals = program->attributeLocation("v_normals");
+	state.handle_v_tex_coords = program->attributeLocation("v_tex_coords");
+	state.handle_v_vertex_colors = program->attributeLocation("v_vertex_colors");
+	if (state.handle_v_vertex_colors < 0) state.handle_v_vertex_colors = program->attributeLocation("v_colors");
+	state.handle_pos_light = program->uniformLocation("pos_light");
+	state.handle_color_light = program->uniformLocation("color_light");
+	state.handle_ambience = program->uniformLocation("ambience");
+	state.handle_fade = program->uniformLocation("fade");
+	state.handle_A = program->uniformLocation("A");
+	state.handle_B = program->uniformLocation("B");
+	// Never changes. Hence set once while the program is bound.
+	program->setUniformValue("texture", 0);
+	state.lighting_frame = frame - 1;
+	state.highlight = -1;
+	state.fade = -1;
+	program_states.push_back(state);
+	return &(program_states.back());
+}
+
+void Render_queue::submit(QOpenGLFunctions* gl, const QMatrix4x4& camera,
+	const Render_lighting& lighting)
+{
+	Timing_zone timing(E_TIMING_ZONE::SUBMIT_DRAWS);
+	frame++;
+	stats.draws = 0;
+	stats.blended = 0;
+	stats.programs = 0;
+	stats.textures = 0;
+	stats.vertex_buffers = 0;
+	stats.uniforms = 0;
+	//> Currently bound. ---------------------------------------------
+	QOpenGLShaderProgram* program = 0;
+	Program_state* state = 0;
+	QOpenGLTexture* texture = 0;
+	Mesh_Data* mesh = 0;
+	QOpenGLBuffer* buf_vertices = 0;
+	E_RENDER_PASS pass = E_RENDER_PASS::BACKGROUND_PASS;
+	bool blend = true;
+	// The context comes with blending enabled. Opaque commands turn it off.
+	gl->glEnable(GL_BLEND);
+	//< --------------------------------------------------------------
+	for (vector<int>::const_iterator CI=order.begin();CI!=order.end();CI++)
+	{
+		const Render_command& command = commands[*CI];
+		//> Blending and depth writes. -------------------------------
+		bool command_blend = command.pass == E_RENDER_PASS::TRANSPARENT_PASS ||
+			(command.pass == E_RENDER_PASS::BACKGROUND_PASS && command.fade < 1);
+		if (command_blend != blend)
+		{
+			if (command_blend) { gl->glEnable(GL_BLEND); } else { gl->glDisable(GL_BLEND); }
+			blend = command_blend;
+		}
+		if (command.pass != pass && command.pass == E_RENDER_PASS::TRANSPARENT_PASS)
+		{
+			// Sorted back to front. Nothing behind is to be hidden by it.
+			gl->glDepthMask(GL_FALSE);
+		}
+		pass = command.pass;
+		if (blend) stats.blended++;
+		//< ----------------------------------------------------------
+		//> Program and the per frame constants. ---------------------
+		if (command.program != program)
+		{
+			if (state)
+			{
+				program->disableAttributeArray(state->handle_v_vertex_colors);
+				program->disableAttributeArray(state->handle_v_tex_coords);
+				program->disableAttributeArray(state->handle_v_normals);
+				program->disableAttributeArray(state->handle_v_vertices);
+			}
+			program = command.program;
+			program->bind();
+			state = get_program_state(program);
+			program->enableAttributeArray(state->handle_v_vertices);
+			program->enableAttributeArray(state->handle_v_normals);
+			program->enableAttributeArray(state->handle_v_tex_coords);
+			program->enableAttributeArray(state->handle_v_vertex_colors);
+			if (state->lighting_frame != frame)
+			{
+				program->setUniformValue(state->handle_pos_light, lighting.position);
+				program->setUniformValue(state->handle_ambience, lighting.ambience);
+				stats.uniforms += 2;
+				state->lighting_frame = frame;
+				// The color carries the highlight. Sent with the next draw.
+				state->highlight = -1;
+			}
+			// The attributes of the new program still need to be pointed
+			// at the vertex buffer.
+			buf_vertices = 0;
+			stats.programs++;
+		}
+		//< ----------------------------------------------------------
+		//> Texture. -------------------------------------------------
+		if (command.texture != texture)
+		{
+			if (command.texture) { command.texture->bind(); } else { texture->release(); }
+			texture = command.texture;
+			stats.textures++;
+		}
+		//< ----------------------------------------------------------
+		//> Elements and vertices. -----------------------------------
+		if (command.mesh != mesh)
+		{
+			command.mesh->buf_elements.bind();
+			mesh = command.mesh;
+		}
+		if (command.buf_vertices != buf_vertices)
+		{
+			buf_vertices = command.buf_vertices;
+			buf_vertices->bind();
+			// Offsets of the members of Vertex_Data.
+			quintptr offset = 0;
+			program->setAttributeBuffer(
+				state->handle_v_vertices, GL_FLOAT, offset, 4, sizeof(Vertex_Data));
+			offset += sizeof(QVector4D);
+			program->setAttributeBuffer(
+				state->handle_v_normals, GL_FLOAT, offset, 3, sizeof(Vertex_Data));
+			offset += sizeof(QVector3D);
+			program->setAttributeBuffer(
+				state->handle_v_tex_coords, GL_FLOAT, offset, 2, sizeof(Vertex_Data));
+			offset += sizeof(QVector2D);
+			program->setAttributeBuffer(
+				state->handle_v_vertex_colors, GL_FLOAT, offset, 4, sizeof(Vertex_Data));
+			stats.vertex_buffers++;
+		}
+		//< ----------------------------------------------------------
+		//> Per draw uniforms and draw. ------------------------------
+		if (command.highlight != state->highlight)
+		{
+			program->setUniformValue(state->handle_color_light, lighting.color*command.highlight);
+			state->highlight = command.highlight;
+			stats.uniforms++;
+		}
+		if (command.fade != state->fade)
+		{
+			program->setUniformValue(state->handle_fade, command.fade);
+			state->fade = command.fade;
+			stats.uniforms++;
+		}
+		program->setUniformValue(state->handle_A, camera * command.transformation);
+		program->setUniformValue(state->handle_B, command.transformation.normalMatrix());
+		stats.uniforms += 2;
+		gl->glDrawElements(command.mesh->draw_mode, command.mesh->elements.size(),
+			GL_UNSIGNED_SHORT, 0);
+		stats.draws++;
+		//< ----------------------------------------------------------
+	}
+	//> Leave nothing bound. -----------------------------------------
+	if (state)
+	{
+		program->disableAttributeArray(state->handle_v_vertex_colors);
+		program->disableAttributeArray(state->handle_v_tex_coords);
+		program->disableAttributeArray(state->handle_v_normals);
+		program->disableAttributeArray(state->handle_v_vertices);
+		program->release();
+	}
+	if (buf_vertices) buf_vertices->release();
+	if (texture) texture->release();
+	if (mesh) mesh->buf_elements.release();
+	if (!blend) gl->glEnable(GL_BLEND);
+	if (pass == E_RENDER_PASS::TRANSPARENT_PASS) gl->glDepthMask(GL_TRUE);
+	//< --------------------------------------------------------------
+}
+
+Render_queue::Render_queue()
+{
+	this->stats.draws = 0;
+	this->stats.blended = 0;
+	this->stats.programs = 0;
+	this->stats.textures = 0;
+	this->stats.vertex_buffers = 0;
+	this->stats.uniforms = 0;
+	this->frame = 0;
+}
+}
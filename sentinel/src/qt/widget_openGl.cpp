@@ -20,7 +20,10 @@
 #include <QSurfaceFormat>
 #include <QOpenGLShader>
 #include <QFileInfo>
+#include <QMutexLocker>
+#include <QPainter>
 #include "widget_openGl.h"
+#include "profiler.h"
 #include "config.h"
 
 using std::stringstream;
@@ -35,6 +38,8 @@ namespace {	bool pause_light_active = false; }
 void Widget_OpenGl::display_pause_game()
 {
 	if (!game) return;
+	if (simulation) simulation->set_paused(is_paused());
+	QMutexLocker locker(game->get_mutex());
 	QVector4D light_pause(.9,.8,1.3,1);
 	ostringstream oss;
 	if (is_user_paused || is_auto_paused)
@@ -74,34 +79,34 @@ bool Widget_OpenGl::is_paused()
 }
 
 Mesh_Data* Widget_OpenGl::get_mesh_data_connection()
-	{ return objects.at(get_scenery_resource_string("sq_connection",scenery)); }
+	{ return objects.get(scenery_meshes.at(scenery).sq_connection); }
 
 Mesh_Data* Widget_OpenGl::get_mesh_data_odd()
-	{ return objects.at(get_scenery_resource_string("sq_odd",scenery)); }
+	{ return objects.get(scenery_meshes.at(scenery).sq_odd); }
 
 Mesh_Data* Widget_OpenGl::get_mesh_data_even()
-	{ return objects.at(get_scenery_resource_string("sq_even",scenery)); }
+	{ return objects.get(scenery_meshes.at(scenery).sq_even); }
 
 Mesh_Data* Widget_OpenGl::get_mesh_data_tree()
-	{ return objects.at(get_scenery_resource_string("tree",scenery)); }
+	{ return objects.get(scenery_meshes.at(scenery).tree); }
 
 Mesh_Data* Widget_OpenGl::get_mesh_data_sentinel_tower()
-	{ return objects.at(get_scenery_resource_string("tower",scenery)); }
+	{ return objects.get(scenery_meshes.at(scenery).tower); }
 	
 Mesh_Data* Widget_OpenGl::get_mesh_data_sentinel()
-	{ return objects.at("sentinel"); }
+	{ return objects.get("sentinel"); }
 
 Mesh_Data* Widget_OpenGl::get_mesh_data_sentry()
-	{ return objects.at("sentry"); }
+	{ return objects.get("sentry"); }
 
 Mesh_Data* Widget_OpenGl::get_mesh_data_robot()
-	{ return objects.at("robot"); }
+	{ return objects.get("robot"); }
 	
 Mesh_Data* Widget_OpenGl::get_mesh_data_block()
-	{ return objects.at("block"); }
+	{ return objects.get("block"); }
 	
 Mesh_Data* Widget_OpenGl::get_mesh_data_meanie()
-	{ return objects.at("meanie"); }
+	{ return objects.get("meanie"); }
 
 //> Constructor and Destructor. --------------------------------------
 Widget_OpenGl::Widget_OpenGl(QWidget* parent, Qt::WindowFlags flags)
@@ -109,6 +114,15 @@ Widget_OpenGl::Widget_OpenGl(QWidget* parent, Qt::WindowFlags flags)
 {
 	this->io = 0;
 	this->game = 0;
+	this->simulation = 0;
+	this->hover_picker = 0;
+	this->gpu_picker = 0;
+	this->use_gpu_picking = false;
+	this->show_timing_overlay = false;
+	this->pending_zoom = 0;
+	this->pending_zoom_reset = false;
+	this->pending_u_turn = false;
+	this->is_snapshot_stale = false;
 	this->is_auto_paused = false;
 	this->is_user_paused = false;
 	this->do_repaint = true;
@@ -129,11 +143,24 @@ Widget_OpenGl::Widget_OpenGl(QWidget* parent, Qt::WindowFlags flags)
 
 Widget_OpenGl::~Widget_OpenGl()
 {
+	// The simulation thread publishes snapshots from the meshes and the
+	// hover thread casts rays against them. Hence both stop before
+	// anything is freed.
+	if (io) io->println(E_DEBUG_LEVEL::VERBOSE, "~Widget_OpenGl()",	"Stopping the simulation thread.");
+	delete simulation;
+	if (io) io->println(E_DEBUG_LEVEL::VERBOSE, "~Widget_OpenGl()",	"Stopping the hover thread.");
+	delete hover_picker;
+
+	// GL resources are released with the context current. The picker's
+	// framebuffer and pixel buffer go first. Its program is among this->programs.
+	makeCurrent();
+	if (io) io->println(E_DEBUG_LEVEL::VERBOSE, "~Widget_OpenGl()",	"Deleting the GPU picker.");
+	delete gpu_picker;
 	if (io) io->println(E_DEBUG_LEVEL::VERBOSE, "~Widget_OpenGl()",	"Deleting glsl programs.");
-	for (map<string,QOpenGLShaderProgram*>::iterator IT = programs.begin();
-		IT != programs.end(); ++IT)
+	for (vector<QOpenGLShaderProgram*>::const_iterator CI = programs.get_items().begin();
+		CI != programs.get_items().end(); ++CI)
 	{
-		delete (IT->second);
+		delete (*CI);
 	}
 	if (io) io->println(E_DEBUG_LEVEL::VERBOSE, "~Widget_OpenGl()",	"Deleting glsl shaders.");
 	for (vector<QOpenGLShader*>::iterator IT=shaders.begin();IT!=shaders.end();++IT)
@@ -143,11 +170,14 @@ Widget_OpenGl::~Widget_OpenGl()
 	//// Texture deletion is apparently not important:
     //// http://stackoverflow.com/questions/12403688/not-deleting-texture-memory-in-opengl
 	//if (io) io->println(E_DEBUG_LEVEL::VERBOSE, "~Widget_OpenGl()",	"Deleting textures.");
-	//for (map<string, QOpenGLTexture*>::iterator IT=textures.begin(); IT!=textures.end(); ++IT)
-	//  { delete (IT->second); }
+	//for (vector<QOpenGLTexture*>::const_iterator CI=textures.get_items().begin();
+	//	CI!=textures.get_items().end(); ++CI)
+	//  { delete (*CI); }
 	if (io) io->println(E_DEBUG_LEVEL::VERBOSE, "~Widget_OpenGl()",	"Deleting 3D objects.");
-	for (map<string, Mesh_Data*>::iterator IT=objects.begin(); IT!=objects.end(); ++IT)
-	  { delete (IT->second); }
+	for (vector<Mesh_Data*>::const_iterator CI=objects.get_items().begin();
+		CI!=objects.get_items().end(); ++CI)
+	  { delete (*CI); }
+	doneCurrent();
 
 	if (io) io->println(E_DEBUG_LEVEL::VERBOSE, "~Widget_OpenGl()",	"Deleting framerate timer.");
 	if (timer_framerate)
@@ -261,8 +291,9 @@ bool Widget_OpenGl::compile_programs()
 			return false;
 		}
 		string src_fragment = IT_F->second;
-		programs[key] = new QOpenGLShaderProgram(this);
-		if (compile_single_program(programs[key], key, src_vertex, src_fragment))
+		QOpenGLShaderProgram* program = new QOpenGLShaderProgram(this);
+		programs.add(key, program);
+		if (compile_single_program(program, key, src_vertex, src_fragment))
 		{
 			ostringstream oss;
 			oss << "Successfully buildt program '" << key << "'.";
@@ -294,7 +325,7 @@ bool Widget_OpenGl::load_textures()
 		texture->setMinificationFilter(QOpenGLTexture::Nearest);
 		texture->setMagnificationFilter(QOpenGLTexture::Linear);
 		texture->setWrapMode(QOpenGLTexture::Repeat);
-		this->textures[key] = texture;
+		this->textures.add(key, texture);
 	}
 	ostringstream oss;
 	oss << "Done loading " << textures.size() << " textures.";
@@ -322,6 +353,7 @@ Mesh_Data* Widget_OpenGl::build_standard_object(string pfname_obj, string progra
 	}
 	object->draw_mode = GL_TRIANGLES;
 	object->program_name = program_name;
+	object->program = programs.get_handle(program_name);
 	object->texture = texture;
 	if (do_transfer_to_GPU) object->transfer_vertices_and_elements_to_GPU();
 	return object;
@@ -368,66 +400,68 @@ Known_Texture_Resources::Known_Texture_Resources()
 bool Widget_OpenGl::initialize_objects()
 {
 	Known_Sceneries scs;
+	scenery_meshes.resize(Known_Sceneries::number_of_known_sceneries());
 	for (vector<E_SCENERY>::const_iterator CI=scs.get_sceneries()->begin();
 		CI!=scs.get_sceneries()->end();CI++)
 	{
 	string scrs;
 	E_SCENERY sc = *CI;
+	Scenery_meshes& meshes = scenery_meshes.at(sc);
 	//>> The Sky Dome. -----------------------------------------------
 	scrs = get_scenery_resource_string("sky",sc);
-	objects[scrs] = build_standard_object(
-		":/blender/sky_dome.obj", "sky", textures.at(scrs), true);
+	meshes.sky = objects.add(scrs, build_standard_object(
+		":/blender/sky_dome.obj", "sky", textures.get(scrs), true));
 	//<< -------------------------------------------------------------
 	//>> The foundation plane of the thunder dome. -------------------
 	scrs = get_scenery_resource_string("foundation",sc);
-	objects[scrs] = build_standard_object(
-		":/blender/plane.obj", "terrain", textures.at(scrs), true);
+	meshes.foundation = objects.add(scrs, build_standard_object(
+		":/blender/plane.obj", "terrain", textures.get(scrs), true));
 	//<< -------------------------------------------------------------
 	//>> A granite rock wall. ----------------------------------------
 	scrs = get_scenery_resource_string("sq_connection",sc);
-	objects[scrs] = build_standard_object(
-		":/blender/plane.obj", "terrain", textures.at(scrs), true);
+	meshes.sq_connection = objects.add(scrs, build_standard_object(
+		":/blender/plane.obj", "terrain", textures.get(scrs), true));
 	//<< -------------------------------------------------------------
 	//>> A light square. ---------------------------------------------
 	scrs = get_scenery_resource_string("sq_odd",sc);
-	objects[scrs] = build_standard_object(
-		":/blender/plane.obj", "terrain", textures.at(scrs), true);
+	meshes.sq_odd = objects.add(scrs, build_standard_object(
+		":/blender/plane.obj", "terrain", textures.get(scrs), true));
 	//<< -------------------------------------------------------------
 	//>> A dark square. ----------------------------------------------
 	scrs = get_scenery_resource_string("sq_even",sc);
-	objects[scrs] = build_standard_object(
-		":/blender/plane.obj", "terrain", textures.at(scrs), true);
+	meshes.sq_even = objects.add(scrs, build_standard_object(
+		":/blender/plane.obj", "terrain", textures.get(scrs), true));
 	//<< -------------------------------------------------------------
 	//>> Tree. -------------------------------------------------------
 	scrs = get_scenery_resource_string("tree",sc);
-	objects[scrs] = build_standard_object(
-		":/blender/"+scrs+".obj", "terrain", textures.at(scrs), true);
+	meshes.tree = objects.add(scrs, build_standard_object(
+		":/blender/"+scrs+".obj", "terrain", textures.get(scrs), true));
 	//<< -------------------------------------------------------------
 	//>> Sentinel Tower. ---------------------------------------------
 	scrs = get_scenery_resource_string("tower",sc);
-	objects[scrs] = build_standard_object(":/blender/tower.obj",
-		"terrain", textures.at(scrs), true);
+	meshes.tower = objects.add(scrs, build_standard_object(":/blender/tower.obj",
+		"terrain", textures.get(scrs), true));
 	//<< -------------------------------------------------------------
 	}
 	//>> Block. ------------------------------------------------------
-	objects["block"] = build_standard_object(":/blender/block.obj",
-		"terrain", textures.at("block"), true);
+	objects.add("block", build_standard_object(":/blender/block.obj",
+		"terrain", textures.get("block"), true));
 	//<< -------------------------------------------------------------
 	//>> Robot. ------------------------------------------------------
-	objects["robot"] = build_standard_object(":/blender/robot.obj",
-		"terrain", textures.at("robot"), true);
+	objects.add("robot", build_standard_object(":/blender/robot.obj",
+		"terrain", textures.get("robot"), true));
 	//<< -------------------------------------------------------------
 	//>> Meanie. -----------------------------------------------------
-	objects["meanie"] = build_standard_object(":/blender/meanie.obj",
-		"terrain", textures.at("meanie"), true);
+	objects.add("meanie", build_standard_object(":/blender/meanie.obj",
+		"terrain", textures.get("meanie"), true));
 	//<< -------------------------------------------------------------
 	//>> Sentry. -----------------------------------------------------
-	objects["sentry"] = build_standard_object(":/blender/sentry.obj",
-		"terrain", textures.at("sentry"), true);
+	objects.add("sentry", build_standard_object(":/blender/sentry.obj",
+		"terrain", textures.get("sentry"), true));
 	//<< -------------------------------------------------------------
 	//>> The Sentinel. -----------------------------------------------
-	objects["sentinel"] = build_standard_object(":/blender/sentinel.obj",
-		"terrain", textures.at("sentinel"), true);
+	objects.add("sentinel", build_standard_object(":/blender/sentinel.obj",
+		"terrain", textures.get("sentinel"), true));
 	//<< -------------------------------------------------------------
 	return true;
 }
@@ -467,28 +501,6 @@ void Widget_OpenGl::set_context_to_default_state()
 	}
 }
 
-float Widget_OpenGl::plop_fct(float x)
-{
-	float y = 0;
-	if (x < 0)
-	{
-		y = 0;
-	} else if (x < .5)
-	{
-		y = x*x; // parable up to y=.25
-	} else if (x< .65)
-	{
-		// parable matching first section and running up to 1.3.
-		y = 43.333*x*x - 42.833*x + 10.833;
-	} else if (x<1.0)
-	{
-		y = 2.4490*x*x - 4.8980*x + 3.4490;
-	} else {
-		y = 1.0;
-	}
-	return y;
-}
-
 void Widget_OpenGl::clear_screen(QVector4D color)
 {
 	glClearColor(color.x(), color.y(), color.z(), color.w());
@@ -510,244 +522,77 @@ Viewer_Data* Widget_OpenGl::get_viewer_data()
 	return vd;
 }
 
-void Widget_OpenGl::draw_terrain_object(Mesh_Data* object, QMatrix4x4& camera,
-	QMatrix4x4& trans_rot_object, float fade, QOpenGLBuffer* buf_vertices)
+void Widget_OpenGl::queue_dome(float fade)
 {
-	object->buf_elements.bind();
-	if (object->texture) object->texture->bind();
-	if (buf_vertices) { buf_vertices->bind(); } else { object->buf_vertices.bind(); }
-	QOpenGLShaderProgram* program = programs.at(object->program_name);
-	program->bind();
-	program->setUniformValue("texture", 0);
-	
-    int handle_v_vertices = program->attributeLocation("v_vertices");
-	int handle_v_normals = program->attributeLocation("v_normals");
-    int handle_v_tex_coords = program->attributeLocation("v_tex_coords");
-	int handle_v_vertex_colors = program->attributeLocation("v_vertex_colors");
-	int handle_pos_light = program->uniformLocation("pos_light");
-	int handle_color_light = program->uniformLocation("color_light");
-	int handle_ambience = program->uniformLocation("ambience");
-	int handle_fade = program->uniformLocation("fade");
-	int handle_A = program->uniformLocation("A");
-	int handle_B = program->uniformLocation("B");
-	
-	// Vertices.
-	quintptr offset = 0;
-	program->enableAttributeArray(handle_v_vertices);
-	program->setAttributeBuffer(
-		handle_v_vertices, GL_FLOAT, offset, 4, sizeof(Vertex_Data));
-	
-	// Normal vectors.
-	offset += sizeof(QVector4D);
-	program->enableAttributeArray(handle_v_normals);
-	program->setAttributeBuffer(
-		handle_v_normals, GL_FLOAT, offset, 3, sizeof(Vertex_Data));
-	
-	// Tex coords.
-	offset += sizeof(QVector3D);
-    program->enableAttributeArray(handle_v_tex_coords);
-    program->setAttributeBuffer(
-		handle_v_tex_coords, GL_FLOAT, offset, 2, sizeof(Vertex_Data));
-	
-	// Vertex colors.
-	offset += sizeof(QVector2D);
-	program->enableAttributeArray(handle_v_vertex_colors);
-	program->setAttributeBuffer(
-		handle_v_vertex_colors, GL_FLOAT, offset, 4, sizeof(Vertex_Data));
-	
-	QMatrix4x4 A = camera * trans_rot_object;
-	QMatrix3x3 B = trans_rot_object.normalMatrix();
-
-	program->setUniformValue(handle_pos_light, light_position);
-	program->setUniformValue(handle_color_light, light_color*light_brightness*light_filtering_factor);
-	program->setUniformValue(handle_ambience, light_ambience);
-	program->setUniformValue(handle_fade, fade);
-	program->setUniformValue(handle_A, A);
-	program->setUniformValue(handle_B, B);
-
-    // Draw cube geometry using indices from VBO 1
-    glDrawElements(
-		object->draw_mode, // Element ordering. Here probably GL_TRIANGLES.
-		object->elements.size(), // #elements withinin the bound index buffer.
-		GL_UNSIGNED_SHORT, 0);
-
-	program->disableAttributeArray(handle_v_vertex_colors);
-	program->disableAttributeArray(handle_v_tex_coords);
-	program->disableAttributeArray(handle_v_normals);
-	program->disableAttributeArray(handle_v_vertices);
-	program->release();
-
-	if (buf_vertices) { buf_vertices->release(); } else { object->buf_vertices.release(); }
-	if (object->texture) object->texture->release();
-	object->buf_elements.release();
-}
-
-void Widget_OpenGl::draw_square(Square* sq, QMatrix4x4& camera, float fade)
-{
-	if (sq == 0) throw "0 pointer square encountered!";
-	Mesh_Data* mesh = sq->get_mesh_prototype();
-	QMatrix4x4 trans_rot; trans_rot.setToIdentity(); // The mesh is in world coordinates.
-	draw_terrain_object(mesh, camera, trans_rot, fade, &(sq->buf_vertices));
-}
-
-void Widget_OpenGl::draw_dome(QMatrix4x4& camera, float fade)
-{
-	//> Draw the sky dome itself. ------------------------------------
-	Mesh_Data* sky = objects.at(get_scenery_resource_string("sky", scenery));
-	sky->bind();
-    // Offset for position of each data type within Vertex_Data.
-	QOpenGLShaderProgram* program = programs.at(sky->program_name);
-	program->bind();
-    quintptr offset = 0;
-	program->setUniformValue("texture", 0);
-    // Tell OpenGL programmable pipeline how to locate vertex position data
-    int handle_v_vertices = program->attributeLocation("v_vertices");
-    int handle_v_tex_coords = program->attributeLocation("v_tex_coords");
-	int handle_v_colors = program->attributeLocation("v_colors");
-	int handle_A = program->uniformLocation("A");
-	int handle_color_light = program->uniformLocation("color_light");
-	int handle_fade = program->uniformLocation("fade");
-	
-	// Assigning the vertices to the vertex shader.
-    program->enableAttributeArray(handle_v_vertices);
-    program->setAttributeBuffer(
-		handle_v_vertices, // handle of the target attribute within the vertex shader.
-		GL_FLOAT, // type of data.
-		offset, // Offset within the Vertex_Data block seen from the start.
-		4, // Size of a single vertex.
-		sizeof(Vertex_Data) // Size of a single Vertex_Data block.
-	);
-
-	// Assigning the texture coordinates to the vertex shader.
-    // Offset for texture coordinates -- they come behind the vec4 vertices
-	// and behind the vec3 normal vectors.
-    offset += sizeof(QVector4D) + sizeof(QVector3D);
-    program->enableAttributeArray(handle_v_tex_coords);
-    program->setAttributeBuffer(
-		handle_v_tex_coords,
-		GL_FLOAT,
-		offset,
-		2,
-		sizeof(Vertex_Data)
-	);
-	// Assigning the vertex colors to the vertex shader.
-	offset += sizeof(QVector2D);
-	program->enableAttributeArray(handle_v_colors);
-	program->setAttributeBuffer(
-		handle_v_colors,
-		GL_FLOAT,
-		offset,
-		4,
-		sizeof(Vertex_Data)
-	);
-	
-	QMatrix4x4 A = camera;
-	A.translate(0,0,-.01);
-
 	float radius = game ? (2.*game->get_landscape()->get_board_diagonal_length()) : 0.;
-	A.scale(radius);
-	program->setUniformValue(handle_A, A);
-
-	// Assigning the light color.
-	program->setUniformValue(handle_color_light, light_color*light_brightness*light_filtering_factor);
-
-	program->setUniformValue(handle_fade, fade);
-	
-    // Draw cube geometry using indices from VBO 1
-    glDrawElements(
-		sky->draw_mode, // Element ordering. Here probably GL_TRIANGLES.
-		sky->elements.size(), // #elements withinin the bound index buffer.
-		GL_UNSIGNED_SHORT,
-		0
-	);
-	
-	program->disableAttributeArray(handle_v_tex_coords);
-	program->disableAttributeArray(handle_v_vertices);
-	program->release();
-	sky->release();
+	//> The sky dome itself. -----------------------------------------
+	const Scenery_meshes& meshes = scenery_meshes.at(scenery);
+	Mesh_Data* sky = objects.get(meshes.sky);
+	QMatrix4x4 A;
+	A.setToIdentity(); A.translate(0,0,-.01); A.scale(radius);
+	render_queue.add_background(sky, programs.get(sky->program), A, fade);
 	//< --------------------------------------------------------------
-	//> Draw the base of the thunderdome. ----------------------------
+	//> The base of the thunderdome. ---------------------------------
+	Mesh_Data* foundation = objects.get(meshes.foundation);
 	A.setToIdentity(); A.translate(0,0,-.01); A.scale(radius*2);
-	draw_terrain_object(objects.at(
-		get_scenery_resource_string("foundation", scenery)),
-		camera,
-		A,
-		fade
-	);
+	render_queue.add_background(foundation, programs.get(foundation->program), A, fade);
 	//< --------------------------------------------------------------
 }
 					
-float Widget_OpenGl::get_appropriate_scale(Figure* figure)
-{
-	/** Never shrink the Sentinel! */
-	if (figure->get_type()==E_FIGURE_TYPE::SENTINEL) return 1.0;
-	E_MATTER_STATE state = figure->get_state();
-	float scale = 1.0;
-	float fade = figure->get_fade();
-	switch (state)
-	{
-		case E_MATTER_STATE::STABLE: scale = 1.0; break;
-		case E_MATTER_STATE::MANIFESTING: // Fall-through
-		case E_MATTER_STATE::TRANSMUTING: scale = plop_fct(fade); break;
-		case E_MATTER_STATE::DISINTEGRATING: scale = fade; break;
-		case E_MATTER_STATE::GONE: scale = 0.0; break;
-		default: break;
-	}
-	return scale;
-}
-
 void Widget_OpenGl::draw_landscape(float fade)
 {
+	Timing_zone timing(E_TIMING_ZONE::DRAW_LANDSCAPE);
 	if (!game) return;
 	Landscape* ls = game->get_landscape();
 	if (!ls) throw "Landscape is still a 0 pointer";
 	int width = ls->get_board_sq()->get_width();
 	int height = ls->get_board_sq()->get_height();
-	QPoint player_site = game->get_player()->get_site();
-	QMatrix4x4 camera = game->get_player()->get_viewer_data()->get_camera();
-
-	draw_dome(camera,fade); 
-
+	// The board squares never change. The figures do. They are taken from
+	// the latest snapshot the simulation has published.
+	const Render_snapshot* snapshot = game->get_snapshots()->get_front();
+	// Either a figure or a square is highlighted. Never both.
+	QPoint hover_square(-1,-1);
+	const Figure* hover_figure = 0;
+	if (hover_picker)
+	{
+		Hover_target hover = (use_gpu_picking && gpu_picker) ?
+			gpu_picker->get_latest() : hover_picker->get_latest();
+		hover_figure = hover.figure;
+		if (!hover_figure) hover_square = hover.board_pos;
+	}
+	//> Build the command list. --------------------------------------
+	render_queue.clear();
+	queue_dome(fade);
+	QMatrix4x4 identity; identity.setToIdentity(); // Squares are in world coordinates.
 	for (int x=0;x<width;x++)
 	{
 		for (int y=0;y<height;y++)
 		{
 			Square* sq = ls->get_board_sq()->get(x,y);
-			draw_square(sq,camera,fade);
-			Figure* fg = game->get_board_fg()->get(x,y);
-			if (fg)
-			{
-				vector<Figure*> fgs = fg->get_above_figure_stack();
-				QMatrix4x4 A; A.setToIdentity();
-				A.translate(x,y,sq->get_altitude());
-				for (vector<Figure*>::const_iterator CI=fgs.begin();CI!=fgs.end();CI++)
-				{
-					Figure* f = *CI;
-					if (
-						game->get_status() != E_GAME_STATUS::SURVEY &&
-						player_site.x() == x && player_site.y() == y &&
-						f->get_type()==E_FIGURE_TYPE::ROBOT
-					) continue; // Don't draw self unless in SURVEY mode.
-					// B: tranlate*rotate*scale for the object.
-					QMatrix4x4 B = A;
-					B.rotate(f->get_phi(),QVector3D(0,0,1));
-					float scale = get_appropriate_scale(f);
-					B.scale(scale);
-					draw_terrain_object(f->get_mesh_prototype(),camera,B,f->get_fade()*fade);
-					if (f->get_state()==E_MATTER_STATE::TRANSMUTING && scale > 0)
-					{
-						float old_mesh_fade = 1-f->get_fade();
-						B.scale(old_mesh_fade/scale);
-						Mesh_Data* old_mesh = f->get_old_mesh();
-						if (old_mesh)
-							draw_terrain_object(old_mesh,camera,B,old_mesh_fade*fade);
-					}
-					// The next figure in the stack will be on the new figure.
-					A.translate(QVector3D(0,0,Figure::get_height(f->get_type())));
-				}
-			}
+			if (sq == 0) throw "0 pointer square encountered!";
+			Mesh_Data* mesh = sq->get_mesh_prototype();
+			float highlight = hover_square == QPoint(x,y) ? HOVER_HIGHLIGHT : 1.;
+			render_queue.add(mesh, programs.get(mesh->program), identity, fade, sq->bounds.sphere_center,
+				&(sq->buf_vertices), highlight);
 		}
 	}
+	const View_frustum& frustum = snapshot->frustum;
+	for (vector<Figure_snapshot>::const_iterator CI=snapshot->figures.begin();
+		CI!=snapshot->figures.end();CI++)
+	{
+		if (frustum.is_outside(CI->bounds.sphere_center, CI->bounds.sphere_radius)) continue;
+		float highlight = (hover_figure && CI->figure == hover_figure) ? HOVER_HIGHLIGHT : 1.;
+		render_queue.add(CI->mesh, programs.get(CI->mesh->program),
+			CI->transformation, CI->fade*fade, CI->bounds.sphere_center, 0, highlight);
+	}
+	render_queue.sort(snapshot->camera);
+	//< --------------------------------------------------------------
+	//> Submit it. ---------------------------------------------------
+	Render_lighting lighting;
+	lighting.position = light_position;
+	lighting.color = light_color*light_brightness*light_filtering_factor;
+	lighting.ambience = light_ambience;
+	render_queue.submit(this, snapshot->camera, lighting);
 	//< --------------------------------------------------------------
 }
 
@@ -798,6 +643,15 @@ void Widget_OpenGl::initializeGL()
 		disable_program("Critical: Unable to initialize game resources. See console error messages for details.");
 	}
 	//< --------------------------------------------------------------
+	//> Picking on the GPU if possible. ------------------------------
+	if (initializeGL_ok && Gpu_picker::is_supported())
+	{
+		gpu_picker = new Gpu_picker(this, programs.get("pick_id"));
+	} else {
+		if (io) io->println(E_DEBUG_LEVEL::VERBOSE, "initializeGL()",
+			"No framebuffer objects. Picking on the CPU only.");
+	}
+	//< --------------------------------------------------------------
 	//> Setting up the update timer. ---------------------------------
     timer_framerate->start(1000./framerate);
 	//< --------------------------------------------------------------
@@ -812,11 +666,39 @@ void Widget_OpenGl::resizeGL(int width, int height)
 void Widget_OpenGl::paintGL()
 {
 	if (!(do_repaint && initializeGL_ok && game)) { return; }
+	Timing_zone timing(E_TIMING_ZONE::PAINT_GL);
 	clear_screen();
 	draw_landscape(this->light_color.w());
+	if (show_timing_overlay) draw_timing_overlay();
 	do_repaint = false;
 }
 
+void Widget_OpenGl::draw_timing_overlay()
+{
+	vector<string> lines = Profiler::get_instance()->get_summary();
+	const Render_queue_stats& stats = render_queue.get_stats();
+	ostringstream oss;
+	oss << "draws: " << stats.draws << " (" << stats.blended << " blended), programs: " << stats.programs <<
+		", textures: " << stats.textures << ", vertex buffers: " << stats.vertex_buffers <<
+		", uniforms: " << stats.uniforms;
+	lines.push_back(oss.str());
+	QPainter painter(this);
+	QFont font("Monospace");
+	font.setStyleHint(QFont::TypeWriter);
+	painter.setFont(font);
+	painter.fillRect(5, 5, 420, 16*lines.size()+8, QColor(0,0,0,160));
+	painter.setPen(QColor(Qt::yellow));
+	int y = 20;
+	for (vector<string>::const_iterator CI=lines.begin();CI!=lines.end();CI++)
+	{
+		painter.drawText(10, y, QString(CI->c_str()));
+		y += 16;
+	}
+	painter.end();
+	// QPainter leaves the openGL state modified.
+	set_context_to_default_state();
+}
+
 float Widget_OpenGl::get_Gl_mouse_x(bool clamp)
 {
 	float val = (2*(float)(mapFromGlobal(QCursor::pos()).x())/(float)(this->width()))-1;
@@ -831,18 +713,44 @@ float Widget_OpenGl::get_Gl_mouse_y(bool clamp)
 	return val;
 }
 
+E_POSSIBLE_PLAYER_ACTION Widget_OpenGl::get_mouse_target(QPoint& board_pos, Figure*& figure)
+{
+	float x = get_Gl_mouse_x(true);
+	float y = get_Gl_mouse_y(true);
+	if (use_gpu_picking && gpu_picker)
+	{
+		makeCurrent();
+		gpu_picker->collect();
+		doneCurrent();
+		if (gpu_picker->get_target(x, y, game->get_player()->get_viewer_data()->get_camera(),
+			game->get_board_revision(), board_pos, figure))
+		{
+			return game->get_possible_interactions(board_pos, figure);
+		}
+	}
+	E_POSSIBLE_PLAYER_ACTION action;
+	if (hover_picker && hover_picker->get_target(x, y, board_pos, figure, action)) return action;
+	// The worker has not caught up yet. Pick right here.
+	return game->get_mouse_target(x, y, board_pos, figure);
+}
+
+void Widget_OpenGl::mouseMoveEvent(QMouseEvent* e)
+{
+	if (hover_picker && !use_gpu_picking) hover_picker->request(get_Gl_mouse_x(true), get_Gl_mouse_y(true));
+	e->accept();
+}
 
 void Widget_OpenGl::mouseReleaseEvent(QMouseEvent* e)
 {
 	if (!game) return;
 	Qt::MouseButton button = e->button();
-	Viewer_Data* vd = game->get_player()->get_viewer_data();
-	Player_Data* pd = game->get_player();
-	E_GAME_STATUS status = game->get_status();
 	bool running = !is_paused();
 	switch (button)
 	{
 		case Qt::MouseButton::LeftButton:
+		{
+			QMutexLocker locker(game->get_mutex());
+			E_GAME_STATUS status = game->get_status();
 			if (status==E_GAME_STATUS::SURVEY)
 			{
 				if (running)
@@ -857,19 +765,21 @@ void Widget_OpenGl::mouseReleaseEvent(QMouseEvent* e)
 				request_restart_game();
 				request_paintGL();
 			} else {
-				if (running) pd->switch_cursor_mode();
+				if (running) game->get_player()->switch_cursor_mode();
 			}
 			break;
+		}
 		case Qt::MouseButton::RightButton:
 			if (running)
 			{
-				game->do_u_turn();
+				pending_u_turn = !pending_u_turn;
 			}
 			break;
 		case Qt::MouseButton::MiddleButton:
 			if (running)
 			{
-				vd->set_opening(get_player_data()->get_opening_default());
+				pending_zoom_reset = true;
+				pending_zoom = 0;
 			}
 			break;
 		default: break;
@@ -888,19 +798,42 @@ void Widget_OpenGl::update_zoom(float dFOV)
 	vd->set_opening(opening);
 }
 
+void Widget_OpenGl::apply_pending_view_input()
+{
+	if (pending_u_turn)
+	{
+		game->do_u_turn();
+		pending_u_turn = false;
+		do_repaint = true;
+	}
+	if (pending_zoom_reset)
+	{
+		get_viewer_data()->set_opening(get_player_data()->get_opening_default());
+		pending_zoom_reset = false;
+		do_repaint = true;
+	}
+	if (pending_zoom != 0)
+	{
+		update_zoom(pending_zoom);
+		pending_zoom = 0;
+		do_repaint = true;
+	}
+}
+
 void Widget_OpenGl::wheelEvent(QWheelEvent* e)
 {
 	if ((!is_paused()) && game && !e->angleDelta().isNull())
 	{
 		// +-120, -120: turned towards user.
 		float angle = -(float)(e->angleDelta().y())/60.;
-		update_zoom(angle);
+		pending_zoom += angle;
 	}
 	e->accept();
 }
 
 void Widget_OpenGl::player_dynamic_rotation(float framerate, float center)
 {
+	Timing_zone timing(E_TIMING_ZONE::PLAYER_ROTATION);
 	if (get_player_data()->get_cursor_mode()) return;
 	float dt = 1./framerate;
 	float x = get_Gl_mouse_x();
@@ -935,11 +868,73 @@ void Widget_OpenGl::player_dynamic_rotation(float framerate, float center)
 
 void Widget_OpenGl::update_after_dt()
 {
-	if (is_paused() || !game) return;
-	player_dynamic_rotation(framerate);
-	bool had_progress = game->do_progress(1./((float)framerate));
-	do_repaint = do_repaint || had_progress;
-	update();
+	if (!game) return;
+	Timing_zone timing(E_TIMING_ZONE::UPDATE_AFTER_DT);
+	// The frame does not wait for the simulation. If the game is busy
+	// the rotation of this frame is skipped and its publication postponed.
+	if (game->get_mutex()->tryLock())
+	{
+		apply_pending_view_input();
+		if (!is_paused()) player_dynamic_rotation(framerate);
+		// Changes made from this side (view, input) are published here.
+		// The simulation thread publishes its own progress.
+		if (do_repaint || is_snapshot_stale) game->publish_snapshot();
+		is_snapshot_stale = false;
+		game->get_mutex()->unlock();
+	} else {
+		is_snapshot_stale = is_snapshot_stale || do_repaint;
+	}
+	bool had_progress = game->get_snapshots()->acquire();
+	// The view or the board may have moved under a resting mouse. The
+	// pickers only pick anew if they did.
+	float mouse_x = get_Gl_mouse_x(true);
+	float mouse_y = get_Gl_mouse_y(true);
+	bool hover_changed;
+	if (use_gpu_picking && gpu_picker)
+	{
+		makeCurrent();
+		gpu_picker->update(mouse_x, mouse_y, width(), height(),
+			game->get_landscape(), game->get_snapshots()->get_front());
+		set_context_to_default_state();
+		doneCurrent();
+		hover_changed = gpu_picker->has_changed();
+	} else {
+		hover_picker->request(mouse_x, mouse_y);
+		hover_changed = hover_picker->has_changed();
+	}
+	// The overlay's percentiles change all the time.
+	do_repaint = do_repaint || had_progress || hover_changed || show_timing_overlay;
+	if (!is_paused() || do_repaint) update();
+}
+
+void Widget_OpenGl::set_game(Game* game)
+{
+	if (simulation)
+	{
+		if (io) io->println(E_DEBUG_LEVEL::VERBOSE, "set_game()", "Stopping the simulation thread.");
+		delete simulation; // Stops and joins the thread.
+		simulation = 0;
+	}
+	if (hover_picker)
+	{
+		delete hover_picker; // Stops and joins the thread.
+		hover_picker = 0;
+	}
+	this->game = game;
+	pending_zoom = 0;
+	pending_zoom_reset = false;
+	pending_u_turn = false;
+	is_snapshot_stale = false;
+	if (game)
+	{
+		simulation = new Simulation_thread(game, framerate);
+		simulation->set_paused(is_paused());
+		simulation->start();
+		hover_picker = new Hover_picker(game);
+		hover_picker->start();
+	}
+	if (gpu_picker) gpu_picker->invalidate();
+	do_repaint = true;
 }
 
 void Widget_OpenGl::request_paintGL()
@@ -999,61 +994,16 @@ void Widget_OpenGl::modify_brightness(float factor)
 void Widget_OpenGl::keyPressEvent(QKeyEvent* e)
 {
 	if (!game) { e->ignore(); return; }
-	QPoint board_pos(-1,-1);
-	Figure* figure=0;
-	E_POSSIBLE_PLAYER_ACTION action = game->get_mouse_target(
-		get_Gl_mouse_x(true), get_Gl_mouse_y(true), board_pos, figure);
 	bool running = !is_paused();
+	//> Keys of the view and the GUI. They never wait for the simulation.
+	bool is_handled = true;
 	switch(e->key())
 	{
 		case Qt::Key_Escape: exit_requested(); break;
-		case Qt::Key_A: // Absorb object.
-			if (running && (action == E_POSSIBLE_PLAYER_ACTION::ABSMANI ||
-				action == E_POSSIBLE_PLAYER_ACTION::ABSORPTION))
-			{
-				game->disintegrate_figure(board_pos,true);
-			}
-			break;
-		case Qt::Key_T: // Manifest tree.
-			if (running && (action == E_POSSIBLE_PLAYER_ACTION::ABSMANI ||
-				action == E_POSSIBLE_PLAYER_ACTION::MANIFESTATION))
-			{
-				game->manifest_figure(board_pos,E_FIGURE_TYPE::TREE,true);
-			}
-			break;
-		case Qt::Key_B: // Manifest block.
-			if (running && (action == E_POSSIBLE_PLAYER_ACTION::ABSMANI ||
-				action == E_POSSIBLE_PLAYER_ACTION::MANIFESTATION))
-			{
-				game->manifest_figure(board_pos,E_FIGURE_TYPE::BLOCK,true);
-			}
-			break;
-		case Qt::Key_R: // Manifest robot.
-			if (running && (action == E_POSSIBLE_PLAYER_ACTION::ABSMANI ||
-				action == E_POSSIBLE_PLAYER_ACTION::MANIFESTATION))
-			{
-				game->manifest_figure(board_pos,E_FIGURE_TYPE::ROBOT,true);
-			}
-			break;
-		case Qt::Key_Q: // Transfer consciousness.
-			if (running && (action == E_POSSIBLE_PLAYER_ACTION::EXCHANGE))
-			{
-				game->transfer(board_pos);
-			}
-			break;
 		case Qt::Key_U: // Attempt u-turn.
 			if (running)
 			{
-				game->do_u_turn();
-			}
-			break;
-		case Qt::Key_H: // Hyperjump.
-			if (running)
-			{
-				if (game->hyperspace_request())
-				{
-					request_paintGL();
-				}
+				pending_u_turn = !pending_u_turn;
 			}
 			break;
 		case Qt::Key_Space: // Toggle cursor mode.
@@ -1071,16 +1021,6 @@ void Widget_OpenGl::keyPressEvent(QKeyEvent* e)
 				);
 				break;
 			}
-		case Qt::Key_P: // Toggle user driven pause mode.
-			if (this->underMouse())
-			{
-				is_user_paused = !is_user_paused;
-				is_auto_paused = false;
-				if (is_user_paused) { game->pause_timers(); }
-				else { game->unpause_timers(); }
-				display_pause_game();
-			}
-			break;
 		case Qt::Key_F: // Toggle fullscreen mode.
 			{
 				fullscreen_key_pressed();
@@ -1090,21 +1030,20 @@ void Widget_OpenGl::keyPressEvent(QKeyEvent* e)
 		case Qt::Key_Plus: // Zoom in.
 			if (running)
 			{
-				update_zoom(-DEFAULT_DELTA_ZOOM);
+				pending_zoom -= DEFAULT_DELTA_ZOOM;
 			}
 			break;
 		case Qt::Key_Minus: // Zoom out.
 			if (running)
 			{
-				update_zoom(DEFAULT_DELTA_ZOOM);
+				pending_zoom += DEFAULT_DELTA_ZOOM;
 			}
 			break;
 		case Qt::Key_Period: // Normalize zoom.
 			if (running)
 			{
-				game->get_player()->get_viewer_data()->
-					set_opening(get_player_data()->get_opening_default());
-				request_paintGL();
+				pending_zoom_reset = true;
+				pending_zoom = 0;
 			}
 			break;
 		case Qt::Key_1: // Darken image.
@@ -1122,6 +1061,100 @@ void Widget_OpenGl::keyPressEvent(QKeyEvent* e)
 				modify_brightness(1./.95);
 			}
 			break;
+		case Qt::Key_I: // Toggle the timing overlay.
+			{
+				show_timing_overlay = !show_timing_overlay;
+				request_paintGL();
+			}
+			break;
+		case Qt::Key_G: // Toggle picking on the GPU.
+			{
+				if (gpu_picker)
+				{
+					use_gpu_picking = !use_gpu_picking;
+					update_parent_statusBar_text(use_gpu_picking ?
+						QObject::tr("Picking on the GPU.") :
+						QObject::tr("Picking on the CPU."));
+				} else {
+					update_parent_statusBar_text(
+						QObject::tr("Picking on the GPU is not supported here."));
+				}
+			}
+			break;
+		case Qt::Key_E: // Export the recorded timings.
+			{
+				string pfname = "sentinel_trace.json";
+				update_parent_statusBar_text(
+					Profiler::get_instance()->export_chrome_trace(pfname) ?
+						QObject::tr("Timings written to ") + QString(pfname.c_str()) :
+						QObject::tr("Unable to write ") + QString(pfname.c_str())
+				);
+			}
+			break;
+		default: is_handled = false;
+	}
+	if (is_handled) return;
+	//<
+	//> Keys acting on the game. They serialize with the simulation.
+	QMutexLocker locker(game->get_mutex());
+	QPoint board_pos(-1,-1);
+	Figure* figure=0;
+	E_POSSIBLE_PLAYER_ACTION action = get_mouse_target(board_pos, figure);
+	switch(e->key())
+	{
+		case Qt::Key_A: // Absorb object.
+			if (running && (action == E_POSSIBLE_PLAYER_ACTION::ABSMANI ||
+				action == E_POSSIBLE_PLAYER_ACTION::ABSORPTION))
+			{
+				game->disintegrate_figure(board_pos,true);
+			}
+			break;
+		case Qt::Key_T: // Manifest tree.
+			if (running && (action == E_POSSIBLE_PLAYER_ACTION::ABSMANI ||
+				action == E_POSSIBLE_PLAYER_ACTION::MANIFESTATION))
+			{
+				game->manifest_figure(board_pos,E_FIGURE_TYPE::TREE,true);
+			}
+			break;
+		case Qt::Key_B: // Manifest block.
+			if (running && (action == E_POSSIBLE_PLAYER_ACTION::ABSMANI ||
+				action == E_POSSIBLE_PLAYER_ACTION::MANIFESTATION))
+			{
+				game->manifest_figure(board_pos,E_FIGURE_TYPE::BLOCK,true);
+			}
+			break;
+		case Qt::Key_R: // Manifest robot.
+			if (running && (action == E_POSSIBLE_PLAYER_ACTION::ABSMANI ||
+				action == E_POSSIBLE_PLAYER_ACTION::MANIFESTATION))
+			{
+				game->manifest_figure(board_pos,E_FIGURE_TYPE::ROBOT,true);
+			}
+			break;
+		case Qt::Key_Q: // Transfer consciousness.
+			if (running && (action == E_POSSIBLE_PLAYER_ACTION::EXCHANGE))
+			{
+				game->transfer(board_pos);
+			}
+			break;
+		case Qt::Key_H: // Hyperjump.
+			if (running)
+			{
+				if (game->hyperspace_request())
+				{
+					request_paintGL();
+				}
+			}
+			break;
+		case Qt::Key_P: // Toggle user driven pause mode.
+			if (this->underMouse())
+			{
+				is_user_paused = !is_user_paused;
+				is_auto_paused = false;
+				if (is_user_paused) { game->pause_timers(); }
+				else { game->unpause_timers(); }
+				display_pause_game();
+			}
+			break;
 		case Qt::Key_S: // Analyze scanned object.
 			{
 				game->handle_scan_key(action, board_pos, figure);
@@ -1134,5 +1167,6 @@ void Widget_OpenGl::keyPressEvent(QKeyEvent* e)
 			break;
 		default: e->ignore(); // Propagate this keypress to parent QObject.
 	}
+	//<
 }
 }
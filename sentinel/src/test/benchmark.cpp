@@ -0,0 +1,166 @@
+/**
+ * Sentinel Gl -- an OpenGL based remake of the Firebird classic the Sentinel.
+ * Copyright (C) May 25th, 2015 Markus-Hermann Koch, mhk@markuskoch.eu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * Microbenchmarks of the kernels that have more than one implementation.
+ * Prints their throughput on the terrain of TEST_SEED. Fails if the
+ * implementations do not agree: The line of sight kernels on any line,
+ * the vector math and QMatrix4x4 by more than VEC_MATH_TOLERANCE.
+ * Runs on its own, never within the game.
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <QApplication>
+#include "test_world.h"
+#include "line_of_sight.h"
+#include "vec_math.h"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+using namespace mhk_test;
+
+namespace
+{
+/** Largest deviation of Rotation_2d and Mat4 from QMatrix4x4 allowed.
+ * Relative to the length of the result of Qt, if that exceeds 1. */
+const float VEC_MATH_TOLERANCE = 1.e-6;
+
+/** Traces the given number of random lines of sight with each supported
+ * kernel.
+ * @return the number of lines the scalar kernel judges differently. */
+int count_line_of_sight_disagreements(Landscape* landscape, int lines)
+{
+	const int* altitudes = landscape->get_altitudes();
+	int width = landscape->get_width();
+	int height = landscape->get_height();
+	const int BATCH_SIZE = 64;
+	unsigned int random = 54321;
+	int res = 0;
+	Line_of_sight_batch batch;
+	vector<unsigned char> visible_scalar;
+	for (int traced=0;traced<lines;traced+=BATCH_SIZE)
+	{
+		random = random*1103515245 + 12345;
+		int eye_x = (random>>8) % width;
+		random = random*1103515245 + 12345;
+		int eye_y = (random>>8) % height;
+		random = random*1103515245 + 12345;
+		QVector3D eye((float)eye_x, (float)eye_y,
+			altitudes[eye_y*width+eye_x] + .5f + (float)((random>>8) % 350)/100.f);
+		batch.clear();
+		for (int j=0;j<BATCH_SIZE;j++)
+		{
+			random = random*1103515245 + 12345;
+			int x = (random>>8) % width;
+			random = random*1103515245 + 12345;
+			int y = (random>>8) % height;
+			QPoint target(x,y);
+			batch.add(eye, target, (float)altitudes[y*width+x],
+				get_line_of_sight_steps(eye, target));
+		}
+		trace_lines_of_sight(eye, landscape, batch, E_LOS_KERNEL::SCALAR);
+		visible_scalar = batch.visible;
+		trace_lines_of_sight(eye, landscape, batch, E_LOS_KERNEL::AVX2);
+		for (int j=0;j<BATCH_SIZE;j++)
+		{
+			if (batch.visible[j] != visible_scalar[j]) res++;
+		}
+	}
+	return res;
+}
+
+/** @return the relative deviation of a from the reference b. */
+float get_deviation(const QVector4D& a, const QVector4D& b)
+{
+	float length = b.length();
+	return (a-b).length() / (length > 1 ? length : 1);
+}
+
+/** Turns random points around the z axis and projects them with the
+ * camera of benchmark_vec_math(..), once with QMatrix4x4 and once with
+ * Rotation_2d and Mat4.
+ * @return the largest deviation of the two by get_deviation(..). */
+float get_vec_math_deviation(int n)
+{
+	QMatrix4x4 camera;
+	camera.setToIdentity();
+	camera.perspective(60, 4./3., .1, 100);
+	camera.lookAt(QVector3D(3,5,7), QVector3D(32,32,0), QVector3D(0,0,1));
+	Mat4 A(camera);
+	unsigned int random = 54321;
+	float res = 0;
+	for (int j=0;j<n;j++)
+	{
+		random = random*1103515245 + 12345;
+		float angle = (float)((random>>8) % 36000)/100.f;
+		float f[3];
+		for (int k=0;k<3;k++)
+		{
+			random = random*1103515245 + 12345;
+			f[k] = (float)((random>>8) % 6400)/100.f;
+		}
+		QVector3D point(f[0], f[1], f[2]);
+		QMatrix4x4 rot; rot.setToIdentity();
+		rot.rotate(angle,QVector3D(0,0,1));
+		res = std::max(res, get_deviation(
+			QVector4D(Rotation_2d(angle).apply_z(point),1), QVector4D(rot*point,1)));
+		res = std::max(res, get_deviation(
+			(A*Vec4(point)).to_QVector4D(), camera*QVector4D(point,1)));
+	}
+	return res;
+}
+}
+
+int main(int argc, char** argv)
+{
+	QApplication app(argc, argv);
+	const int LINES = 1<<16;
+	int res = 0;
+	try
+	{
+		Test_world world(TEST_SEED, 50, 50, 3, false);
+		Landscape* landscape = world.game->get_landscape();
+		cout << "Line of sight kernels: " <<
+			benchmark_lines_of_sight(landscape, LINES) << endl;
+		if (is_line_of_sight_kernel_supported(E_LOS_KERNEL::AVX2))
+		{
+			int disagreements = count_line_of_sight_disagreements(landscape, LINES);
+			if (disagreements > 0)
+			{
+				cerr << "FAIL: The line of sight kernels disagree on " <<
+					disagreements << " of " << LINES << " lines." << endl;
+				res = 1;
+			}
+		}
+		cout << "Vector math: " << benchmark_vec_math(LINES) << endl;
+		float deviation = get_vec_math_deviation(LINES);
+		if (deviation > VEC_MATH_TOLERANCE)
+		{
+			cerr << "FAIL: The vector math deviates from QMatrix4x4 by " <<
+				deviation << "." << endl;
+			res = 1;
+		}
+	} catch (const char* msg) {
+		cerr << "FAIL: " << msg << endl;
+		res = 1;
+	}
+	return res;
+}
@@ -0,0 +1,139 @@
+/**
+ * Sentinel Gl -- an OpenGL based remake of the Firebird classic the Sentinel.
+ * Copyright (C) May 25th, 2015 Markus-Hermann Koch, mhk@markuskoch.eu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * Test: The Gpu_picker picks what Game::get_mouse_target(..) picks. The mouse
+ * is put on a grid across the view of the player at the start of the game
+ * on TEST_SEED. Both pick at each point. Points right on an edge may go
+ * either way. Hence a few disagreements are tolerated.
+ * Renders into an offscreen surface. Without OpenGL the test is skipped.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <QApplication>
+#include <QMutexLocker>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include "test_world.h"
+#include "gpu_picker.h"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::stringstream;
+
+using namespace mhk_test;
+
+namespace
+{
+/** ctest reports the test as skipped on this exit code. */
+const int EXIT_SKIPPED = 77;
+/** Mouse positions per row and column. */
+const int GRID = 41;
+/** Fraction of the mouse positions both pickers have to agree on. */
+const float MIN_AGREEMENT = .99;
+
+/** Compiles and links the "pick_id" program like Widget_OpenGl does. */
+bool link_pick_id(QOpenGLShaderProgram& program)
+{
+	stringstream src_vertex;
+	stringstream src_fragment;
+	if (!Io_Qt::get_stringstream_from_QFile(":/kernels/pick_id.vert",src_vertex)) return false;
+	if (!Io_Qt::get_stringstream_from_QFile(":/kernels/pick_id.frag",src_fragment)) return false;
+	return program.addShaderFromSourceCode(QOpenGLShader::Vertex, src_vertex.str().c_str()) &&
+		program.addShaderFromSourceCode(QOpenGLShader::Fragment, src_fragment.str().c_str()) &&
+		program.link();
+}
+}
+
+int main(int argc, char** argv)
+{
+	QApplication app(argc, argv);
+	//> Offscreen OpenGL context. ------------------------------------
+	QOffscreenSurface surface;
+	surface.create();
+	QOpenGLContext context;
+	if (!surface.isValid() || !context.create() || !context.makeCurrent(&surface))
+	{
+		cout << "SKIP: No OpenGL context." << endl;
+		return EXIT_SKIPPED;
+	}
+	if (!Gpu_picker::is_supported())
+	{
+		cout << "SKIP: No framebuffer objects." << endl;
+		return EXIT_SKIPPED;
+	}
+	QOpenGLFunctions* gl = context.functions();
+	// As Widget_OpenGl::set_context_to_default_state() does.
+	gl->glEnable(GL_DEPTH_TEST);
+	gl->glEnable(GL_CULL_FACE);
+	gl->glCullFace(GL_FRONT);
+	//< --------------------------------------------------------------
+	int res = 1;
+	try
+	{
+		QOpenGLShaderProgram program;
+		if (!link_pick_id(program)) throw "Unable to build the pick_id program.";
+		Test_world world(TEST_SEED, 30, 30, 3, true);
+		Game* game = world.game;
+		QMutexLocker locker(game->get_mutex());
+		world.start();
+		game->publish_snapshot();
+		game->get_snapshots()->acquire();
+		const Render_snapshot* snapshot = game->get_snapshots()->get_front();
+		Gpu_picker picker(gl, &program);
+		int agreed = 0;
+		int figures = 0;
+		for (int j=0;j<GRID;j++)
+		{
+			for (int k=0;k<GRID;k++)
+			{
+				float x = -.98 + 1.96*(float)k/(float)(GRID-1);
+				float y = -.98 + 1.96*(float)j/(float)(GRID-1);
+				picker.update(x, y, TEST_VIEWPORT_WIDTH, TEST_VIEWPORT_HEIGHT,
+					game->get_landscape(), snapshot);
+				picker.collect();
+				const Hover_target& target = picker.get_latest();
+				QPoint board_pos(-1,-1);
+				Figure* figure = 0;
+				game->get_mouse_target(x, y, board_pos, figure);
+				if (target.board_pos == board_pos && target.figure == figure) agreed++;
+				if (figure) figures++;
+			}
+		}
+		int points = GRID*GRID;
+		cout << "The pickers agree on " << agreed << " of " << points <<
+			" points, " << figures << " of which on a figure." << endl;
+		if (figures == 0)
+		{
+			cerr << "FAIL: No figure in sight. The test does not cover them." << endl;
+		} else if ((float)agreed < MIN_AGREEMENT*(float)points) {
+			cerr << "FAIL: Too many disagreements." << endl;
+		} else {
+			cout << "PASS" << endl;
+			res = 0;
+		}
+	} catch (const char* msg) {
+		cerr << "FAIL: " << msg << endl;
+	}
+	context.doneCurrent();
+	return res;
+}
@@ -0,0 +1,79 @@
+/**
+ * Sentinel Gl -- an OpenGL based remake of the Firebird classic the Sentinel.
+ * Copyright (C) May 25th, 2015 Markus-Hermann Koch, mhk@markuskoch.eu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * Test: A steady-state game tick does not allocate. That is do_progress()
+ * with the scans, the attacks, the turning and the fading, followed by
+ * publish_snapshot(). The antagonists turn for two full periods first.
+ * Thereafter every scratch buffer and every sight has seen its largest
+ * size. The following full period must not allocate at all.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <QApplication>
+#include <QMutexLocker>
+#include "test_world.h"
+#include "profiler.h"
+
+#ifndef MHK_COUNT_ALLOCATIONS
+#error "The allocation test needs to be built with MHK_COUNT_ALLOCATIONS."
+#endif
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::ostringstream;
+
+using namespace mhk_test;
+
+int main(int argc, char** argv)
+{
+	QApplication app(argc, argv);
+	int res = 1;
+	try
+	{
+		Test_world world(TEST_SEED, 30, 30, 3, false);
+		Game* game = world.game;
+		// Every antagonist scans every tick. Thus each run does the same.
+		game->set_scan_budget(0);
+		QMutexLocker locker(game->get_mutex());
+		world.start();
+		int ticks_per_period = (int)(game->get_landscape()->get_antagonist_spin_period()*
+			TEST_FRAMERATE);
+		for (int j=0;j<2*ticks_per_period;j++) world.tick();
+		Allocation_count before = get_thread_allocations();
+		for (int j=0;j<ticks_per_period;j++) world.tick();
+		Allocation_count after = get_thread_allocations();
+		ostringstream oss;
+		oss << ticks_per_period << " ticks made " << (after.count - before.count) <<
+			" allocations (" << (after.bytes - before.bytes) << " B).";
+		if (game->get_status() != E_GAME_STATUS::RUNNING)
+		{
+			cerr << "FAIL: The game did not keep running. " << oss.str() << endl;
+		} else if (after.count != before.count) {
+			cerr << "FAIL: " << oss.str() << endl;
+		} else {
+			cout << "PASS: " << oss.str() << endl;
+			res = 0;
+		}
+	} catch (const char* msg) {
+		cerr << "FAIL: " << msg << endl;
+	}
+	return res;
+}
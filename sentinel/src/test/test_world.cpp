@@ -0,0 +1,121 @@
+/**
+ * Sentinel Gl -- an OpenGL based remake of the Firebird classic the Sentinel.
+ * Copyright (C) May 25th, 2015 Markus-Hermann Koch, mhk@markuskoch.eu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+#include <sstream>
+#include "test_world.h"
+
+using std::stringstream;
+
+namespace mhk_test
+{
+Mesh_Data* Test_world::load_mesh(string pfname_obj, bool do_transfer_to_GPU)
+{
+	stringstream ss;
+	if (!Io_Qt::get_stringstream_from_QFile(pfname_obj,ss)) throw ".obj file not found.";
+	Mesh_Data* object = new Mesh_Data(&io);
+	meshes.push_back(object);
+	if (!object->parse_blender_obj(Io::read_file(ss))) throw "Failure to parse .obj file.";
+	object->draw_mode = GL_TRIANGLES;
+	if (do_transfer_to_GPU && !object->transfer_vertices_and_elements_to_GPU())
+		throw "Failure to transfer a mesh to the GPU.";
+	return object;
+}
+
+void Test_world::tick()
+{
+	game->do_progress(1./TEST_FRAMERATE);
+	game->publish_snapshot();
+}
+
+void Test_world::start()
+{
+	game->end_survey();
+	// Absorbing a free square changes nothing but the game status.
+	Board<Figure>* board_fg = game->get_board_fg();
+	for (int y=0;y<board_fg->get_height();y++)
+	{
+		for (int x=0;x<board_fg->get_width();x++)
+		{
+			if (board_fg->get(x,y) == 0)
+			{
+				game->disintegrate_figure(QPoint(x,y),true);
+				if (game->get_status() != E_GAME_STATUS::RUNNING)
+					throw "The game did not start running.";
+				return;
+			}
+		}
+	}
+	throw "There is no free square.";
+}
+
+Test_world::Test_world(uint seed, int width, int height, int sentries, bool do_transfer_to_GPU)
+	: io(0, E_DEBUG_LEVEL::ERROR)
+{
+	this->parent = new QOpenGLWidget();
+	parent->resize(TEST_VIEWPORT_WIDTH,TEST_VIEWPORT_HEIGHT);
+	this->known_sounds = new Known_Sounds();
+	known_sounds->toggle_sound();
+	//> Setup as by the dialog, but without psi shield drain. --------
+	setup.lineEdit_campaign = "";
+	setup.horizontalSlider_challenge = 0;
+	setup.spinBox_sentries_max = sentries;
+	setup.spinBox_sentries = sentries;
+	setup.combobox_gravity = 1;
+	setup.combobox_age = 1;
+	setup.combobox_rotation_type = 0;
+	setup.spinBox_psi_shield = 100000;
+	setup.spinBox_confidence = 100000;
+	setup.spinBox_spin_period = 10;
+	setup.checkBox_meanies = false;
+	setup.checkBox_random_scenery = false;
+	setup.spinBox_rows = height;
+	setup.spinBox_cols = width;
+	setup.spinBox_self_spin = 12;
+	setup.spinBox_energy = 5;
+	setup.spinBox_object_resilience = 100000;
+	setup.spinBox_antagonist_fov = 60;
+	//< --------------------------------------------------------------
+	//> The meshes of the MASTER scenery. ----------------------------
+	Mesh_Data* mesh_connection = load_mesh(":/blender/plane.obj", do_transfer_to_GPU);
+	Mesh_Data* mesh_odd = load_mesh(":/blender/plane.obj", do_transfer_to_GPU);
+	Mesh_Data* mesh_even = load_mesh(":/blender/plane.obj", do_transfer_to_GPU);
+	Mesh_Data* mesh_sentinel = load_mesh(":/blender/sentinel.obj", do_transfer_to_GPU);
+	Mesh_Data* mesh_tower = load_mesh(":/blender/tower.obj", do_transfer_to_GPU);
+	Mesh_Data* mesh_sentry = load_mesh(":/blender/sentry.obj", do_transfer_to_GPU);
+	Mesh_Data* mesh_tree = load_mesh(":/blender/tree_master.obj", do_transfer_to_GPU);
+	Mesh_Data* mesh_robot = load_mesh(":/blender/robot.obj", do_transfer_to_GPU);
+	Mesh_Data* mesh_block = load_mesh(":/blender/block.obj", do_transfer_to_GPU);
+	Mesh_Data* mesh_meanie = load_mesh(":/blender/meanie.obj", do_transfer_to_GPU);
+	//< --------------------------------------------------------------
+	this->game = new Game(E_GAME_TYPE::CUSTOM, seed, &setup, parent, &io,
+		known_sounds, TEST_FRAMERATE, mesh_connection, mesh_odd, mesh_even,
+		mesh_sentinel, mesh_tower, mesh_sentry, mesh_tree, mesh_robot,
+		mesh_block, mesh_meanie);
+}
+
+Test_world::~Test_world()
+{
+	delete game;
+	for (vector<Mesh_Data*>::iterator IT=meshes.begin();IT!=meshes.end();IT++)
+	{
+		delete *IT;
+	}
+	delete known_sounds;
+	delete parent;
+}
+}
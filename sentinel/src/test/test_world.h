@@ -0,0 +1,85 @@
+/**
+ * Sentinel Gl -- an OpenGL based remake of the Firebird classic the Sentinel.
+ * Copyright (C) May 25th, 2015 Markus-Hermann Koch, mhk@markuskoch.eu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * A game on a fixed seed for the tests and the benchmark. The meshes are
+ * loaded the way Widget_OpenGl::initialize_objects() loads them, only
+ * without textures and programs. There is no window. Run with the
+ * offscreen platform plugin, i.e. QT_QPA_PLATFORM=offscreen, where there
+ * is no display.
+ */
+
+#ifndef MHK_TEST_WORLD_H
+#define MHK_TEST_WORLD_H
+
+#include <vector>
+#include <string>
+#include <QOpenGLWidget>
+#include "game.h"
+
+using std::vector;
+using std::string;
+
+using namespace game;
+
+namespace mhk_test
+{
+/** Seed of the landscape all tests run on. */
+const uint TEST_SEED = 20150525;
+const float TEST_FRAMERATE = 30.;
+/** Size of the view the player sees the world in. In pixels. */
+const int TEST_VIEWPORT_WIDTH = 800;
+const int TEST_VIEWPORT_HEIGHT = 600;
+
+class Test_world
+{
+private:
+	/** Player_Data takes the aspect ratio from it. It is never shown. */
+	QOpenGLWidget* parent;
+	Known_Sounds* known_sounds;
+	Setup_game_data setup;
+	/** All meshes. For deletion. */
+	vector<Mesh_Data*> meshes;
+
+	/** Parses the given .obj resource. Also transfers it to the GPU if
+	 * do_transfer_to_GPU. */
+	Mesh_Data* load_mesh(string pfname_obj, bool do_transfer_to_GPU);
+
+public:
+	Io_Qt io;
+	Game* game;
+
+	/** Steps the game like Simulation_thread::run() does, but publishes
+	 * a snapshot each tick. The caller is required to hold the game mutex. */
+	void tick();
+
+	/** Ends the SURVEY and has the game RUNNING without touching the board. */
+	void start();
+
+	/** Requires a QApplication. If do_transfer_to_GPU the meshes and the
+	 * squares go to the GPU as well. The OpenGL context needs to be current
+	 * then. Else they stay on the CPU, which is all Game needs.
+	 * @param int width, height: Board size in squares.
+	 * @param int sentries: Number of sentries besides The Sentinel.
+	 * Attacks never get further than draining the psi shield, nor does
+	 * any object ever give in. Thus the board only changes on request. */
+	Test_world(uint seed, int width, int height, int sentries, bool do_transfer_to_GPU);
+	~Test_world();
+};
+}
+#endif